@@ -8,6 +8,7 @@
 
 #include "sanitizer.hpp"
 #include "input.hpp"
+#include "text-scan.hpp"
 
 int sanitizerClose(void *context);
 int sanitizerProcess(void *context, char *buffer, int len);
@@ -96,6 +97,30 @@ int sanitizerProcess(void *context, char *buffer, int len)
           continue;
       }
 
+      /* Outside of a multi-byte char, copy the ASCII chars which are
+       * buffered in one go, which is most of the input */
+      if (ctx->state == 1) {
+          const char *data;
+          int ascii = inputPeek(ctx->file, &data);
+          if (ascii > len - out)
+              ascii = len - out;
+          ascii = text_scan::ascii_prefix(data, ascii);
+          if (ascii > 0) {
+              const char *nl = data, *end = data + ascii;
+              long long lines = 0;
+              while ((nl = (const char *)memchr(nl, '\n', end - nl))) {
+                  ++lines;
+                  ++nl;
+              }
+              ctx->line += lines;
+              ctx->chars1 += ascii - lines;
+              memcpy(buffer + out, data, ascii);
+              inputSkip(ctx->file, ascii);
+              out += ascii;
+              continue;
+          }
+      }
+
       current_char=inputGetChar(ctx->file);
       if (inputEof(ctx->file))
           break;
@@ -0,0 +1,105 @@
+/* Sending COPY data from a background thread, see copy-sender.hpp */
+
+#include "copy-sender.hpp"
+
+#include <stdexcept>
+
+#include <boost/bind.hpp>
+
+copy_sender::copy_sender(const std::string &context)
+    : context(context), thread(), conn(NULL), sending(), pending(false), quit(false), error()
+{
+}
+
+copy_sender::~copy_sender()
+{
+    stop();
+}
+
+void copy_sender::send(pg_conn *conn, std::string &data)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+
+    //the thread is started the first time there is something to send
+    if (!thread)
+    {
+        quit = false;
+        thread.reset(new boost::thread(boost::bind(&copy_sender::loop, this)));
+    }
+
+    //only one buffer can be in flight, so wait for the previous one
+    while (pending)
+        cond.wait(lock);
+
+    if (!error.empty())
+        throw std::runtime_error(error);
+
+    //swap the buffers and keep filling the other one while this one is sent
+    sending.swap(data);
+    data.clear();
+    this->conn = conn;
+    pending = true;
+    cond.notify_all();
+}
+
+void copy_sender::wait()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (pending)
+        cond.wait(lock);
+
+    if (!error.empty())
+    {
+        const std::string e = error;
+        error.clear();
+        throw std::runtime_error(e);
+    }
+}
+
+void copy_sender::stop()
+{
+    if (!thread)
+        return;
+
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        quit = true;
+        cond.notify_all();
+    }
+    thread->join();
+    thread.reset();
+}
+
+void copy_sender::loop()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (true)
+    {
+        while (!pending && !quit)
+            cond.wait(lock);
+
+        //finish sending before quitting so no data is lost
+        if (!pending)
+            break;
+
+        //the writing thread doesn't touch the connection or this buffer
+        //until pending is cleared, so send without holding the lock
+        lock.unlock();
+        std::string e;
+        try
+        {
+            pgsql_CopyData(context.c_str(), conn, sending.c_str());
+        }
+        catch (const std::exception &ex)
+        {
+            e = ex.what();
+        }
+        lock.lock();
+
+        if (!e.empty() && error.empty())
+            error = e;
+        sending.clear();
+        pending = false;
+        cond.notify_all();
+    }
+}
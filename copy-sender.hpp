@@ -0,0 +1,53 @@
+/* Sending COPY data from a background thread
+ *
+ * Rows are collected in a buffer which is handed over to a thread that
+ * sends it to PostgreSQL, while the next buffer is filled. Only one buffer
+ * is in flight at a time, and the connection must not be used for anything
+ * else until wait() has returned.
+*/
+
+#ifndef COPY_SENDER_H
+#define COPY_SENDER_H
+
+#include "pgsql.hpp"
+
+#include <string>
+
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+class copy_sender : public boost::noncopyable
+{
+public:
+    //the name of the table the data goes to, for error messages
+    explicit copy_sender(const std::string &context);
+    ~copy_sender();
+
+    //hands the data over to be sent on the connection and leaves data
+    //empty, after waiting for the previous data to be sent
+    void send(pg_conn *conn, std::string &data);
+
+    //waits until everything handed over has been sent, throws if sending failed
+    void wait();
+
+    //sends what has been handed over and stops the thread
+    void stop();
+
+private:
+    void loop();
+
+    std::string context;
+    boost::scoped_ptr<boost::thread> thread;
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    pg_conn *conn;
+    std::string sending;
+    bool pending;
+    bool quit;
+    std::string error;
+};
+
+#endif
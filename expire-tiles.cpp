@@ -13,6 +13,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <algorithm>
+#include <vector>
 #include "output.hpp"
 #include "options.hpp"
 #include "geometry-builder.hpp"
@@ -22,79 +24,49 @@
 #define EARTH_CIRCUMFERENCE		40075016.68
 #define HALF_EARTH_CIRCUMFERENCE	(EARTH_CIRCUMFERENCE / 2)
 #define TILE_EXPIRY_LEEWAY		0.1		/* How many tiles worth of space to leave either side of a changed feature */
-#define EXPIRE_TILES_MAX_BBOX		20000		/* Maximum width or height of a bounding box (metres) */
 
 namespace {
 /*
- * We store the dirty tiles in an in-memory tree during runtime
- * and dump them out to a file at the end.  This allows us to easilly drop
- * duplicate tiles from the output.
+ * We store the dirty tiles in memory during runtime and dump them out to a
+ * file at the end.  This allows us to easilly drop duplicate tiles from the
+ * output.
  *
- * This data structure consists of a node, representing a tile at zoom level 0,
- * which contains 4 pointers to nodes representing each of the child tiles at
- * zoom level 1, and so on down the the zoom level specified in
- * Options->expire_tiles_zoom.
+ * Each dirty tile at the zoom level specified in Options->expire_tiles_zoom
+ * is stored as its quadkey: the bits of its x and y coordinates interleaved,
+ * with x in the higher bit of each pair. Sorting the quadkeys keeps the tiles
+ * of each lower zoom tile together, so a run of 4^n consecutive quadkeys
+ * starting at a multiple of 4^n is a complete tile n zoom levels up.
  *
- * The memory allowed to this structure is not capped, but daily deltas
- * generally produce a few hundred thousand expired tiles at zoom level 17,
- * which are easilly accommodated.
+ * Daily deltas generally produce a few hundred thousand expired tiles at zoom
+ * level 17, which take 8 bytes each.
  */
 
-int calc_complete(struct expire_tiles::tile * tile) {
-	int	c;
-
-	c = tile->complete[0][0];
-	c += tile->complete[0][1];
-	c += tile->complete[1][0];
-	c += tile->complete[1][1];
-	return c;
-}
-
-void destroy_tree(struct expire_tiles::tile * tree) {
-	if (! tree) return;
-	if (tree->subtiles[0][0]) destroy_tree(tree->subtiles[0][0]);
-	if (tree->subtiles[0][1]) destroy_tree(tree->subtiles[0][1]);
-	if (tree->subtiles[1][0]) destroy_tree(tree->subtiles[1][0]);
-	if (tree->subtiles[1][1]) destroy_tree(tree->subtiles[1][1]);
-	free(tree);
+/* Minimum number of unsorted tiles that are collected before they are
+   sorted into the rest and duplicates are dropped */
+#define EXPIRE_TILES_MIN_UNSORTED	65536
+
+uint64_t spread_bits(uint32_t v) {
+	uint64_t x = v;
+	x = (x | (x << 16)) & 0x0000FFFF0000FFFFULL;
+	x = (x | (x << 8)) & 0x00FF00FF00FF00FFULL;
+	x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	x = (x | (x << 2)) & 0x3333333333333333ULL;
+	x = (x | (x << 1)) & 0x5555555555555555ULL;
+	return x;
 }
 
-/*
- * Mark a tile as dirty.
- * Returns the number of subtiles which have all their children marked as dirty.
- */
-int _mark_tile(struct expire_tiles::tile ** tree, int x, int y, int zoom, int this_zoom) {
-	int	zoom_diff = zoom - this_zoom;
-	int	rel_x;
-	int	rel_y;
-	int	complete;
-
-	if (! *tree) *tree = (struct expire_tiles::tile *)calloc(1, sizeof(**tree));
-	zoom_diff = (zoom - this_zoom) - 1;
-	rel_x = (x >> zoom_diff) & 1;
-	rel_y = (y >> zoom_diff) & 1;
-	if (! (*tree)->complete[rel_x][rel_y]) {
-		if (zoom_diff <= 0) {
-			(*tree)->complete[rel_x][rel_y] = 1;
-		} else {
-			complete = _mark_tile(&((*tree)->subtiles[rel_x][rel_y]), x, y, zoom, this_zoom + 1);
-			if (complete >= 4) {
-				(*tree)->complete[rel_x][rel_y] = 1;
-				/* We can destroy the subtree to save memory now all the children are dirty */
-				destroy_tree((*tree)->subtiles[rel_x][rel_y]);
-				(*tree)->subtiles[rel_x][rel_y] = NULL;
-			}
-		}
-	}
-	return calc_complete(*tree);
+uint32_t gather_bits(uint64_t x) {
+	x &= 0x5555555555555555ULL;
+	x = (x | (x >> 1)) & 0x3333333333333333ULL;
+	x = (x | (x >> 2)) & 0x0F0F0F0F0F0F0F0FULL;
+	x = (x | (x >> 4)) & 0x00FF00FF00FF00FFULL;
+	x = (x | (x >> 8)) & 0x0000FFFF0000FFFFULL;
+	x = (x | (x >> 16)) & 0x00000000FFFFFFFFULL;
+	return x;
 }
 
-/*
- * Mark a tile as dirty.
- * Returns the number of subtiles which have all their children marked as dirty.
- */
-int mark_tile(struct expire_tiles::tile ** tree_head, int x, int y, int zoom) {
-	return _mark_tile(tree_head, x, y, zoom, 0);
+uint64_t quadkey(int x, int y) {
+	return (spread_bits(x) << 1) | spread_bits(y);
 }
 
 void output_dirty_tile_impl(FILE * outfile, int x, int y, int zoom, int min_zoom, int &outcount) {
@@ -148,98 +120,36 @@ private:
   FILE *outfile;
 };
 
-void _output_and_destroy_tree(expire_tiles::tile_output *output, struct expire_tiles::tile * tree, int x, int y, int this_zoom, int min_zoom) {
-	int	sub_x = x << 1;
-	int	sub_y = y << 1;
-        expire_tiles::tile_output *out;
-
-	if (! tree) return;
-
-	out = output;
-	if ((tree->complete[0][0]) && output) {
-		output->output_dirty_tile(sub_x + 0, sub_y + 0, this_zoom + 1, min_zoom);
-		out = NULL;
-	}
-	if (tree->subtiles[0][0]) _output_and_destroy_tree(out, tree->subtiles[0][0], sub_x + 0, sub_y + 0, this_zoom + 1, min_zoom);
-
-	out = output;
-	if ((tree->complete[0][1]) && output) {
-		output->output_dirty_tile(sub_x + 0, sub_y + 1, this_zoom + 1, min_zoom);
-		out = NULL;
-	}
-	if (tree->subtiles[0][1]) _output_and_destroy_tree(out, tree->subtiles[0][1], sub_x + 0, sub_y + 1, this_zoom + 1, min_zoom);
-
-	out = output;
-	if ((tree->complete[1][0]) && output) {
-		output->output_dirty_tile(sub_x + 1, sub_y + 0, this_zoom + 1, min_zoom);
-		out = NULL;
-	}
-	if (tree->subtiles[1][0]) _output_and_destroy_tree(out, tree->subtiles[1][0], sub_x + 1, sub_y + 0, this_zoom + 1, min_zoom);
-
-	out = output;
-	if ((tree->complete[1][1]) && output) {
-		output->output_dirty_tile(sub_x + 1, sub_y + 1, this_zoom + 1, min_zoom);
-		out = NULL;
-	}
-	if (tree->subtiles[1][1]) _output_and_destroy_tree(out, tree->subtiles[1][1], sub_x + 1, sub_y + 1, this_zoom + 1, min_zoom);
-
-	free(tree);
-}
-
-// merge the two trees, destroying b in the process. returns the
-// number of completed subtrees.
-int _tree_merge(struct expire_tiles::tile **a,
-                struct expire_tiles::tile **b) {
-  if (*a == NULL) {
-    *a = *b;
-    *b = NULL;
-
-  } else if (*b != NULL) {
-    for (int x = 0; x < 2; ++x) {
-      for (int y = 0; y < 2; ++y) {
-        // if b is complete on a subtree, then the merged tree must
-        // be complete too.
-        if ((*b)->complete[x][y]) {
-          (*a)->complete[x][y] = (*b)->complete[x][y];
-          destroy_tree((*a)->subtiles[x][y]);
-          (*a)->subtiles[x][y] = NULL;
-
-          // but if a is already complete, don't bother moving across
-          // anything
-        } else if (!(*a)->complete[x][y]) {
-          int complete = _tree_merge(&((*a)->subtiles[x][y]), &((*b)->subtiles[x][y]));
-
-          if (complete >= 4) {
-            (*a)->complete[x][y] = 1;
-            destroy_tree((*a)->subtiles[x][y]);
-            (*a)->subtiles[x][y] = NULL;
-          }
-        }
-
-        destroy_tree((*b)->subtiles[x][y]);
-        (*b)->subtiles[x][y] = NULL;
-      }
-    }
-  }
-
-  // count the number complete, so we can return it
-  int a_complete = 0;
-  for (int x = 0; x < 2; ++x) {
-    for (int y = 0; y < 2; ++y) {
-      if ((*a != NULL) && ((*a)->complete[x][y])) {
-        ++a_complete;
-      }
-    }
-  }
-
-  return a_complete;
-}
-
 } // anonymous namespace
 
+/*
+ * Output the dirty tiles, combining each complete group of tiles into the
+ * tile at the lowest zoom level that covers it exactly. Zoom level 0 is never
+ * output, as it would only ever be the whole planet.
+ */
 void expire_tiles::output_and_destroy(tile_output *output) {
-    _output_and_destroy_tree(output, dirty, 0, 0, 0, Options->expire_tiles_zoom_min);
-    dirty = NULL;
+	const int zoom = Options->expire_tiles_zoom;
+	size_t i = 0;
+	int levels;
+	uint64_t run;
+
+	compact();
+	while (i < dirty.size()) {
+		/* Find the largest complete, aligned run of tiles starting here */
+		for (levels = std::max(zoom - 1, 0); levels > 0; levels--) {
+			run = uint64_t(1) << (2 * levels);
+			if ((dirty[i] & (run - 1)) == 0 &&
+			    i + run <= dirty.size() &&
+			    dirty[i + run - 1] == dirty[i] + run - 1) break;
+		}
+		output->output_dirty_tile(gather_bits(dirty[i] >> 1) >> levels,
+		                          gather_bits(dirty[i]) >> levels,
+		                          zoom - levels, Options->expire_tiles_zoom_min);
+		i += size_t(1) << (2 * levels);
+	}
+
+	std::vector<uint64_t>().swap(dirty);
+	dirty_sorted = 0;
 }
 
 void expire_tiles::output_and_destroy() {
@@ -251,58 +161,71 @@ void expire_tiles::output_and_destroy() {
 }
 
 expire_tiles::~expire_tiles() {
-  if (dirty != NULL) {
-    destroy_tree(dirty);
-    dirty = NULL;
-  }
 }
 
 expire_tiles::expire_tiles(const struct options_t *options)
-    : Options(options), map_width(0), tile_width(0),
-      dirty(NULL)
+    : map_width(0), tile_width(0), simplify_tolerance(0), Options(options),
+      dirty_sorted(0)
 {
 	if (Options->expire_tiles_zoom < 0) return;
 	map_width = 1 << Options->expire_tiles_zoom;
 	tile_width = EARTH_CIRCUMFERENCE / map_width;
+
+	/* Geometries read back from the database are simplified to well within
+	   the leeway. Only the mercator projections have units close enough to
+	   those of the tiles to know how far that is. */
+	if (Options->projection->get_proj_id() == PROJ_SPHERE_MERC ||
+	    Options->projection->get_proj_id() == PROJ_MERC)
+		simplify_tolerance = tile_width * TILE_EXPIRY_LEEWAY / 2;
 }
 
 void expire_tiles::expire_tile(int x, int y) {
-	mark_tile(&dirty, x, y, Options->expire_tiles_zoom);
+	dirty.push_back(quadkey(x, y));
+	if (dirty.size() - dirty_sorted >= std::max(dirty_sorted, size_t(EXPIRE_TILES_MIN_UNSORTED))) {
+		compact();
+	}
+}
+
+/*
+ * Sort the tiles added since the last call into the sorted part and drop the
+ * duplicates.
+ */
+void expire_tiles::compact() {
+	std::sort(dirty.begin() + dirty_sorted, dirty.end());
+	std::inplace_merge(dirty.begin(), dirty.begin() + dirty_sorted, dirty.end());
+	dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+	dirty_sorted = dirty.size();
 }
 
 int expire_tiles::normalise_tile_x_coord(int x) {
 	x %= map_width;
-	if (x < 0) x = (map_width - x) + 1;
+	if (x < 0) x += map_width;
 	return x;
 }
 
 /*
- * Expire tiles that a line crosses
+ * Expire tiles that a line crosses. The ends of the line are given in tile
+ * coordinates, and every tile within TILE_EXPIRY_LEEWAY of the line is
+ * expired. The line is traversed one column of tiles at a time: in each
+ * column only the rows between where the line enters and leaves it (plus the
+ * leeway) are marked, so no tile is visited twice and none are missed.
  */
-void expire_tiles::from_line(double lon_a, double lat_a, double lon_b, double lat_b) {
-	double	tile_x_a;
-	double	tile_y_a;
-	double	tile_x_b;
-	double	tile_y_b;
+void expire_tiles::from_line(double tile_x_a, double tile_y_a, double tile_x_b, double tile_y_b) {
 	double	temp;
+	double	x_len;
+	double	y_len;
 	double	x1;
-	double	y1;
 	double	x2;
+	double	y1;
 	double	y2;
-	double	hyp_len;
-	double	x_len;
-	double	y_len;
-	double	x_step;
-	double	y_step;
-	double	step;
-	double	next_step;
+	int	min_x;
+	int	max_x;
+	int	min_y;
+	int	max_y;
 	int	x;
 	int	y;
 	int	norm_x;
 
-    Options->projection->coords_to_tile(&tile_x_a, &tile_y_a, lon_a, lat_a, map_width);
-    Options->projection->coords_to_tile(&tile_x_b, &tile_y_b, lon_b, lat_b, map_width);
-
 	if (tile_x_a > tile_x_b) {
 		/* We always want the line to go from left to right - swap the ends if it doesn't */
 		temp = tile_x_b;
@@ -325,36 +248,38 @@ void expire_tiles::from_line(double lon_a, double lat_a, double lon_b, double la
 		temp = tile_y_b;
 		tile_y_b = tile_y_a;
 		tile_y_a = temp;
+		x_len = tile_x_b - tile_x_a;
 	}
 	y_len = tile_y_b - tile_y_a;
-	hyp_len = sqrt(pow(x_len, 2) + pow(y_len, 2));	/* Pythagoras */
-	x_step = x_len / hyp_len;
-	y_step = y_len / hyp_len;
-
-	for (step = 0; step <= hyp_len; step+= 0.4) {
-		/* Interpolate points 1 tile width apart */
-		next_step = step + 0.4;
-		if (next_step > hyp_len) next_step = hyp_len;
-		x1 = tile_x_a + ((double)step * x_step);
-		y1 = tile_y_a + ((double)step * y_step);
-		x2 = tile_x_a + ((double)next_step * x_step);
-		y2 = tile_y_a + ((double)next_step * y_step);
-
-		/* The line (x1,y1),(x2,y2) is up to 1 tile width long
-           x1 will always be <= x2
-           We could be smart and figure out the exact tiles intersected,
-           but for simplicity, treat the coordinates as a bounding box
-           and expire everything within that box. */
+
+	min_x = floor(tile_x_a - TILE_EXPIRY_LEEWAY);
+	max_x = floor(tile_x_b + TILE_EXPIRY_LEEWAY);
+	for (x = min_x; x <= max_x; x++) {
+		/* The part of the line that is within the leeway of this column */
+		x1 = x - TILE_EXPIRY_LEEWAY;
+		x2 = x + 1 + TILE_EXPIRY_LEEWAY;
+		if (x1 < tile_x_a) x1 = tile_x_a;
+		if (x2 > tile_x_b) x2 = tile_x_b;
+		if (x_len > 0) {
+			y1 = tile_y_a + (x1 - tile_x_a) * y_len / x_len;
+			y2 = tile_y_a + (x2 - tile_x_a) * y_len / x_len;
+		} else {
+			y1 = tile_y_a;
+			y2 = tile_y_b;
+		}
 		if (y1 > y2) {
 			temp = y2;
 			y2 = y1;
 			y1 = temp;
 		}
-		for (x = x1 - TILE_EXPIRY_LEEWAY; x <= x2 + TILE_EXPIRY_LEEWAY; x ++) {
-			norm_x =  normalise_tile_x_coord(x);
-			for (y = y1 - TILE_EXPIRY_LEEWAY; y <= y2 + TILE_EXPIRY_LEEWAY; y ++) {
-				expire_tile(norm_x, y);
-			}
+
+		min_y = floor(y1 - TILE_EXPIRY_LEEWAY);
+		max_y = floor(y2 + TILE_EXPIRY_LEEWAY);
+		if (min_y < 0) min_y = 0;
+		if (max_y >= map_width) max_y = map_width - 1;
+		norm_x = normalise_tile_x_coord(x);
+		for (y = min_y; y <= max_y; y++) {
+			expire_tile(norm_x, y);
 		}
 	}
 }
@@ -388,8 +313,8 @@ int expire_tiles::from_bbox(double min_lon, double min_lat, double max_lon, doub
 		return ret;
 	}
 
-	if (width > EXPIRE_TILES_MAX_BBOX) return -1;
-	if (height > EXPIRE_TILES_MAX_BBOX) return -1;
+	if (width > Options->expire_tiles_max_bbox) return -1;
+	if (height > Options->expire_tiles_max_bbox) return -1;
 
 
 	/* Convert the box's Mercator coordinates into tile coordinates */
@@ -414,56 +339,183 @@ int expire_tiles::from_bbox(double min_lon, double min_lat, double max_lon, doub
 
 void expire_tiles::from_nodes_line(const struct osmNode * nodes, int count) {
 	int	i;
-	double	last_lat;
-	double	last_lon;
 
 	if (Options->expire_tiles_zoom < 0) return;
 	if (count < 1) return;
-	last_lat = nodes[0].lat;
-	last_lon = nodes[0].lon;
 	if (count < 2) {
-		from_bbox(last_lon, last_lat, last_lon, last_lat);
+		from_bbox(nodes[0].lon, nodes[0].lat, nodes[0].lon, nodes[0].lat);
 		return;
 	}
-	for (i = 1; i < count; i ++) {
-		from_line(last_lon, last_lat, nodes[i].lon, nodes[i].lat);
-		last_lat = nodes[i].lat;
-		last_lon = nodes[i].lon;
+
+	/* Project each node only once, the segments share their ends */
+	std::vector<double> tile_x(count);
+	std::vector<double> tile_y(count);
+	for (i = 0; i < count; i++) {
+		Options->projection->coords_to_tile(&tile_x[i], &tile_y[i], nodes[i].lon, nodes[i].lat, map_width);
+	}
+	for (i = 1; i < count; i++) {
+		from_line(tile_x[i - 1], tile_y[i - 1], tile_x[i], tile_y[i]);
 	}
 }
 
 /*
- * Calculate a bounding box from a list of nodes and expire all tiles within it
+ * The rings of a polygon in tile coordinates
  */
-void expire_tiles::from_nodes_poly(const struct osmNode * nodes, int count, osmid_t osm_id) {
+struct expire_tiles::tile_rings {
+	std::vector<double> x;
+	std::vector<double> y;
+	std::vector<size_t> ends;	/* Each ring ends before the point at this index */
+	double min_x;
+	double min_y;
+	double max_x;
+	double max_y;
+};
+
+void expire_tiles::project_rings(const struct osmNode * const * xnodes, const int * xcount, tile_rings &rings) {
+	double	tile_x;
+	double	tile_y;
 	int	i;
-	int	got_coords = 0;
-	double	min_lon = 0.0;
-	double	min_lat = 0.0;
-	double	max_lon = 0.0;
-	double	max_lat = 0.0;
+	int	j;
+
+	for (i = 0; xnodes[i]; i++) {
+		for (j = 0; j < xcount[i]; j++) {
+			Options->projection->coords_to_tile(&tile_x, &tile_y, xnodes[i][j].lon, xnodes[i][j].lat, map_width);
+			if (rings.x.empty() || tile_x < rings.min_x) rings.min_x = tile_x;
+			if (rings.x.empty() || tile_y < rings.min_y) rings.min_y = tile_y;
+			if (rings.x.empty() || tile_x > rings.max_x) rings.max_x = tile_x;
+			if (rings.x.empty() || tile_y > rings.max_y) rings.max_y = tile_y;
+			rings.x.push_back(tile_x);
+			rings.y.push_back(tile_y);
+		}
+		rings.ends.push_back(rings.x.size());
+	}
+}
 
-	if (Options->expire_tiles_zoom < 0) return;
-	for (i = 0; i < count; i++) {
-		if ((! got_coords) || (nodes[i].lon < min_lon)) min_lon = nodes[i].lon;
-		if ((! got_coords) || (nodes[i].lat < min_lat)) min_lat = nodes[i].lat;
-		if ((! got_coords) || (nodes[i].lon > max_lon)) max_lon = nodes[i].lon;
-		if ((! got_coords) || (nodes[i].lat > max_lat)) max_lat = nodes[i].lat;
-		got_coords = 1;
+/*
+ * Expire the tiles along each ring, including the edge that closes it
+ */
+void expire_tiles::from_ring_outlines(const tile_rings &rings) {
+	size_t	start = 0;
+	size_t	i;
+	size_t	j;
+
+	for (size_t r = 0; r < rings.ends.size(); r++) {
+		for (i = start; i < rings.ends[r]; i++) {
+			j = (i + 1 < rings.ends[r]) ? i + 1 : start;
+			from_line(rings.x[i], rings.y[i], rings.x[j], rings.y[j]);
+		}
+		start = rings.ends[r];
+	}
+}
+
+/*
+ * Expire the tiles covered by a polygon, if it is no bigger than
+ * Options->expire_tiles_max_bbox. Returns -1 if it is too big.
+ *
+ * The tiles along the rings are expired like lines. A tile which no ring
+ * crosses is either completely inside or outside the polygon, so the
+ * remaining tiles are found by filling between the crossings of the rings
+ * with the line through the centres of each row of tiles.
+ */
+int expire_tiles::from_rings(const tile_rings &rings) {
+	size_t	start = 0;
+	size_t	i;
+	size_t	j;
+	size_t	k;
+	int	min_row;
+	int	max_row;
+	int	first;
+	int	last;
+	int	row;
+	int	x;
+	double	x0;
+	double	y0;
+	double	x1;
+	double	y1;
+
+	if (rings.x.empty()) return 0;
+	/* Polygons crossing the international date line are never filled */
+	if (rings.max_x - rings.min_x > map_width / 2) return -1;
+	if ((rings.max_x - rings.min_x) * tile_width > Options->expire_tiles_max_bbox) return -1;
+	if ((rings.max_y - rings.min_y) * tile_width > Options->expire_tiles_max_bbox) return -1;
+
+	from_ring_outlines(rings);
+
+	min_row = floor(rings.min_y);
+	max_row = floor(rings.max_y);
+	if (min_row < 0) min_row = 0;
+	if (max_row >= map_width) max_row = map_width - 1;
+	if (min_row > max_row) return 0;
+
+	/* Where each edge crosses the centre line of the rows it spans. An edge
+	   spans a row if the centre line is at or below its top end and above
+	   its bottom end, so a vertex on a centre line is counted only once */
+	std::vector<std::vector<double> > crossings(max_row - min_row + 1);
+	for (size_t r = 0; r < rings.ends.size(); r++) {
+		for (i = start; i < rings.ends[r]; i++) {
+			j = (i + 1 < rings.ends[r]) ? i + 1 : start;
+			x0 = rings.x[i];
+			y0 = rings.y[i];
+			x1 = rings.x[j];
+			y1 = rings.y[j];
+			if (y0 == y1) continue;
+			first = ceil(std::min(y0, y1) - 0.5);
+			last = ceil(std::max(y0, y1) - 0.5) - 1;
+			if (first < min_row) first = min_row;
+			if (last > max_row) last = max_row;
+			for (row = first; row <= last; row++) {
+				crossings[row - min_row].push_back(x0 + (row + 0.5 - y0) * (x1 - x0) / (y1 - y0));
+			}
+		}
+		start = rings.ends[r];
 	}
-	if (got_coords) {
-		if (from_bbox(min_lon, min_lat, max_lon, max_lat)) {
-			/* Bounding box too big - just expire tiles on the line */
-			fprintf(stderr, "\rLarge polygon (%.0f x %.0f metres, OSM ID %" PRIdOSMID ") - only expiring perimeter\n", max_lon - min_lon, max_lat - min_lat, osm_id);
-			from_nodes_line(nodes, count);
+
+	/* Expire the tiles whose centres are between pairs of crossings */
+	for (row = min_row; row <= max_row; row++) {
+		std::vector<double> &row_crossings = crossings[row - min_row];
+		std::sort(row_crossings.begin(), row_crossings.end());
+		for (k = 0; k + 1 < row_crossings.size(); k += 2) {
+			first = ceil(row_crossings[k] - 0.5);
+			last = floor(row_crossings[k + 1] - 0.5);
+			if (first < 0) first = 0;
+			if (last >= map_width) last = map_width - 1;
+			for (x = first; x <= last; x++) {
+				expire_tile(x, row);
+			}
 		}
 	}
+	return 0;
+}
+
+/*
+ * Expire the tiles covered by a polygon, or only the tiles along its outline
+ * if it is too big.
+ */
+void expire_tiles::from_nodes_poly(const struct osmNode * nodes, int count, osmid_t osm_id) {
+	const struct osmNode * xnodes[2] = { nodes, NULL };
+	const int xcount[2] = { count, 0 };
+	tile_rings rings;
+
+	if (Options->expire_tiles_zoom < 0) return;
+	if (count < 1) return;
+	project_rings(xnodes, xcount, rings);
+	if (from_rings(rings)) {
+		/* Polygon too big - just expire tiles on the line */
+		fprintf(stderr, "\rLarge polygon (%.0f x %.0f metres, OSM ID %" PRIdOSMID ") - only expiring perimeter\n",
+		        (rings.max_x - rings.min_x) * tile_width, (rings.max_y - rings.min_y) * tile_width, osm_id);
+		from_ring_outlines(rings);
+	}
 }
 
 void expire_tiles::from_xnodes_poly(const struct osmNode * const * xnodes, int * xcount, osmid_t osm_id) {
+	tile_rings rings;
 	int	i;
 
-        for (i = 0; xnodes[i]; i++) from_nodes_poly(xnodes[i], xcount[i], osm_id);
+	project_rings(xnodes, xcount, rings);
+	if (from_rings(rings)) {
+		/* Too big as a whole, but its parts may still be small enough */
+		for (i = 0; xnodes[i]; i++) from_nodes_poly(xnodes[i], xcount[i], osm_id);
+	}
 }
 
 void expire_tiles::from_xnodes_line(const struct osmNode * const * xnodes, int * xcount) {
@@ -489,30 +541,27 @@ void expire_tiles::from_wkt(const char * wkt, osmid_t osm_id) {
 }
 
 /*
- * Expire tiles based on an osm element.
- * What type of element (node, line, polygon) osm_id refers to depends on
- * sql_conn. Each type of table has its own sql_conn and the prepared statement
- * get_wkt refers to the appropriate table.
- *
- * The function returns -1 if expiry is not enabled. Otherwise it returns the number
- * of elements that refer to the osm_id.
-
+ * Delete the rows of an osm element from a table and expire the tiles they
+ * covered. What type of element (node, line, polygon) osm_id refers to
+ * depends on the table. The geometries are returned by the same statement
+ * that deletes the rows, simplified so that they stay within the expiry
+ * leeway of the original, which keeps the amount of data read for big
+ * polygons down.
  */
-int expire_tiles::from_db(table_t* table, osmid_t osm_id) {
-    //bail if we dont care about expiry
-    if (Options->expire_tiles_zoom < 0)
-        return -1;
+void expire_tiles::delete_from_db(table_t* table, osmid_t osm_id) {
+    //without expiry the rows only have to go
+    if (Options->expire_tiles_zoom < 0) {
+        table->delete_row(osm_id);
+        return;
+    }
 
-    //grab the geom for this id
-    boost::shared_ptr<table_t::wkt_reader> wkts = table->get_wkt_reader(osm_id);
+    //grab the geom for this id while deleting it
+    boost::shared_ptr<table_t::wkt_reader> wkts = table->delete_wkt_reader(osm_id, simplify_tolerance);
 
     //dirty the stuff
     const char* wkt = NULL;
     while((wkt = wkts->get_next()))
         from_wkt(wkt, osm_id);
-
-    //return how many rows were affected
-    return wkts->get_count();
 }
 
 void expire_tiles::merge_and_destroy(expire_tiles &other) {
@@ -528,8 +577,16 @@ void expire_tiles::merge_and_destroy(expire_tiles &other) {
                               % tile_width % other.tile_width).str());
   }
 
-  _tree_merge(&dirty, &other.dirty);
+  if (dirty.empty()) {
+    dirty.swap(other.dirty);
+    dirty_sorted = other.dirty_sorted;
+  } else {
+    compact();
+    other.compact();
+    dirty.insert(dirty.end(), other.dirty.begin(), other.dirty.end());
+    compact();
+  }
 
-  destroy_tree(other.dirty);
-  other.dirty = NULL;
+  std::vector<uint64_t>().swap(other.dirty);
+  other.dirty_sorted = 0;
 }
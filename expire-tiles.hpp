@@ -4,6 +4,8 @@
 #include "table.hpp"
 #include "options.hpp"
 
+#include <vector>
+#include <boost/cstdint.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
 
@@ -17,12 +19,7 @@ struct expire_tiles : public boost::noncopyable {
     void from_nodes_line(const struct osmNode * nodes, int count);
     void from_nodes_poly(const struct osmNode * nodes, int count, osmid_t osm_id);
     void from_wkt(const char * wkt, osmid_t osm_id);
-    int from_db(table_t* table, osmid_t osm_id);
-
-    struct tile {
-        int	complete[2][2];
-        struct tile* subtiles[2][2];
-    };
+    void delete_from_db(table_t* table, osmid_t osm_id);
 
     /* customisable tile output. this can be passed into the
      * `output_and_destroy` function to override output to a file.
@@ -50,14 +47,24 @@ struct expire_tiles : public boost::noncopyable {
 private:
     void expire_tile(int x, int y);
     int normalise_tile_x_coord(int x);
-    void from_line(double lon_a, double lat_a, double lon_b, double lat_b);
+    void from_line(double tile_x_a, double tile_y_a, double tile_x_b, double tile_y_b);
+    struct tile_rings;
+    void project_rings(const struct osmNode * const * xnodes, const int * xcount, tile_rings &rings);
+    void from_ring_outlines(const tile_rings &rings);
+    int from_rings(const tile_rings &rings);
     void from_xnodes_poly(const struct osmNode * const * xnodes, int * xcount, osmid_t osm_id);
     void from_xnodes_line(const struct osmNode * const * xnodes, int * xcount);
 
+    void compact();
+
     int map_width;
     double tile_width;
+    double simplify_tolerance;
     const struct options_t *Options;
-    struct tile *dirty;
+    // quadkeys of the dirty tiles at the maximum zoom, of which the first
+    // dirty_sorted are sorted and unique
+    std::vector<uint64_t> dirty;
+    size_t dirty_sorted;
 };
 
 #endif
@@ -20,11 +20,14 @@
 #-----------------------------------------------------------------------------
 */
 
+#include <algorithm>
+#include <deque>
 #include <iostream>
 #include <cstring>
 #include <cstdlib>
 #include <cmath>
 #include <exception>
+#include <sstream>
 
 #if defined(__CYGWIN__)
 #define GEOS_INLINE
@@ -50,23 +53,40 @@
 #include <geos/geom/Polygon.h>
 #include <geos/geom/MultiPolygon.h>
 #include <geos/geom/Point.h>
+#include <geos/index/strtree/STRtree.h>
 #include <geos/io/WKTReader.h>
-#include <geos/io/WKTWriter.h>
+#include <geos/io/WKBReader.h>
+#include <geos/io/WKBWriter.h>
 #include <geos/util/GEOSException.h>
 #include <geos/opLinemerge.h>
 using namespace geos::geom;
 using namespace geos::io;
 using namespace geos::util;
 using namespace geos::operation::linemerge;
+using namespace geos::index::strtree;
 #else
 /* geos-2.2.3 */
 #include <geos/geom.h>
+#include <geos/indexStrtree.h>
 #include <geos/io.h>
 #include <geos/opLinemerge.h>
 using namespace geos;
 #endif
 
 #include "geometry-builder.hpp"
+#include "wkb.hpp"
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <boost/noncopyable.hpp>
+
+/* relations with at least this many rings have building their polygons
+ * spread over the builder's threads */
+#define PARALLEL_MIN_RINGS 256
+/* each thread working on a batch of tasks gets at least this many of them,
+ * fewer aren't worth waking a helper thread for */
+#define PARALLEL_MIN_TASKS 32
 
 typedef std::auto_ptr<Geometry> geom_ptr;
 
@@ -97,6 +117,13 @@ struct polygondata
     unsigned        containedbyid;
 };
 
+std::string write_hex(const Geometry *geom)
+{
+    std::ostringstream out;
+    WKBWriter().writeHEX(*geom, out);
+    return out.str();
+}
+
 int polygondata_comparearea(const void* vp1, const void* vp2)
 {
     const polygondata* p1 = (const polygondata*)vp1;
@@ -106,44 +133,793 @@ int polygondata_comparearea(const void* vp1, const void* vp2)
     if (p1->area > p2->area) return -1;
     return 1;
 }
-} // anonymous namespace
 
-geometry_builder::maybe_wkt_t geometry_builder::get_wkt_simple(const osmNode *nodes, int count, int polygon) const
+/* Native checks for the common case of a closed way making a simple ring.
+ * If a ring passes these, the polygon is valid and GEOS isn't needed at
+ * all, otherwise it is handed to GEOS to be repaired. */
+
+inline bool same_node(const osmNode &a, const osmNode &b)
+{
+    return (a.lon == b.lon) && (a.lat == b.lat);
+}
+
+// > 0 if c is left of a->b, < 0 if right and 0 if collinear
+inline double orientation(const osmNode &a, const osmNode &b, const osmNode &c)
+{
+    return (b.lon - a.lon) * (c.lat - a.lat) - (b.lat - a.lat) * (c.lon - a.lon);
+}
+
+// whether p, which is collinear with a->b, lies within its bounding box
+inline bool in_segment_box(const osmNode &a, const osmNode &b, const osmNode &p)
+{
+    return (std::min(a.lon, b.lon) <= p.lon) && (p.lon <= std::max(a.lon, b.lon)) &&
+           (std::min(a.lat, b.lat) <= p.lat) && (p.lat <= std::max(a.lat, b.lat));
+}
+
+// whether segments a1->a2 and b1->b2 have any point in common
+bool segments_intersect(const osmNode &a1, const osmNode &a2, const osmNode &b1, const osmNode &b2)
+{
+    const double d1 = orientation(b1, b2, a1);
+    const double d2 = orientation(b1, b2, a2);
+    const double d3 = orientation(a1, a2, b1);
+    const double d4 = orientation(a1, a2, b2);
+
+    if (((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0)) &&
+        ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0))) {
+        return true;
+    }
+
+    return (d1 == 0 && in_segment_box(b1, b2, a1)) ||
+           (d2 == 0 && in_segment_box(b1, b2, a2)) ||
+           (d3 == 0 && in_segment_box(a1, a2, b1)) ||
+           (d4 == 0 && in_segment_box(a1, a2, b2));
+}
+
+struct segment_order
+{
+    segment_order(const std::vector<osmNode> &ring): ring(ring) {}
+    double min_lon(size_t i) const { return std::min(ring[i].lon, ring[i + 1].lon); }
+    bool operator()(size_t a, size_t b) const { return min_lon(a) < min_lon(b); }
+    const std::vector<osmNode> &ring;
+};
+
+// whether no two segments of a closed ring touch, other than neighbouring
+// segments at their shared node. sweeps over the segments sorted by their
+// west edge, so only segments overlapping in longitude get compared.
+bool ring_is_simple(const std::vector<osmNode> &ring)
+{
+    const size_t segments = ring.size() - 1;
+
+    for (size_t i = 0; i < segments; ++i) {
+        // neighbours can only overlap if the ring doubles back on itself
+        const osmNode &next = ring[(i + 2 > segments) ? 1 : i + 2];
+        if (orientation(ring[i], ring[i + 1], next) == 0 &&
+            ((ring[i + 1].lon - ring[i].lon) * (next.lon - ring[i + 1].lon) +
+             (ring[i + 1].lat - ring[i].lat) * (next.lat - ring[i + 1].lat)) < 0) {
+            return false;
+        }
+    }
+
+    std::vector<size_t> order(segments);
+    for (size_t i = 0; i < segments; ++i) {
+        order[i] = i;
+    }
+    segment_order by_west(ring);
+    std::sort(order.begin(), order.end(), by_west);
+
+    for (size_t i = 0; i < segments; ++i) {
+        const size_t a = order[i];
+        const double east = std::max(ring[a].lon, ring[a + 1].lon);
+        for (size_t j = i + 1; j < segments && by_west.min_lon(order[j]) <= east; ++j) {
+            const size_t b = order[j];
+            const size_t diff = (a > b) ? a - b : b - a;
+            if (diff == 1 || diff == segments - 1) {
+                continue;
+            }
+            if (segments_intersect(ring[a], ring[a + 1], ring[b], ring[b + 1])) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/* Checks the closed way is a simple ring with some area and, if it is,
+ * puts it in the same form GEOS normalize() would: without repeated nodes,
+ * starting at the lowest node and going clockwise. */
+bool normalized_simple_ring(const osmNode *nodes, int count, std::vector<osmNode> &ring, double &area)
+{
+    ring.reserve(count);
+    size_t start = 0;
+    for (int i = 0; i < count - 1; ++i) {
+        if (!std::isfinite(nodes[i].lon) || !std::isfinite(nodes[i].lat)) {
+            return false;
+        }
+        if (!ring.empty() && same_node(ring.back(), nodes[i])) {
+            continue;
+        }
+        ring.push_back(nodes[i]);
+        const osmNode &lowest = ring[start];
+        if ((nodes[i].lon < lowest.lon) || ((nodes[i].lon == lowest.lon) && (nodes[i].lat < lowest.lat))) {
+            start = ring.size() - 1;
+        }
+    }
+    if (ring.size() > 1 && same_node(ring.back(), ring.front())) {
+        ring.pop_back();
+    }
+    if (ring.size() < 3) {
+        return false;
+    }
+
+    std::rotate(ring.begin(), ring.begin() + start, ring.end());
+    ring.push_back(ring.front());
+
+    // shoelace formula, positive for counterclockwise rings
+    double twice_area = 0;
+    for (size_t i = 0; i + 1 < ring.size(); ++i) {
+        twice_area += ring[i].lon * ring[i + 1].lat - ring[i + 1].lon * ring[i].lat;
+    }
+    if (twice_area == 0 || !ring_is_simple(ring)) {
+        return false;
+    }
+
+    if (twice_area > 0) {
+        std::reverse(ring.begin(), ring.end());
+    }
+    area = std::fabs(twice_area) / 2;
+    return true;
+}
+
+// GEOS drops repeated consecutive nodes when the coordinates are added, so
+// they are dropped here too before deciding what a way is. the nodes are
+// only copied if there is a repeat.
+const osmNode *without_repeated_nodes(const osmNode *nodes, int &count, std::vector<osmNode> &copy)
+{
+    int i = 1;
+    while (i < count && !same_node(nodes[i - 1], nodes[i])) {
+        ++i;
+    }
+    if (i >= count) {
+        return nodes;
+    }
+
+    copy.assign(nodes, nodes + i);
+    for (; i < count; ++i) {
+        if (!same_node(copy.back(), nodes[i])) {
+            copy.push_back(nodes[i]);
+        }
+    }
+    count = copy.size();
+    return &copy[0];
+}
+
+inline bool is_closed_ring(const osmNode *nodes, int count)
+{
+    return (count >= 4) && same_node(nodes[0], nodes[count - 1]);
+}
+
+// the polygon for a closed way which isn't a simple ring, repaired with
+// buffer(0) unless broken polygons are to be excluded. it is written out
+// here because the GEOS geometries must not outlive their factory.
+void repair_polygon(const osmNode *nodes, int count, int excludepoly, geometry_builder::wkt_t &wkt)
 {
     GeometryFactory gf;
     std::auto_ptr<CoordinateSequence> coords(gf.getCoordinateSequenceFactory()->create((size_t)0, (size_t)2));
+    for (int i = 0; i < count ; i++) {
+        Coordinate c;
+        c.x = nodes[i].lon;
+        c.y = nodes[i].lat;
+        coords->add(c, 0);
+    }
 
-    try
+    std::auto_ptr<LinearRing> shell(gf.createLinearRing(coords.release()));
+    geom_ptr geom = geom_ptr(gf.createPolygon(shell.release(), new std::vector<Geometry *>));
+    if (!geom->isValid()) {
+        if (excludepoly) {
+            throw std::runtime_error("Excluding broken polygon.");
+        } else {
+            geom = geom_ptr(geom->buffer(0));
+        }
+    }
+    geom->normalize(); // Fix direction of ring
+    wkt.geom = write_hex(geom.get());
+    wkt.area = geom->getArea();
+}
+
+inline double node_distance(const osmNode &a, const osmNode &b)
+{
+    return std::sqrt((a.lon - b.lon) * (a.lon - b.lon) + (a.lat - b.lat) * (a.lat - b.lat));
+}
+
+typedef std::vector<osmNode> nodelist_t;
+
+struct way_end
+{
+    osmNode node;
+    // index of the way times two, plus one for its last node
+    size_t end;
+
+    bool operator<(const way_end &other) const
     {
-        for (int i = 0; i < count ; i++) {
-            Coordinate c;
-            c.x = nodes[i].lon;
-            c.y = nodes[i].lat;
-            coords->add(c, 0);
+        if (node.lon != other.node.lon) return node.lon < other.node.lon;
+        if (node.lat != other.node.lat) return node.lat < other.node.lat;
+        return end < other.end;
+    }
+};
+
+/* Joins ways which meet at their ends into longer lines the same way the
+ * GEOS LineMerger does, only joining at nodes where exactly two way ends
+ * meet. The ends are sorted so ways meeting at a node are found without
+ * building a planar graph. */
+void merge_ways(const osmNode * const * xnodes, const int *xcount, std::vector<nodelist_t> &merged)
+{
+    std::vector<nodelist_t> ways;
+    for (int c = 0; xnodes[c]; c++) {
+        nodelist_t way;
+        way.reserve(xcount[c]);
+        for (int i = 0; i < xcount[c]; i++) {
+            if (way.empty() || !same_node(way.back(), xnodes[c][i])) {
+                way.push_back(xnodes[c][i]);
+            }
+        }
+        if (way.size() > 1) {
+            ways.push_back(nodelist_t());
+            ways.back().swap(way);
         }
+    }
 
-        maybe_wkt_t wkt(new geometry_builder::wkt_t());
-        geom_ptr geom;
-        if (polygon && (coords->getSize() >= 4) && (coords->getAt(coords->getSize() - 1).equals2D(coords->getAt(0)))) {
-            std::auto_ptr<LinearRing> shell(gf.createLinearRing(coords.release()));
-            geom = geom_ptr(gf.createPolygon(shell.release(), new std::vector<Geometry *>));
-            if (!geom->isValid()) {
-                if (excludepoly) {
-                    throw std::runtime_error("Excluding broken polygon.");
+    std::vector<way_end> ends(ways.size() * 2);
+    for (size_t i = 0; i < ways.size(); ++i) {
+        ends[2 * i].node = ways[i].front();
+        ends[2 * i].end = 2 * i;
+        ends[2 * i + 1].node = ways[i].back();
+        ends[2 * i + 1].end = 2 * i + 1;
+    }
+    std::sort(ends.begin(), ends.end());
+
+    // ends meeting at the same node are next to each other after sorting.
+    // remember where each end got to and where its node starts and stops.
+    std::vector<size_t> position(ends.size()), node_first(ends.size()), node_last(ends.size());
+    for (size_t i = 0, first = 0; i < ends.size(); ++i) {
+        if (!same_node(ends[i].node, ends[first].node)) {
+            first = i;
+        }
+        position[ends[i].end] = i;
+        node_first[i] = first;
+    }
+    for (size_t i = ends.size(), last = ends.size(); i-- > 0; ) {
+        if (i + 1 < ends.size() && !same_node(ends[i].node, ends[i + 1].node)) {
+            last = i + 1;
+        }
+        node_last[i] = last;
+    }
+
+    std::vector<bool> used(ways.size(), false);
+
+    // starting from each node with other than two way ends, and then from
+    // what is left over, which can only be closed rings
+    for (int pass = 0; pass < 2; ++pass) {
+        for (size_t i = 0; i < ends.size(); ++i) {
+            const bool passthrough = (node_last[i] - node_first[i] == 2);
+            if (used[ends[i].end / 2] || (passthrough != (pass == 1))) {
+                continue;
+            }
+
+            merged.push_back(nodelist_t());
+            nodelist_t &line = merged.back();
+            size_t end = ends[i].end;
+            while (true) {
+                const size_t way = end / 2;
+                const nodelist_t &nodes = ways[way];
+                used[way] = true;
+                if (end % 2 == 0) {
+                    line.insert(line.end(), nodes.begin() + (line.empty() ? 0 : 1), nodes.end());
                 } else {
-                    geom = geom_ptr(geom->buffer(0));
+                    line.insert(line.end(), nodes.rbegin() + (line.empty() ? 0 : 1), nodes.rend());
+                }
+
+                // carry on through the node at the other end of this way if
+                // exactly one other way ends there
+                const size_t other = position[end ^ 1];
+                const size_t first = node_first[other];
+                if (node_last[other] - first != 2) {
+                    break;
+                }
+                end = ends[(first == other) ? first + 1 : first].end;
+                if (used[end / 2]) {
+                    break;
+                }
+            }
+        }
+    }
+}
+
+CoordinateSequence *nodes2coords(const GeometryFactory &gf, const nodelist_t &nodes)
+{
+    std::auto_ptr<std::vector<Coordinate> > coords(new std::vector<Coordinate>());
+    coords->reserve(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        coords->push_back(Coordinate(nodes[i].lon, nodes[i].lat));
+    }
+    return gf.getCoordinateSequenceFactory()->create(coords.release());
+}
+
+/* Calls task(worker, i) for every i in [0, count), spread over up to
+ * thread_count threads which each take the next i when they are free. The
+ * worker number is below thread_count and lets tasks keep per thread
+ * state. The first exception thrown by a task is rethrown at the end. */
+struct parallel_tasks
+{
+    typedef boost::function<void (int, size_t)> task_t;
+
+    parallel_tasks(size_t count, const task_t &task)
+        : count(count), next(0), task(task), failed(false), wanted(0), joined(0), running(0) {}
+
+    void run(int worker)
+    {
+        while (true) {
+            size_t i;
+            {
+                boost::mutex::scoped_lock lock(mutex);
+                if (failed || next >= count) return;
+                i = next++;
+            }
+
+            try {
+                task(worker, i);
+            } catch (const std::exception &e) {
+                fail(e.what());
+            } catch (...) {
+                fail("Unknown exception");
+            }
+        }
+    }
+
+    void fail(const std::string &what)
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        if (!failed) {
+            failed = true;
+            error = what;
+        }
+    }
+
+    const size_t count;
+    size_t next;
+    const task_t &task;
+    boost::mutex mutex;
+    bool failed;
+    std::string error;
+
+    // the helper threads still wanted, which have joined and which are
+    // running the tasks, guarded by the pool's mutex
+    int wanted;
+    int joined;
+    int running;
+};
+
+/* Helper threads shared by every geometry builder. The pending workers each
+ * build polygons with their own builder, so starting threads for every
+ * batch of tasks could have thread_count threads for each of them. The pool
+ * only grows to the most helpers any one batch asks for, and an idle helper
+ * joins whichever batch is waiting. The thread handing over a batch always
+ * works on it too, so it finishes even when all the helpers are busy. */
+class helper_pool : public boost::noncopyable
+{
+public:
+    static helper_pool &instance()
+    {
+        static helper_pool pool;
+        return pool;
+    }
+
+    // runs the tasks on this thread and on up to helpers idle helper threads
+    void run(parallel_tasks &tasks, int helpers)
+    {
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            while (threads.size() < size_t(helpers)) {
+                threads.create_thread(boost::bind(&helper_pool::loop, this));
+            }
+            tasks.wanted = helpers;
+            batches.push_back(&tasks);
+            cond.notify_all();
+        }
+
+        tasks.run(0);
+
+        // no more helpers may join, and the ones which did have to be done
+        boost::mutex::scoped_lock lock(mutex);
+        std::deque<parallel_tasks *>::iterator itr = std::find(batches.begin(), batches.end(), &tasks);
+        if (itr != batches.end()) {
+            batches.erase(itr);
+        }
+        while (tasks.running > 0) {
+            done.wait(lock);
+        }
+    }
+
+private:
+    helper_pool() : quit(false) {}
+
+    ~helper_pool()
+    {
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            quit = true;
+            cond.notify_all();
+        }
+        threads.join_all();
+    }
+
+    void loop()
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        while (true) {
+            while (!quit && batches.empty()) {
+                cond.wait(lock);
+            }
+            if (quit) {
+                return;
+            }
+
+            parallel_tasks *tasks = batches.front();
+            const int worker = ++tasks->joined;
+            if (tasks->joined >= tasks->wanted) {
+                batches.pop_front();
+            }
+            ++tasks->running;
+
+            lock.unlock();
+            tasks->run(worker);
+            lock.lock();
+
+            if (--tasks->running == 0) {
+                done.notify_all();
+            }
+        }
+    }
+
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    boost::condition_variable done;
+    std::deque<parallel_tasks *> batches;
+    boost::thread_group threads;
+    bool quit;
+};
+
+void run_parallel(size_t count, int thread_count, const parallel_tasks::task_t &task)
+{
+    const size_t workers = std::min(size_t(std::max(thread_count, 1)), count / PARALLEL_MIN_TASKS);
+    if (workers < 2) {
+        for (size_t i = 0; i < count; ++i) {
+            task(0, i);
+        }
+        return;
+    }
+
+    parallel_tasks tasks(count, task);
+    helper_pool::instance().run(tasks, workers - 1);
+
+    if (tasks.failed) {
+        throw std::runtime_error(tasks.error);
+    }
+}
+
+/* A geometry factory for each worker of run_parallel. Geometries keep a
+ * reference to the factory which made them, which isn't safe to share
+ * between threads, so each thread only makes geometries with its own. */
+class worker_factories : public boost::noncopyable
+{
+public:
+    explicit worker_factories(int thread_count)
+        : factories(std::max(thread_count, 1), (GeometryFactory *) 0)
+    {
+        for (size_t w = 0; w < factories.size(); ++w) {
+            factories[w] = new GeometryFactory();
+        }
+    }
+
+    ~worker_factories()
+    {
+        for (size_t w = 0; w < factories.size(); ++w) {
+            delete factories[w];
+        }
+    }
+
+    const GeometryFactory &operator[](int worker) const { return *factories[worker]; }
+
+private:
+    std::vector<GeometryFactory *> factories;
+};
+
+struct make_polygon_task
+{
+    make_polygon_task(const worker_factories &factories, const std::vector<const nodelist_t *> &rings, polygondata *polys)
+        : factories(factories), rings(rings), polys(polys) {}
+
+    void operator()(int worker, size_t i) const
+    {
+        const GeometryFactory &gf = factories[worker];
+        polys[i].polygon = gf.createPolygon(gf.createLinearRing(nodes2coords(gf, *rings[i])),0);
+        polys[i].ring = gf.createLinearRing(nodes2coords(gf, *rings[i]));
+        polys[i].area = polys[i].polygon->getArea();
+        polys[i].iscontained = 0;
+        polys[i].containedbyid = 0;
+    }
+
+    const worker_factories &factories;
+    const std::vector<const nodelist_t *> &rings;
+    polygondata *polys;
+};
+
+// makes a polygon for each ring, keeping only those with some area at the
+// start of polys. returns how many there are.
+unsigned make_polygons(const worker_factories &factories, const std::vector<const nodelist_t *> &rings,
+                       polygondata *polys, int thread_count)
+{
+    run_parallel(rings.size(), thread_count, make_polygon_task(factories, rings, polys));
+
+    unsigned totalpolys = 0;
+    for (size_t i = 0; i < rings.size(); ++i) {
+        if (polys[i].area > 0.0) {
+            polys[totalpolys++] = polys[i];
+        } else {
+            delete(polys[i].polygon);
+            delete(polys[i].ring);
+        }
+    }
+    return totalpolys;
+}
+
+inline bool envelope_contains(const Envelope *outer, const Envelope *inner)
+{
+    return (outer->getMinX() <= inner->getMinX()) && (inner->getMaxX() <= outer->getMaxX()) &&
+           (outer->getMinY() <= inner->getMinY()) && (inner->getMaxY() <= outer->getMaxY());
+}
+
+/* State for nesting the polygons inside one top level polygon. candidates
+ * are the smaller polygons whose bounding boxes are inside it. */
+struct nesting
+{
+    nesting(polygondata *polys, unsigned totalpolys, STRtree &tree, int thread_count)
+        : polys(polys), tree(tree), inside(totalpolys, 0), covered_by(), outer(0)
+#ifdef HAS_PREPARED_GEOMETRIES
+          , prepared(thread_count, (const geos::geom::prep::PreparedGeometry *) 0)
+#endif
+    {}
+
+    ~nesting()
+    {
+#ifdef HAS_PREPARED_GEOMETRIES
+        release_prepared();
+#endif
+    }
+
+#ifdef HAS_PREPARED_GEOMETRIES
+    void release_prepared()
+    {
+        for (size_t w = 0; w < prepared.size(); ++w) {
+            if (prepared[w]) {
+                pgf.destroy(prepared[w]);
+                prepared[w] = 0;
+            }
+        }
+    }
+#endif
+
+    // whether the outer polygon contains candidate c
+    void test_inside(int worker, size_t c)
+    {
+        const unsigned j = candidates[c];
+        if (polys[j].containedbyid != 0) return;
+#ifdef HAS_PREPARED_GEOMETRIES
+        // each thread needs its own, they build their indexes lazily
+        if (!prepared[worker]) {
+            prepared[worker] = pgf.create(polys[outer].polygon);
+        }
+        // Does the prepared top level polygon contain the smaller polygon[j]?
+        inside[j] = prepared[worker]->contains(polys[j].polygon);
+#else
+        // Does polygon[outer] contain the smaller polygon[j]?
+        inside[j] = polys[outer].polygon->contains(polys[j].polygon);
+#endif
+    }
+
+    // which of the polygons between the outer one and candidate c, and also
+    // inside the outer one, contain c
+    void find_covering(int, size_t c)
+    {
+        const unsigned j = candidates[c];
+        if (!inside[j]) return;
+
+        const Envelope *env = polys[j].polygon->getEnvelopeInternal();
+        std::vector<void *> found;
+        tree.query(env, found);
+        for (size_t f = 0; f < found.size(); ++f) {
+            const unsigned k = static_cast<polygondata *>(found[f]) - polys;
+            if (k > outer && k < j && inside[k] &&
+                envelope_contains(polys[k].polygon->getEnvelopeInternal(), env) &&
+                polys[k].polygon->contains(polys[j].polygon)) {
+                covered_by[c].push_back(k);
+            }
+        }
+    }
+
+    polygondata *polys;
+    STRtree &tree;
+    std::vector<char> inside;
+    std::vector<unsigned> candidates;
+    std::vector<std::vector<unsigned> > covered_by;
+    unsigned outer;
+#ifdef HAS_PREPARED_GEOMETRIES
+    geos::geom::prep::PreparedGeometryFactory pgf;
+    std::vector<const geos::geom::prep::PreparedGeometry *> prepared;
+#endif
+};
+
+/* Works out which of the polygons, sorted by decreasing area, are holes in
+ * which others. A polygon is a hole in the first top level polygon which
+ * contains it, unless it is also inside one of that polygon's holes, in
+ * which case it is an island and becomes top level itself. Only polygons
+ * whose bounding boxes could contain each other are compared, using an
+ * STRtree over all of them, and the containment tests for each top level
+ * polygon are spread over thread_count threads. Returns the number of top
+ * level polygons and fills holes with the holes of each of them. */
+unsigned nest_polygons(polygondata *polys, unsigned totalpolys, std::vector<std::vector<unsigned> > &holes,
+                       int thread_count)
+{
+    STRtree tree;
+    for (unsigned i = 0; i < totalpolys; ++i) {
+        tree.insert(polys[i].polygon->getEnvelopeInternal(), &polys[i]);
+    }
+
+    nesting state(polys, totalpolys, tree, std::max(thread_count, 1));
+    unsigned toplevelpolygons = 0;
+    std::vector<void *> found;
+
+    for (unsigned i=0 ;i < totalpolys; ++i)
+    {
+        if (polys[i].iscontained != 0) continue;
+        toplevelpolygons++;
+
+        const Envelope *outer = polys[i].polygon->getEnvelopeInternal();
+        found.clear();
+        tree.query(outer, found);
+        state.candidates.clear();
+        for (size_t f = 0; f < found.size(); ++f) {
+            const unsigned j = static_cast<polygondata *>(found[f]) - polys;
+            if (j > i && envelope_contains(outer, polys[j].polygon->getEnvelopeInternal())) {
+                state.candidates.push_back(j);
+            }
+        }
+        if (state.candidates.empty()) continue;
+        std::sort(state.candidates.begin(), state.candidates.end());
+
+        const size_t count = state.candidates.size();
+        state.outer = i;
+        state.covered_by.assign(count, std::vector<unsigned>());
+        run_parallel(count, thread_count, boost::bind(&nesting::test_inside, &state, _1, _2));
+        run_parallel(count, thread_count, boost::bind(&nesting::find_covering, &state, _1, _2));
+#ifdef HAS_PREPARED_GEOMETRIES
+        state.release_prepared();
+#endif
+
+        for (size_t c = 0; c < count; ++c)
+        {
+            const unsigned j = state.candidates[c];
+            if (!state.inside[j]) continue;
+
+            // are we in a [i] contains [k] contains [j] situation
+            // which would actually make j top level
+            bool istoplevelafterall = false;
+            for (size_t n = 0; n < state.covered_by[c].size(); ++n) {
+                const unsigned k = state.covered_by[c][n];
+                if (polys[k].iscontained && polys[k].containedbyid == i) {
+                    istoplevelafterall = true;
+                    break;
                 }
             }
-            geom->normalize(); // Fix direction of ring
-            wkt->area = geom->getArea();
+            if (!istoplevelafterall)
+            {
+                polys[j].iscontained = 1;
+                polys[j].containedbyid = i;
+            }
+        }
+
+        for (size_t c = 0; c < count; ++c) {
+            state.inside[state.candidates[c]] = 0;
+        }
+    }
+
+    holes.assign(totalpolys, std::vector<unsigned>());
+    for (unsigned j = 0; j < totalpolys; ++j) {
+        if (polys[j].iscontained == 1) {
+            holes[polys[j].containedbyid].push_back(j);
+        }
+    }
+
+    return toplevelpolygons;
+}
+
+struct write_polygon_task
+{
+    write_polygon_task(const worker_factories &factories, const std::vector<Geometry *> &polygons, int excludepoly,
+                       std::vector<geometry_builder::wkt_t> &out, std::vector<char> &keep)
+        : factories(factories), polygons(polygons), excludepoly(excludepoly), out(out), keep(keep) {}
+
+    void operator()(int worker, size_t i) const
+    {
+        const Geometry *poly = polygons[i];
+        geom_ptr repaired;
+        if (!poly->isValid() && (excludepoly == 0)) {
+            // buffer makes its result with the polygon's factory, so repair
+            // a copy made with this thread's own
+            geom_ptr copy(factories[worker].createGeometry(poly));
+            repaired = geom_ptr(copy->buffer(0));
+            repaired->normalize();
+            poly = repaired.get();
+        }
+        if ((excludepoly == 0) || (poly->isValid()))
+        {
+            out[i].geom = write_hex(poly);
+            out[i].area = poly->getArea();
+            keep[i] = 1;
+        }
+    }
+
+    const worker_factories &factories;
+    const std::vector<Geometry *> &polygons;
+    int excludepoly;
+    std::vector<geometry_builder::wkt_t> &out;
+    std::vector<char> &keep;
+};
+
+// repairs each polygon if needed and adds it to wkts on its own, then
+// deletes the polygons
+void write_polygons(const worker_factories &factories, const std::vector<Geometry *> &polygons,
+                    int excludepoly, int thread_count, std::vector<geometry_builder::wkt_t> &wkts)
+{
+    std::vector<geometry_builder::wkt_t> out(polygons.size());
+    std::vector<char> keep(polygons.size(), 0);
+    run_parallel(polygons.size(), thread_count, write_polygon_task(factories, polygons, excludepoly, out, keep));
+
+    for (size_t i = 0; i < polygons.size(); ++i) {
+        if (keep[i]) {
+            //copy of an empty one should be cheapest
+            wkts.push_back(geometry_builder::wkt_t());
+            //then we set on the one we already have
+            wkts.back().geom.swap(out[i].geom);
+            wkts.back().area = out[i].area;
+        }
+        delete(polygons[i]);
+    }
+}
+} // anonymous namespace
+
+geometry_builder::maybe_wkt_t geometry_builder::get_wkt_simple(const osmNode *nodes, int count, int polygon) const
+{
+    try
+    {
+        std::vector<osmNode> copy;
+        nodes = without_repeated_nodes(nodes, count, copy);
+
+        maybe_wkt_t wkt(new geometry_builder::wkt_t());
+        if (polygon && is_closed_ring(nodes, count)) {
+            std::vector<osmNode> ring;
+            if (normalized_simple_ring(nodes, count, ring, wkt->area)) {
+                wkb::write_polygon(wkt->geom, &ring[0], ring.size());
+            } else {
+                repair_polygon(nodes, count, excludepoly, *wkt);
+            }
         } else {
-            if (coords->getSize() < 2)
+            if (count < 2)
                 throw std::runtime_error("Excluding degenerate line.");
-            geom = geom_ptr(gf.createLineString(coords.release()));
+            wkb::write_linestring(wkt->geom, nodes, count);
             wkt->area = 0;
         }
 
-        wkt->geom = WKTWriter().write(geom.get());
         return wkt;
     }
     catch (std::bad_alloc&)
@@ -165,52 +941,36 @@ geometry_builder::maybe_wkt_t geometry_builder::get_wkt_simple(const osmNode *no
 
 geometry_builder::maybe_wkts_t geometry_builder::get_wkt_split(const osmNode *nodes, int count, int polygon, double split_at) const
 {
-    GeometryFactory gf;
-    std::auto_ptr<CoordinateSequence> coords(gf.getCoordinateSequenceFactory()->create((size_t)0, (size_t)2));
-    WKTWriter writer;
-    //TODO: use count to get some kind of hint of how much we should reserve?
     maybe_wkts_t wkts(new std::vector<geometry_builder::wkt_t>);
 
     try
     {
-        for (int i = 0; i < count ; i++) {
-            Coordinate c;
-            c.x = nodes[i].lon;
-            c.y = nodes[i].lat;
-            coords->add(c, 0);
-        }
-
-        geom_ptr geom;
-        if (polygon && (coords->getSize() >= 4) && (coords->getAt(coords->getSize() - 1).equals2D(coords->getAt(0)))) {
-            std::auto_ptr<LinearRing> shell(gf.createLinearRing(coords.release()));
-            geom = geom_ptr(gf.createPolygon(shell.release(), new std::vector<Geometry *>));
-            if (!geom->isValid()) {
-                if (excludepoly) {
-                    throw std::runtime_error("Excluding broken polygon.");
-                } else {
-                    geom = geom_ptr(geom->buffer(0));
-                }
-            }
-            geom->normalize(); // Fix direction of ring
+        std::vector<osmNode> copy;
+        nodes = without_repeated_nodes(nodes, count, copy);
 
+        if (polygon && is_closed_ring(nodes, count)) {
             //copy of an empty one should be cheapest
             wkts->push_back(geometry_builder::wkt_t());
-            //then we set on the one we already have
-            wkts->back().geom = writer.write(geom.get());
-            wkts->back().area = geom->getArea();
+
+            std::vector<osmNode> ring;
+            if (normalized_simple_ring(nodes, count, ring, wkts->back().area)) {
+                wkb::write_polygon(wkts->back().geom, &ring[0], ring.size());
+            } else {
+                //then we set on the one we already have
+                repair_polygon(nodes, count, excludepoly, wkts->back());
+            }
 
         } else {
-            if (coords->getSize() < 2)
+            if (count < 2)
                 throw std::runtime_error("Excluding degenerate line.");
 
             double distance = 0;
-            std::auto_ptr<CoordinateSequence> segment;
-            segment = std::auto_ptr<CoordinateSequence>(gf.getCoordinateSequenceFactory()->create((size_t)0, (size_t)2));
-            segment->add(coords->getAt(0));
-            for(unsigned i=1; i<coords->getSize(); i++) {
-                const Coordinate this_pt = coords->getAt(i);
-                const Coordinate prev_pt = coords->getAt(i-1);
-                const double delta = this_pt.distance(prev_pt);
+            std::vector<osmNode> segment;
+            segment.push_back(nodes[0]);
+            for(int i=1; i<count; i++) {
+                const osmNode &this_pt = nodes[i];
+                const osmNode &prev_pt = nodes[i-1];
+                const double delta = node_distance(this_pt, prev_pt);
                 // figure out if the addition of this point would take the total
                 // length of the line in `segment` over the `split_at` distance.
                 const size_t splits = std::floor((distance + delta) / split_at);
@@ -219,25 +979,25 @@ geometry_builder::maybe_wkts_t geometry_builder::get_wkt_split(const osmNode *no
                   // use the splitting distance to split the current segment up
                   // into as many parts as necessary to keep each part below
                   // the `split_at` distance.
-                  for (size_t i = 0; i < splits; ++i) {
-                    double frac = (double(i + 1) * split_at - distance) / delta;
-                    const Coordinate interpolated(frac * (this_pt.x - prev_pt.x) + prev_pt.x,
-                                                  frac * (this_pt.y - prev_pt.y) + prev_pt.y);
-                    segment->add(interpolated);
-                    geom_ptr geom = geom_ptr(gf.createLineString(segment.release()));
+                  for (size_t j = 0; j < splits; ++j) {
+                    double frac = (double(j + 1) * split_at - distance) / delta;
+                    osmNode interpolated;
+                    interpolated.lon = frac * (this_pt.lon - prev_pt.lon) + prev_pt.lon;
+                    interpolated.lat = frac * (this_pt.lat - prev_pt.lat) + prev_pt.lat;
+                    segment.push_back(interpolated);
 
                     //copy of an empty one should be cheapest
                     wkts->push_back(geometry_builder::wkt_t());
                     //then we set on the one we already have
-                    wkts->back().geom = writer.write(geom.get());
+                    wkb::write_linestring(wkts->back().geom, &segment[0], segment.size());
                     wkts->back().area = 0;
 
-                    segment.reset(gf.getCoordinateSequenceFactory()->create((size_t)0, (size_t)2));
-                    segment->add(interpolated);
+                    segment.clear();
+                    segment.push_back(interpolated);
                   }
                   // reset the distance based on the final splitting point for
                   // the next iteration.
-                  distance = segment->getAt(0).distance(this_pt);
+                  distance = node_distance(segment[0], this_pt);
 
                 } else {
                   // if not split then just push this point onto the sequence
@@ -246,21 +1006,13 @@ geometry_builder::maybe_wkts_t geometry_builder::get_wkt_split(const osmNode *no
                 }
 
                 // always add this point
-                segment->add(this_pt);
-
-                // on the last iteration, close out the line.
-                if (i == coords->getSize()-1) {
-                    geom_ptr geom = geom_ptr(gf.createLineString(segment.release()));
-
-                    //copy of an empty one should be cheapest
-                    wkts->push_back(geometry_builder::wkt_t());
-                    //then we set on the one we already have
-                    wkts->back().geom = writer.write(geom.get());
-                    wkts->back().area = 0;
-
-                    segment.reset(gf.getCoordinateSequenceFactory()->create((size_t)0, (size_t)2));
-                }
+                segment.push_back(this_pt);
             }
+
+            // close out the line
+            wkts->push_back(geometry_builder::wkt_t());
+            wkb::write_linestring(wkts->back().geom, &segment[0], segment.size());
+            wkts->back().area = 0;
         }
     }
     catch (std::bad_alloc&)
@@ -271,6 +1023,7 @@ geometry_builder::maybe_wkts_t geometry_builder::get_wkt_split(const osmNode *no
     catch (std::runtime_error& e)
     {
         //std::cerr << std::endl << "Exception caught processing way: " << e.what() << std::endl;
+        wkts->clear();
     }
     catch (...)
     {
@@ -279,6 +1032,7 @@ geometry_builder::maybe_wkts_t geometry_builder::get_wkt_split(const osmNode *no
     return wkts;
 }
 
+
 int geometry_builder::parse_wkt(const char * wkt, struct osmNode *** xnodes, int ** xcount, int * polygon) {
     GeometryFactory		gf;
     WKTReader		reader(&gf);
@@ -292,7 +1046,14 @@ int geometry_builder::parse_wkt(const char * wkt, struct osmNode *** xnodes, int
 
     *polygon = 0;
     try {
-        geometry = reader.read(wkt_string);
+        // hex WKB as written by us, or EWKB as returned by PostGIS, always
+        // starts with the byte order, which WKT never does
+        if (wkt_string[0] == '0') {
+            std::istringstream in(wkt_string);
+            geometry = WKBReader(gf).readHEX(in);
+        } else {
+            geometry = reader.read(wkt_string);
+        }
         switch (geometry->getGeometryTypeId()) {
             // Single geometries
             case GEOS_POLYGON:
@@ -344,128 +1105,39 @@ int geometry_builder::parse_wkt(const char * wkt, struct osmNode *** xnodes, int
 
 geometry_builder::maybe_wkts_t geometry_builder::build_polygons(const osmNode * const * xnodes, const int *xcount, bool enable_multi, osmid_t osm_id) const
 {
-    std::auto_ptr<std::vector<Geometry*> > lines(new std::vector<Geometry*>);
     GeometryFactory gf;
-    geom_ptr geom;
-#ifdef HAS_PREPARED_GEOMETRIES
-    geos::geom::prep::PreparedGeometryFactory pgf;
-#endif
     maybe_wkts_t wkts(new std::vector<geometry_builder::wkt_t>);
 
 
     try
     {
-        for (int c=0; xnodes[c]; c++) {
-            std::auto_ptr<CoordinateSequence> coords(gf.getCoordinateSequenceFactory()->create((size_t)0, (size_t)2));
-            for (int i = 0; i < xcount[c]; i++) {
-                const osmNode *nodes = xnodes[c];
-                Coordinate c;
-                c.x = nodes[i].lon;
-                c.y = nodes[i].lat;
-                coords->add(c, 0);
-            }
-            if (coords->getSize() > 1) {
-                geom = geom_ptr(gf.createLineString(coords.release()));
-                lines->push_back(geom.release());
-            }
-        }
-
-        //geom_ptr segment(0);
-        geom_ptr mline (gf.createMultiLineString(lines.release()));
-        //geom_ptr noded (segment->Union(mline.get()));
-        LineMerger merger;
-        //merger.add(noded.get());
-        merger.add(mline.get());
-        std::auto_ptr<std::vector<LineString *> > merged(merger.getMergedLineStrings());
-        WKTWriter writer;
-
-        // Procces ways into lines or simple polygon list
-        polygondata* polys = new polygondata[merged->size()];
+        // join the ways up at their ends into rings and lines
+        std::vector<nodelist_t> merged;
+        merge_ways(xnodes, xcount, merged);
 
-        unsigned totalpolys = 0;
-        for (unsigned i=0 ;i < merged->size(); ++i)
+        // Procces ways into simple polygon list
+        std::vector<const nodelist_t *> rings;
+        for (unsigned i=0 ;i < merged.size(); ++i)
         {
-            std::auto_ptr<LineString> pline ((*merged ) [i]);
-            if (pline->getNumPoints() > 3 && pline->isClosed())
+            const nodelist_t &pline = merged[i];
+            if (pline.size() > 3 && same_node(pline.front(), pline.back()))
             {
-                polys[totalpolys].polygon = gf.createPolygon(gf.createLinearRing(pline->getCoordinates()),0);
-                polys[totalpolys].ring = gf.createLinearRing(pline->getCoordinates());
-                polys[totalpolys].area = polys[totalpolys].polygon->getArea();
-                polys[totalpolys].iscontained = 0;
-                polys[totalpolys].containedbyid = 0;
-                if (polys[totalpolys].area > 0.0)
-                    totalpolys++;
-                else {
-                    delete(polys[totalpolys].polygon);
-                    delete(polys[totalpolys].ring);
-                }
+                rings.push_back(&pline);
             }
         }
 
+        const int threads = (rings.size() >= PARALLEL_MIN_RINGS) ? thread_count : 1;
+        polygondata* polys = new polygondata[rings.size()];
+        worker_factories factories(threads);
+        unsigned totalpolys = make_polygons(factories, rings, polys, threads);
+
         if (totalpolys)
         {
             qsort(polys, totalpolys, sizeof(polygondata), polygondata_comparearea);
 
-            unsigned toplevelpolygons = 0;
-            int istoplevelafterall;
-
-            for (unsigned i=0 ;i < totalpolys; ++i)
-            {
-                if (polys[i].iscontained != 0) continue;
-                toplevelpolygons++;
-#ifdef HAS_PREPARED_GEOMETRIES
-                const geos::geom::prep::PreparedGeometry* preparedtoplevelpolygon = pgf.create(polys[i].polygon);
-#endif
+            std::vector<std::vector<unsigned> > holes;
+            unsigned toplevelpolygons = nest_polygons(polys, totalpolys, holes, threads);
 
-                for (unsigned j=i+1; j < totalpolys; ++j)
-                {
-#ifdef HAS_PREPARED_GEOMETRIES
-                    // Does preparedtoplevelpolygon contain the smaller polygon[j]?
-                    if (polys[j].containedbyid == 0 && preparedtoplevelpolygon->contains(polys[j].polygon))
-#else
-                    // Does polygon[i] contain the smaller polygon[j]?
-                    if (polys[j].containedbyid == 0 && polys[i].polygon->contains(polys[j].polygon))
-#endif
-                    {
-                        // are we in a [i] contains [k] contains [j] situation
-                        // which would actually make j top level
-                        istoplevelafterall = 0;
-                        for (unsigned k=i+1; k < j; ++k)
-                        {
-                            if (polys[k].iscontained && polys[k].containedbyid == i && polys[k].polygon->contains(polys[j].polygon))
-                            {
-                                istoplevelafterall = 1;
-                                break;
-                            }
-#if 0
-                            else if (polys[k].polygon->intersects(polys[j].polygon) || polys[k].polygon->touches(polys[j].polygon))
-                            {
-                                // FIXME: This code does not work as intended
-                                // It should be setting the polys[k].ring in order to update this object
-                                // but the value of polys[k].polygon calculated is normally NULL
-
-                                // Add polygon this polygon (j) to k since they intersect
-                                // Mark ourselfs to be dropped (2), delete the original k
-                                Geometry* polyunion = polys[k].polygon->Union(polys[j].polygon);
-                                delete(polys[k].polygon);
-                                polys[k].polygon = dynamic_cast<Polygon*>(polyunion);
-                                polys[j].iscontained = 2; // Drop
-                                istoplevelafterall = 2;
-                                break;
-                            }
-#endif
-                        }
-                        if (istoplevelafterall == 0)
-                        {
-                            polys[j].iscontained = 1;
-                            polys[j].containedbyid = i;
-                        }
-                    }
-                }
-#ifdef HAS_PREPARED_GEOMETRIES
-        pgf.destroy(preparedtoplevelpolygon);
-#endif
-            }
             // polys now is a list of polygons tagged with which ones are inside each other
 
             // List of polygons for multipolygon
@@ -478,12 +1150,9 @@ geometry_builder::maybe_wkts_t geometry_builder::build_polygons(const osmNode *
 
                 // List of holes for this top level polygon
                 std::auto_ptr<std::vector<Geometry*> > interior(new std::vector<Geometry*>);
-                for (unsigned j=i+1; j < totalpolys; ++j)
+                for (unsigned j=0; j < holes[i].size(); ++j)
                 {
-                   if (polys[j].iscontained == 1 && polys[j].containedbyid == i)
-                   {
-                       interior->push_back(polys[j].ring);
-                   }
+                    interior->push_back(polys[holes[i][j]].ring);
                 }
 
                 Polygon* poly(gf.createPolygon(polys[i].ring, interior.release()));
@@ -505,29 +1174,13 @@ geometry_builder::maybe_wkts_t geometry_builder::build_polygons(const osmNode *
                     //copy of an empty one should be cheapest
                     wkts->push_back(geometry_builder::wkt_t());
                     //then we set on the one we already have
-                    wkts->back().geom = writer.write(multipoly.get());
+                    wkts->back().geom = write_hex(multipoly.get());
                     wkts->back().area = multipoly->getArea();
                 }
             }
             else
             {
-                for(unsigned i=0; i<toplevelpolygons; i++)
-                {
-                    Geometry* poly = dynamic_cast<Geometry*>(polygons->at(i));
-                    if (!poly->isValid() && (excludepoly == 0)) {
-                        poly = dynamic_cast<Geometry*>(poly->buffer(0));
-                        poly->normalize();
-                    }
-                    if ((excludepoly == 0) || (poly->isValid()))
-                    {
-                        //copy of an empty one should be cheapest
-                        wkts->push_back(geometry_builder::wkt_t());
-                        //then we set on the one we already have
-                        wkts->back().geom = writer.write(poly);
-                        wkts->back().area = poly->getArea();
-                    }
-                    delete(poly);
-                }
+                write_polygons(factories, *polygons, excludepoly, threads, *wkts);
             }
         }
 
@@ -578,8 +1231,7 @@ geometry_builder::maybe_wkt_t geometry_builder::build_multilines(const osmNode *
         geom_ptr mline (gf.createMultiLineString(lines.release()));
         //geom_ptr noded (segment->Union(mline.get()));
 
-        WKTWriter writer;
-	wkt->geom = writer.write(mline.get());
+	wkt->geom = write_hex(mline.get());
 	wkt->area = 0;
     }//TODO: don't show in message id when osm_id == -1
     catch (std::exception& e)
@@ -596,157 +1248,60 @@ geometry_builder::maybe_wkt_t geometry_builder::build_multilines(const osmNode *
 geometry_builder::maybe_wkts_t geometry_builder::build_both(const osmNode * const * xnodes, const int *xcount, int make_polygon,
                                                                              int enable_multi, double split_at, osmid_t osm_id) const
 {
-    std::auto_ptr<std::vector<Geometry*> > lines(new std::vector<Geometry*>);
     GeometryFactory gf;
-    geom_ptr geom;
-#ifdef HAS_PREPARED_GEOMETRIES
-    geos::geom::prep::PreparedGeometryFactory pgf;
-#endif
     maybe_wkts_t wkts(new std::vector<geometry_builder::wkt_t>);
 
 
     try
     {
-        for (int c=0; xnodes[c]; c++) {
-            std::auto_ptr<CoordinateSequence> coords(gf.getCoordinateSequenceFactory()->create((size_t)0, (size_t)2));
-            for (int i = 0; i < xcount[c]; i++) {
-                const osmNode *nodes = xnodes[c];
-                Coordinate c;
-                c.x = nodes[i].lon;
-                c.y = nodes[i].lat;
-                coords->add(c, 0);
-            }
-            if (coords->getSize() > 1) {
-                geom = geom_ptr(gf.createLineString(coords.release()));
-                lines->push_back(geom.release());
-            }
-        }
-
-        //geom_ptr segment(0);
-        geom_ptr mline (gf.createMultiLineString(lines.release()));
-        //geom_ptr noded (segment->Union(mline.get()));
-        LineMerger merger;
-        //merger.add(noded.get());
-        merger.add(mline.get());
-        std::auto_ptr<std::vector<LineString *> > merged(merger.getMergedLineStrings());
-        WKTWriter writer;
+        // join the ways up at their ends into rings and lines
+        std::vector<nodelist_t> merged;
+        merge_ways(xnodes, xcount, merged);
 
         // Procces ways into lines or simple polygon list
-        polygondata* polys = new polygondata[merged->size()];
-
-        unsigned totalpolys = 0;
-        for (unsigned i=0 ;i < merged->size(); ++i)
+        std::vector<const nodelist_t *> rings;
+        for (unsigned i=0 ;i < merged.size(); ++i)
         {
-            std::auto_ptr<LineString> pline ((*merged ) [i]);
-            if (make_polygon && pline->getNumPoints() > 3 && pline->isClosed())
+            const nodelist_t &pline = merged[i];
+            if (make_polygon && pline.size() > 3 && same_node(pline.front(), pline.back()))
             {
-                polys[totalpolys].polygon = gf.createPolygon(gf.createLinearRing(pline->getCoordinates()),0);
-                polys[totalpolys].ring = gf.createLinearRing(pline->getCoordinates());
-                polys[totalpolys].area = polys[totalpolys].polygon->getArea();
-                polys[totalpolys].iscontained = 0;
-                polys[totalpolys].containedbyid = 0;
-                if (polys[totalpolys].area > 0.0)
-                    totalpolys++;
-                else {
-                    delete(polys[totalpolys].polygon);
-                    delete(polys[totalpolys].ring);
-                }
+                rings.push_back(&pline);
             }
             else
             {
-                        //std::cerr << "polygon(" << osm_id << ") is no good: points(" << pline->getNumPoints() << "), closed(" << pline->isClosed() << "). " << writer.write(pline.get()) << std::endl;
                 double distance = 0;
-                std::auto_ptr<CoordinateSequence> segment;
-                segment = std::auto_ptr<CoordinateSequence>(gf.getCoordinateSequenceFactory()->create((size_t)0, (size_t)2));
-                segment->add(pline->getCoordinateN(0));
-                for(unsigned i=1; i<pline->getNumPoints(); i++) {
-                    segment->add(pline->getCoordinateN(i));
-                    distance += pline->getCoordinateN(i).distance(pline->getCoordinateN(i-1));
-                    if ((distance >= split_at) || (i == pline->getNumPoints()-1)) {
-                        geom_ptr geom = geom_ptr(gf.createLineString(segment.release()));
-
+                nodelist_t segment;
+                segment.push_back(pline[0]);
+                for(unsigned i=1; i<pline.size(); i++) {
+                    segment.push_back(pline[i]);
+                    distance += node_distance(pline[i], pline[i-1]);
+                    if ((distance >= split_at) || (i == pline.size()-1)) {
                         //copy of an empty one should be cheapest
                         wkts->push_back(geometry_builder::wkt_t());
                         //then we set on the one we already have
-                        wkts->back().geom = writer.write(geom.get());
+                        wkb::write_linestring(wkts->back().geom, &segment[0], segment.size());
                         wkts->back().area = 0;
 
-                        segment.reset(gf.getCoordinateSequenceFactory()->create((size_t)0, (size_t)2));
+                        segment.clear();
                         distance=0;
-                        segment->add(pline->getCoordinateN(i));
+                        segment.push_back(pline[i]);
                     }
                 }
-                //std::string text = writer.write(pline.get());
-                //wkts.push_back(text);
-                //areas.push_back(0.0);
-                //wkt_size++;
             }
         }
 
+        const int threads = (rings.size() >= PARALLEL_MIN_RINGS) ? thread_count : 1;
+        polygondata* polys = new polygondata[rings.size()];
+        worker_factories factories(threads);
+        unsigned totalpolys = make_polygons(factories, rings, polys, threads);
+
         if (totalpolys)
         {
             qsort(polys, totalpolys, sizeof(polygondata), polygondata_comparearea);
 
-            unsigned toplevelpolygons = 0;
-            int istoplevelafterall;
-
-            for (unsigned i=0 ;i < totalpolys; ++i)
-            {
-                if (polys[i].iscontained != 0) continue;
-                toplevelpolygons++;
-#ifdef HAS_PREPARED_GEOMETRIES
-                const geos::geom::prep::PreparedGeometry* preparedtoplevelpolygon = pgf.create(polys[i].polygon);
-#endif
+            std::vector<std::vector<unsigned> > holes;
+            unsigned toplevelpolygons = nest_polygons(polys, totalpolys, holes, threads);
 
-                for (unsigned j=i+1; j < totalpolys; ++j)
-                {
-#ifdef HAS_PREPARED_GEOMETRIES
-                    // Does preparedtoplevelpolygon contain the smaller polygon[j]?
-                    if (polys[j].containedbyid == 0 && preparedtoplevelpolygon->contains(polys[j].polygon))
-#else
-                    // Does polygon[i] contain the smaller polygon[j]?
-                    if (polys[j].containedbyid == 0 && polys[i].polygon->contains(polys[j].polygon))
-#endif
-                    {
-                        // are we in a [i] contains [k] contains [j] situation
-                        // which would actually make j top level
-                        istoplevelafterall = 0;
-                        for (unsigned k=i+1; k < j; ++k)
-                        {
-                            if (polys[k].iscontained && polys[k].containedbyid == i && polys[k].polygon->contains(polys[j].polygon))
-                            {
-                                istoplevelafterall = 1;
-                                break;
-                            }
-#if 0
-                            else if (polys[k].polygon->intersects(polys[j].polygon) || polys[k].polygon->touches(polys[j].polygon))
-                            {
-                                // FIXME: This code does not work as intended
-                                // It should be setting the polys[k].ring in order to update this object
-                                // but the value of polys[k].polygon calculated is normally NULL
-
-                                // Add polygon this polygon (j) to k since they intersect
-                                // Mark ourselfs to be dropped (2), delete the original k
-                                Geometry* polyunion = polys[k].polygon->Union(polys[j].polygon);
-                                delete(polys[k].polygon);
-                                polys[k].polygon = dynamic_cast<Polygon*>(polyunion);
-                                polys[j].iscontained = 2; // Drop
-                                istoplevelafterall = 2;
-                                break;
-                            }
-#endif
-                        }
-                        if (istoplevelafterall == 0)
-                        {
-                            polys[j].iscontained = 1;
-                            polys[j].containedbyid = i;
-                        }
-                    }
-                }
-#ifdef HAS_PREPARED_GEOMETRIES
-        pgf.destroy(preparedtoplevelpolygon);
-#endif
-            }
             // polys now is a list of polygons tagged with which ones are inside each other
 
             // List of polygons for multipolygon
@@ -759,12 +1314,9 @@ geometry_builder::maybe_wkts_t geometry_builder::build_both(const osmNode * cons
 
                 // List of holes for this top level polygon
                 std::auto_ptr<std::vector<Geometry*> > interior(new std::vector<Geometry*>);
-                for (unsigned j=i+1; j < totalpolys; ++j)
+                for (unsigned j=0; j < holes[i].size(); ++j)
                 {
-                   if (polys[j].iscontained == 1 && polys[j].containedbyid == i)
-                   {
-                       interior->push_back(polys[j].ring);
-                   }
+                    interior->push_back(polys[holes[i][j]].ring);
                 }
 
                 Polygon* poly(gf.createPolygon(polys[i].ring, interior.release()));
@@ -786,29 +1338,13 @@ geometry_builder::maybe_wkts_t geometry_builder::build_both(const osmNode * cons
                     //copy of an empty one should be cheapest
                     wkts->push_back(geometry_builder::wkt_t());
                     //then we set on the one we already have
-                    wkts->back().geom = writer.write(multipoly.get());
+                    wkts->back().geom = write_hex(multipoly.get());
                     wkts->back().area = multipoly->getArea();
                 }
             }
             else
             {
-                for(unsigned i=0; i<toplevelpolygons; i++)
-                {
-                    Geometry* poly = dynamic_cast<Geometry*>(polygons->at(i));
-                    if (!poly->isValid() && (excludepoly == 0)) {
-                        poly = dynamic_cast<Geometry*>(poly->buffer(0));
-                        poly->normalize();
-                    }
-                    if ((excludepoly == 0) || (poly->isValid()))
-                    {
-                        //copy of an empty one should be cheapest
-                        wkts->push_back(geometry_builder::wkt_t());
-                        //then we set on the one we already have
-                        wkts->back().geom = writer.write(poly);
-                        wkts->back().area = poly->getArea();
-                    }
-                    delete(poly);
-                }
+                write_polygons(factories, *polygons, excludepoly, threads, *wkts);
             }
         }
 
@@ -835,8 +1371,13 @@ void geometry_builder::set_exclude_broken_polygon(int exclude)
     excludepoly = exclude;
 }
 
+void geometry_builder::set_thread_count(int count)
+{
+    thread_count = count;
+}
+
 geometry_builder::geometry_builder()
-    : excludepoly(0) {
+    : excludepoly(0), thread_count(1) {
 }
 
 geometry_builder::~geometry_builder() {
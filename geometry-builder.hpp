@@ -59,9 +59,12 @@ struct geometry_builder : public boost::noncopyable
     maybe_wkt_t build_multilines(const osmNode * const * xnodes, const int *xcount, osmid_t osm_id) const;
 
     void set_exclude_broken_polygon(int exclude);
+    // the rings of very large relations are built on up to this many threads
+    void set_thread_count(int count);
 
 private:
     int excludepoly;
+    int thread_count;
 };
 
 #endif
@@ -21,7 +21,7 @@ boost::shared_ptr<geometry_processor> geometry_processor::create(const std::stri
         ptr = boost::make_shared<processor_line>(srid);
     }
     else if (type == "polygon") {
-        ptr = boost::make_shared<processor_polygon>(srid, options->enable_multi);
+        ptr = boost::make_shared<processor_polygon>(srid, options->enable_multi, options->num_procs);
     }
     else {
         throw std::runtime_error((boost::format("Unable to construct geometry processor "
@@ -78,8 +78,8 @@ size_t way_helper::set(const osmid_t *node_ids, size_t node_count, const middle_
     //if we don't have enough space already get more
     if(node_cache.size() < node_count)
         node_cache.resize(node_count);
-    //get the node data
-    mid->nodes_get_list(&node_cache.front(), node_ids, node_count);
+    //get the node data, dropping what is left over from a longer way
+    node_cache.resize(mid->nodes_get_list(&node_cache.front(), node_ids, node_count));
     return node_cache.size();
 }
 
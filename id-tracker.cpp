@@ -1,61 +1,214 @@
 #include "id-tracker.hpp"
 
-#include <map>
 #include <vector>
 #include <limits>
 #include <algorithm>
+#include <iterator>
+#include <cassert>
 
-#include <boost/optional.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
 
 #define BLOCK_BITS (16)
 #define BLOCK_SIZE (1 << BLOCK_BITS)
 #define BLOCK_MASK (BLOCK_SIZE - 1)
+#define BITMAP_WORDS (BLOCK_SIZE >> 6)
+
+/* blocks with at most this many ids are kept as a sorted array. the array
+ * would stay smaller than the 8kB bitmap up to 4096 ids, but lookups in
+ * it get slow well before that, so switch a bit earlier. */
+#define ARRAY_MAX (1024)
 
 namespace {
-/* block used to be just a std::vector<bool> of fixed size. however,
- * it seems there's significant overhead in exposing std::vector<bool>::iterator
- * and so this is now a minimal re-implementation.
+// index of the lowest set bit, word must not be zero
+inline uint32_t lowest_bit(uint64_t word) {
+#ifdef __GNUC__
+    return __builtin_ctzll(word);
+#else
+    uint32_t idx = 0;
+    while (((word >> idx) & 1) == 0) {
+        ++idx;
+    }
+    return idx;
+#endif
+}
+
+inline size_t popcount(uint64_t word) {
+#ifdef __GNUC__
+    return __builtin_popcountll(word);
+#else
+    size_t n = 0;
+    for (; word; ++n) {
+        word &= word - 1;
+    }
+    return n;
+#endif
+}
+
+/* this used to be a std::map of fixed size bitmaps. it is now a roaring
+ * style layout: a sorted vector of blocks, each of which holds the low
+ * BLOCK_BITS of its ids either as a sorted array (when sparse) or as a
+ * bitmap (when dense). both keep a count of their set bits, so the size
+ * never needs to be recalculated.
  *
- * each block is BLOCK_SIZE bits, stored as a vector of uint32_t elements.
+ * popping the smallest id is the most common access pattern, so both
+ * kinds of block keep a head position before which everything has
+ * already been removed.
  */
 struct block {
-    block() : bits(BLOCK_SIZE >> 5, 0) {}
-    inline bool operator[](size_t i) const { return (bits[i >> 5] & (1 << (i & 0x1f))) > 0; }
+    block() : values(), words(), count(0), head(0) {}
+
+    bool get(uint32_t i) const {
+        if (is_bitmap()) {
+            return (words[i >> 6] & (uint64_t(1) << (i & 0x3f))) != 0;
+        }
+        return std::binary_search(values.begin() + head, values.end(), uint16_t(i));
+    }
+
     //returns true if the value actually caused a bit to flip
-    inline bool set(size_t i, bool value) {
-        uint32_t &bit = bits[i >> 5];
-        uint32_t old = bit;
-        uint32_t mask = 1 << (i & 0x1f);
-        //allow the bit to become 1 if not already
-        if (value) {
-            bit |= mask;
-        }//force the bit to 0 if its not already
-        else {
-            bit &= ~mask;
-        }
-        //did it actually change the value
-        return old != bit;
-    }
-    // find the next bit which is set, starting from an initial offset
-    // of start. this offset is a bit like an iterator, but not fully
-    // supporting iterator movement forwards and backwards.
-    //
-    // returns BLOCK_SIZE if a set bit isn't found
-    size_t next_set(size_t start) const {
-        uint32_t bit_i = start >> 5;
-
-        while ((bit_i < (BLOCK_SIZE >> 5)) && (bits[bit_i] == 0)) {
-            ++bit_i;
-        }
-
-        if (bit_i >= (BLOCK_SIZE >> 5)) { return BLOCK_SIZE; }
-        uint32_t bit = bits[bit_i];
-        size_t idx = bit_i << 5;
-        while ((bit & 1) == 0) { ++idx; bit >>= 1; }
-        return idx;
+    bool set(uint32_t i) {
+        if (is_bitmap()) {
+            uint64_t &word = words[i >> 6];
+            const uint64_t mask = uint64_t(1) << (i & 0x3f);
+            if (word & mask) {
+                return false;
+            }
+            word |= mask;
+            head = std::min(head, size_t(i >> 6));
+            ++count;
+            return true;
+        }
+
+        //everything was popped, so start the array over
+        if (values.size() == head) {
+            values.clear();
+            head = 0;
+        }
+
+        //common case when marking in id order, just add to the end
+        if (values.empty() || values.back() < i) {
+            values.push_back(uint16_t(i));
+        } else {
+            std::vector<uint16_t>::iterator itr =
+                std::lower_bound(values.begin() + head, values.end(), uint16_t(i));
+            if (itr != values.end() && *itr == i) {
+                return false;
+            }
+            //the slot just before the head is free to reuse
+            if (itr == values.begin() + head && head > 0) {
+                values[--head] = uint16_t(i);
+            } else {
+                values.insert(itr, uint16_t(i));
+            }
+        }
+        ++count;
+
+        if (count > ARRAY_MAX) {
+            to_bitmap();
+        }
+        return true;
+    }
+
+    //remove and return the smallest set bit, the block must not be empty
+    uint32_t pop_min() {
+        assert(count > 0);
+        --count;
+
+        if (is_bitmap()) {
+            while (words[head] == 0) {
+                ++head;
+            }
+            uint64_t &word = words[head];
+            const uint32_t idx = lowest_bit(word);
+            word &= word - 1;
+            return uint32_t(head << 6) | idx;
+        }
+
+        return values[head++];
     }
+
+    //smallest set bit >= start, or BLOCK_SIZE if there is none
+    uint32_t next_set(uint32_t start) const {
+        if (is_bitmap()) {
+            for (size_t word_i = start >> 6; word_i < BITMAP_WORDS; ++word_i) {
+                uint64_t word = words[word_i];
+                //ignore the bits before start in its own word
+                if (word_i == (start >> 6)) {
+                    word &= ~uint64_t(0) << (start & 0x3f);
+                }
+                if (word != 0) {
+                    return uint32_t(word_i << 6) | lowest_bit(word);
+                }
+            }
+            return BLOCK_SIZE;
+        }
+
+        std::vector<uint16_t>::const_iterator itr =
+            std::lower_bound(values.begin() + head, values.end(), uint16_t(start));
+        if (itr == values.end()) {
+            return BLOCK_SIZE;
+        }
+        return *itr;
+    }
+
+    //add all the bits set in another block
+    void merge(const block &other) {
+        if (other.is_bitmap()) {
+            if (!is_bitmap()) {
+                to_bitmap();
+            }
+            count = 0;
+            for (size_t i = 0; i < BITMAP_WORDS; ++i) {
+                words[i] |= other.words[i];
+                count += popcount(words[i]);
+            }
+            head = 0;
+        } else if (is_bitmap()) {
+            for (size_t i = other.head; i < other.values.size(); ++i) {
+                set(other.values[i]);
+            }
+        } else {
+            std::vector<uint16_t> merged;
+            merged.reserve((values.size() - head) + (other.values.size() - other.head));
+            std::set_union(values.begin() + head, values.end(),
+                           other.values.begin() + other.head, other.values.end(),
+                           std::back_inserter(merged));
+            values.swap(merged);
+            head = 0;
+            count = values.size();
+            if (count > ARRAY_MAX) {
+                to_bitmap();
+            }
+        }
+    }
+
+    size_t size() const { return count; }
+
 private:
-    std::vector<uint32_t> bits;
+    bool is_bitmap() const { return !words.empty(); }
+
+    void to_bitmap() {
+        words.assign(BITMAP_WORDS, 0);
+        for (size_t i = head; i < values.size(); ++i) {
+            words[values[i] >> 6] |= uint64_t(1) << (values[i] & 0x3f);
+        }
+        std::vector<uint16_t>().swap(values);
+        head = 0;
+    }
+
+    std::vector<uint16_t> values;
+    std::vector<uint64_t> words;
+    size_t count;
+    // array: index of the first live value. bitmap: index of the first
+    // word which may have a bit set.
+    size_t head;
+};
+
+typedef std::pair<osmid_t, boost::shared_ptr<block> > entry_t;
+
+// only compare the keys of the blocks
+struct key_less {
+    bool operator()(const entry_t &a, osmid_t b) const { return a.first < b; }
 };
 } // anonymous namespace
 
@@ -64,72 +217,163 @@ struct id_tracker::pimpl {
     ~pimpl();
 
     bool get(osmid_t id) const;
-    bool set(osmid_t id, bool value);
+    bool set(osmid_t id);
     osmid_t pop_min();
+    osmid_t next(osmid_t id) const;
+    void merge(const pimpl &other);
+    void clear();
+
+    // find the block for a key, or where it would have to be inserted
+    std::vector<entry_t>::iterator find(osmid_t key);
+    std::vector<entry_t>::const_iterator find(osmid_t key) const;
 
-    typedef std::map<osmid_t, block> map_t;
-    map_t pending;
+    // blocks sorted by key. the ones before front have been emptied by
+    // pop_min, so don't need to be looked at any more.
+    std::vector<entry_t> blocks;
+    size_t front;
+    // index of the block found last
+    mutable size_t hint;
     osmid_t old_id;
     size_t count;
-    // a cache of the next starting point to search for in the block.
-    // this significantly speeds up pop_min() because it doesn't need
-    // to repeatedly search the beginning of the block each time.
-    boost::optional<size_t> next_start;
 };
 
-bool id_tracker::pimpl::get(osmid_t id) const {
-    const osmid_t block = id >> BLOCK_BITS, offset = id & BLOCK_MASK;
-    map_t::const_iterator itr = pending.find(block);
-    bool result = false;
+std::vector<entry_t>::iterator id_tracker::pimpl::find(osmid_t key) {
+    // ids are usually marked and looked up in order, so try the block
+    // used last and the one after it before searching.
+    for (size_t i = std::max(hint, front); i < std::min(hint + 2, blocks.size()); ++i) {
+        if (blocks[i].first == key) {
+            hint = i;
+            return blocks.begin() + i;
+        }
+    }
+    std::vector<entry_t>::iterator itr = std::lower_bound(blocks.begin() + front, blocks.end(), key, key_less());
+    hint = itr - blocks.begin();
+    return itr;
+}
 
-    if (itr != pending.end()) {
-        result = itr->second[offset];
+std::vector<entry_t>::const_iterator id_tracker::pimpl::find(osmid_t key) const {
+    for (size_t i = std::max(hint, front); i < std::min(hint + 2, blocks.size()); ++i) {
+        if (blocks[i].first == key) {
+            hint = i;
+            return blocks.begin() + i;
+        }
     }
+    std::vector<entry_t>::const_iterator itr = std::lower_bound(blocks.begin() + front, blocks.end(), key, key_less());
+    hint = itr - blocks.begin();
+    return itr;
+}
 
-    return result;
+bool id_tracker::pimpl::get(osmid_t id) const {
+    const osmid_t key = id >> BLOCK_BITS, offset = id & BLOCK_MASK;
+    std::vector<entry_t>::const_iterator itr = find(key);
+
+    if (itr != blocks.end() && itr->first == key) {
+        return itr->second->get(offset);
+    }
+    return false;
 }
 
-bool id_tracker::pimpl::set(osmid_t id, bool value) {
-    const osmid_t block = id >> BLOCK_BITS, offset = id & BLOCK_MASK;
-    bool flipped = pending[block].set(offset, value);
-    // a set may potentially invalidate a next_start, as the bit
-    // set might be before the position of next_start.
-    if (next_start) { next_start = boost::none; }
-    return flipped;
+bool id_tracker::pimpl::set(osmid_t id) {
+    const osmid_t key = id >> BLOCK_BITS, offset = id & BLOCK_MASK;
+    std::vector<entry_t>::iterator itr = find(key);
+
+    if (itr == blocks.end() || itr->first != key) {
+        // reuse the emptied slot in front of the live blocks if possible,
+        // otherwise drop the emptied ones before shifting things around.
+        if (itr == blocks.begin() + front && front > 0) {
+            --front;
+            blocks[front] = entry_t(key, boost::shared_ptr<block>(new block()));
+            itr = blocks.begin() + front;
+        } else {
+            if (itr != blocks.end() && front > 0) {
+                const size_t pos = (itr - blocks.begin()) - front;
+                blocks.erase(blocks.begin(), blocks.begin() + front);
+                front = 0;
+                itr = blocks.begin() + pos;
+            }
+            itr = blocks.insert(itr, entry_t(key, boost::shared_ptr<block>(new block())));
+        }
+    }
+
+    return itr->second->set(offset);
 }
 
-// find the first element in a block set to true
+// find the first marked id and unmark it
 osmid_t id_tracker::pimpl::pop_min() {
-    osmid_t id = max();
+    while (front < blocks.size()) {
+        entry_t &e = blocks[front];
+        if (e.second->size() > 0) {
+            return (e.first << BLOCK_BITS) | e.second->pop_min();
+        }
+        // nothing left in this block, free it and move on
+        e.second.reset();
+        ++front;
+    }
 
-    while (next_start || !pending.empty()) {
-        map_t::iterator itr = pending.begin();
-        block &b = itr->second;
-        size_t start = next_start.get_value_or(0);
+    // everything has been popped, start over
+    clear();
+    return max();
+}
 
-        size_t b_itr = b.next_set(start);
-        if (b_itr != BLOCK_SIZE) {
-            b.set(b_itr, false);
-            id = (itr->first << BLOCK_BITS) | b_itr;
-            next_start = b_itr;
-            break;
+osmid_t id_tracker::pimpl::next(osmid_t id) const {
+    if (id == max()) {
+        return max();
+    }
+
+    const osmid_t key = id >> BLOCK_BITS;
+    uint32_t offset = id & BLOCK_MASK;
+    std::vector<entry_t>::const_iterator itr = find(key);
+    if (itr != blocks.end() && itr->first != key) {
+        offset = 0;
+    }
+
+    for (; itr != blocks.end(); ++itr, offset = 0) {
+        const uint32_t found = itr->second->next_set(offset);
+        if (found != BLOCK_SIZE) {
+            return (itr->first << BLOCK_BITS) | found;
+        }
+    }
+    return max();
+}
+
+void id_tracker::pimpl::merge(const pimpl &other) {
+    std::vector<entry_t> merged;
+    merged.reserve((blocks.size() - front) + (other.blocks.size() - other.front));
+
+    // both are sorted by key, so this is a plain merge of the two
+    std::vector<entry_t>::const_iterator a = blocks.begin() + front, b = other.blocks.begin() + other.front;
+    while (a != blocks.end() || b != other.blocks.end()) {
+        if (b == other.blocks.end() || (a != blocks.end() && a->first < b->first)) {
+            merged.push_back(*a++);
+
+        } else if (a == blocks.end() || b->first < a->first) {
+            // copy it, the other tracker keeps its own blocks
+            merged.push_back(entry_t(b->first, boost::shared_ptr<block>(new block(*b->second))));
+            count += b->second->size();
+            ++b;
 
         } else {
-            // no elements in this block - might as well delete
-            // the whole thing.
-            pending.erase(itr);
-            // since next_start is relative to the current
-            // block, which is ceasing to exist, then we need to
-            // reset it.
-            next_start = boost::none;
+            count -= a->second->size();
+            a->second->merge(*b->second);
+            count += a->second->size();
+            merged.push_back(*a++);
+            ++b;
         }
     }
 
-    return id;
+    blocks.swap(merged);
+    front = 0;
+}
+
+void id_tracker::pimpl::clear() {
+    std::vector<entry_t>().swap(blocks);
+    front = 0;
+    hint = 0;
+    count = 0;
 }
 
 id_tracker::pimpl::pimpl()
-    : pending(), old_id(min()), count(0), next_start(boost::none) {
+    : blocks(), front(0), hint(0), old_id(min()), count(0) {
 }
 
 id_tracker::pimpl::~pimpl() {
@@ -144,7 +388,7 @@ id_tracker::~id_tracker() {
 
 void id_tracker::mark(osmid_t id) {
     //setting returns true if the id wasn't already marked
-    impl->count += size_t(impl->set(id, true));
+    impl->count += size_t(impl->set(id));
     //we've marked something so we need to be able to pop it
     //the assert below will fail though if we've already popped
     //some that were > id so we have to essentially reset to
@@ -163,12 +407,29 @@ osmid_t id_tracker::pop_mark() {
     impl->old_id = id;
 
     //we just go rid of one (if there were some to get rid of)
-    if(impl->count > 0)
+    if(impl->count > 0 && id_tracker::is_valid(id))
         impl->count--;
 
     return id;
 }
 
+osmid_t id_tracker::next_mark(osmid_t id) const {
+    return impl->next(id);
+}
+
+void id_tracker::merge(const id_tracker &other) {
+    if (this == &other) {
+        return;
+    }
+    impl->merge(*other.impl);
+    impl->old_id = min();
+}
+
+void id_tracker::clear() {
+    impl->clear();
+    impl->old_id = min();
+}
+
 size_t id_tracker::size() { return impl->count; }
 
 bool id_tracker::is_valid(osmid_t id) { return id != max(); }
@@ -8,12 +8,21 @@
 
 struct id_tracker : public boost::noncopyable {
     id_tracker();
-    ~id_tracker();
+    virtual ~id_tracker();
 
-    void mark(osmid_t id);
-    bool is_marked(osmid_t id);
-    osmid_t pop_mark();
-    size_t size();
+    // these can be kept elsewhere, see pgsql_id_tracker
+    virtual void mark(osmid_t id);
+    virtual bool is_marked(osmid_t id);
+    virtual osmid_t pop_mark();
+    virtual size_t size();
+
+    // the smallest marked id >= id, without unmarking it. returns max()
+    // if there are none, so all marks can be visited in order with
+    // for (i = next_mark(min()); is_valid(i); i = next_mark(i + 1))
+    osmid_t next_mark(osmid_t id) const;
+    // mark everything which is marked in other
+    void merge(const id_tracker &other);
+    void clear();
 
     static bool is_valid(osmid_t);
     static osmid_t max();
@@ -118,6 +118,25 @@ char inputGetChar(struct Input *ctx)
     return ctx->buf[ctx->buf_ptr++];
 }
 
+int inputPeek(struct Input *ctx, const char **data)
+{
+    if (ctx->buf_ptr == ctx->buf_fill) {
+        ctx->buf_fill = readFile(ctx, &ctx->buf[0], sizeof(ctx->buf));
+        ctx->buf_ptr = 0;
+        if (ctx->buf_fill < 0) {
+            perror("Error while reading file");
+            exit(1);
+        }
+    }
+    *data = &ctx->buf[ctx->buf_ptr];
+    return ctx->buf_fill - ctx->buf_ptr;
+}
+
+void inputSkip(struct Input *ctx, int len)
+{
+    ctx->buf_ptr += len;
+}
+
 int inputEof(struct Input *ctx)
 {
     return ctx->eof;
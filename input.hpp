@@ -7,6 +7,11 @@ int readFile(struct Input *context, char * buffer, int len);
 int inputClose(struct Input *context);
 struct Input *inputOpen(const char *name);
 char inputGetChar(struct Input *context);
+/* Makes the input which has been buffered but not read yet available in
+   *data, reading more if there is none. Returns how much there is. */
+int inputPeek(struct Input *context, const char **data);
+/* Marks len bytes of what inputPeek made available as read */
+void inputSkip(struct Input *context, int len);
 int inputEof(struct Input *context);
 xmlTextReaderPtr inputUTF8(const char *name);
 
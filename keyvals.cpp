@@ -10,12 +10,12 @@
 #include <assert.h>
 #include <string.h>
 #include "keyvals.hpp"
+#include "string-interner.hpp"
 
 #include <algorithm>
 
 keyval::keyval()
 {
-    tree_ctx.reset(new text_tree());
     keyval::initList(this);
 }
 
@@ -32,7 +32,6 @@ void keyval::initList(struct keyval *head)
     head->prev = head;
     head->key = NULL;
     head->value = NULL;
-    head->has_column = 0;
 }
 
 void keyval::freeItem(struct keyval *p)
@@ -40,8 +39,7 @@ void keyval::freeItem(struct keyval *p)
     if (!p)
         return;
 
-    p->tree_ctx->text_release(p->key);
-    p->tree_ctx->text_release(p->value);
+    free(p->value);
     delete p;
 }
 
@@ -141,7 +139,6 @@ struct keyval *keyval::getMatches(struct keyval *head, const char *name)
     if (!head)
         return NULL;
 
-    //TODO: properly copy the tree_ctx from the keyval passed in
     out = new keyval();
     if (!out)
         return NULL;
@@ -174,8 +171,8 @@ void keyval::updateItem(struct keyval *head, const char *name, const char *value
     item = head->next;
     while(item != head) {
         if (!strcmp(item->key, name)) {
-            head->tree_ctx->text_release(item->value);
-            item->value = (char *)head->tree_ctx->text_get(value);
+            free(item->value);
+            item->value = strdup(value);
             return;
         }
         item = item->next;
@@ -234,13 +231,10 @@ int keyval::addItem(struct keyval *head, const char *name, const char *value, in
         }
     }
 
-    //TODO: properly implement a copy constructor and do the
-    //shallow copy there instead of relying on implicit one?
-    item = new keyval(*head);
+    item = new keyval();
 
-    item->key   = (char *)head->tree_ctx->text_get(name);
-    item->value = (char *)head->tree_ctx->text_get(value);
-    item->has_column=0;
+    item->key   = (char *)interned_keys().text(name);
+    item->value = strdup(value);
 
     /* Add to head */
     item->next = head->next;
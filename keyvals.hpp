@@ -3,26 +3,18 @@
  * Used as a small general purpose store for
  * tags, segment lists etc
  *
+ * The keys are interned in interned_keys(), so they must be tag keys or
+ * similar rather than arbitrary text. Each item owns a copy of its value.
  */
 
 #ifndef KEYVAL_H
 #define KEYVAL_H
 
-#include "text-tree.hpp"
-
-#include <boost/shared_ptr.hpp>
-
 struct keyval {
     char *key;
     char *value;
-    /* if a hstore column is requested we need a flag to store if a key
-       has its own column because it should not be added to the hstore
-       in this case
-    */
-    int has_column;
     struct keyval *next;
     struct keyval *prev;
-    boost::shared_ptr<text_tree> tree_ctx;
 
     keyval();
     ~keyval();
@@ -50,9 +50,14 @@ using namespace std;
 #include "options.hpp"
 #include "node-ram-cache.hpp"
 #include "node-persistent-cache.hpp"
+#include "taglist.hpp"
+#include "string-interner.hpp"
+#include "text-scan.hpp"
 #include "pgsql.hpp"
+#include "pgsql-id-tracker.hpp"
 #include "util.hpp"
 
+#include <algorithm>
 #include <stdexcept>
 #include <boost/format.hpp>
 #include <boost/unordered_map.hpp>
@@ -143,8 +148,18 @@ _restart:
 // Special escape routine for escaping strings in array constants: double quote, backslash,newline, tab*/
 inline char *escape_tag( char *ptr, const char *in, const int& escape )
 {
+  size_t length = strlen(in);
   while( *in )
   {
+    // copy everything up to the next char which needs escaping at once
+    size_t plain = text_scan::plain_prefix(in, length);
+    memcpy(ptr, in, plain);
+    ptr += plain;
+    in += plain;
+    length -= plain;
+    if( !*in )
+      break;
+
     switch(*in)
     {
       case '"':
@@ -178,20 +193,73 @@ inline char *escape_tag( char *ptr, const char *in, const int& escape )
         break;
     }
     in++;
+    length--;
   }
   return ptr;
 }
 
-// escape means we return '\N' for copy mode, otherwise we return just NULL */
-const char *pgsql_store_tags(const struct keyval *tags, const int& escape)
+// Builds the text of a postgres array of tags in a buffer which is reused
+// for the next array, so the result is only valid until then */
+class tag_array_writer
 {
+public:
+  tag_array_writer() : ptr(NULL), first(1) {}
+
+  void begin(int countlist)
+  {
+    if( buflen <= countlist * 24 ) // LE so 0 always matches */
+    {
+      buflen = ((countlist * 24) | 4095) + 1;  // Round up to next page */
+      buffer = (char *)realloc( buffer, buflen );
+    }
+    ptr = buffer;
+    first = 1;
+    *ptr++ = '{';
+  }
+
+  void add(const char *key, const char *value, const int& escape)
+  {
+    int maxlen = (strlen(key) + strlen(value)) * 4;
+    while( (ptr+maxlen-buffer) > (buflen-20) ) // Almost overflowed? */
+    {
+      size_t used = ptr - buffer;
+      buflen <<= 1;
+      buffer = (char *)realloc( buffer, buflen );
+      ptr = buffer + used;
+    }
+    if( !first ) *ptr++ = ',';
+    *ptr++ = '"';
+    ptr = escape_tag( ptr, key, escape );
+    *ptr++ = '"';
+    *ptr++ = ',';
+    *ptr++ = '"';
+    ptr = escape_tag( ptr, value, escape );
+    *ptr++ = '"';
+
+    first=0;
+  }
+
+  const char *end()
+  {
+    *ptr++ = '}';
+    *ptr++ = 0;
+    return buffer;
+  }
+
+private:
   static char *buffer;
   static int buflen;
 
   char *ptr;
-  struct keyval *i;
   int first;
+};
 
+char *tag_array_writer::buffer = NULL;
+int tag_array_writer::buflen = 0;
+
+// escape means we return '\N' for copy mode, otherwise we return just NULL */
+const char *pgsql_store_tags(const struct keyval *tags, const int& escape)
+{
   int countlist = keyval::countList(tags);
   if( countlist == 0 )
   {
@@ -201,43 +269,56 @@ const char *pgsql_store_tags(const struct keyval *tags, const int& escape)
       return NULL;
   }
 
-  if( buflen <= countlist * 24 ) // LE so 0 always matches */
-  {
-    buflen = ((countlist * 24) | 4095) + 1;  // Round up to next page */
-    buffer = (char *)realloc( buffer, buflen );
-  }
-_restart:
-
-  ptr = buffer;
-  first = 1;
-  *ptr++ = '{';
+  tag_array_writer writer;
+  writer.begin(countlist);
   // The lists are circular, exit when we reach the head again */
-  for( i=tags->next; i->key; i = i->next )
+  for( const struct keyval *i=tags->next; i->key; i = i->next )
+    writer.add( i->key, i->value, escape );
+  return writer.end();
+}
+
+// The tags are stored last to first, which is the order they had when the
+// parsers kept them in keyval lists */
+const char *pgsql_store_tags(const taglist &tags, const int& escape)
+{
+  if( tags.empty() )
   {
-    int maxlen = (strlen(i->key) + strlen(i->value)) * 4;
-    if( (ptr+maxlen-buffer) > (buflen-20) ) // Almost overflowed? */
-    {
-      buflen <<= 1;
-      buffer = (char *)realloc( buffer, buflen );
+    if( escape )
+      return "\\N";
+    else
+      return NULL;
+  }
 
-      goto _restart;
-    }
-    if( !first ) *ptr++ = ',';
-    *ptr++ = '"';
-    ptr = escape_tag( ptr, i->key, escape );
-    *ptr++ = '"';
-    *ptr++ = ',';
-    *ptr++ = '"';
-    ptr = escape_tag( ptr, i->value, escape );
-    *ptr++ = '"';
+  tag_array_writer writer;
+  writer.begin(tags.size());
+  for( size_t i = tags.size(); i > 0; i-- )
+    writer.add( tags.key(i - 1), tags.value(i - 1), escape );
+  return writer.end();
+}
 
-    first=0;
+// The members are stored last to first too, each as its type and id
+// followed by its role */
+const char *pgsql_store_members(const struct member *members, const int& member_count, const int& escape)
+{
+  if( member_count == 0 )
+  {
+    if( escape )
+      return "\\N";
+    else
+      return NULL;
   }
 
-  *ptr++ = '}';
-  *ptr++ = 0;
-
-  return buffer;
+  char buf[64];
+  tag_array_writer writer;
+  writer.begin(member_count);
+  for( int i = member_count; i > 0; i-- )
+  {
+    const struct member &m = members[i - 1];
+    const char tag = (m.type == OSMTYPE_NODE)?'n':(m.type == OSMTYPE_WAY)?'w':'r';
+    sprintf( buf, "%c%" PRIdOSMID, tag, m.id );
+    writer.add( buf, m.role, escape );
+  }
+  return writer.end();
 }
 
 // Decodes a portion of an array literal from postgres */
@@ -267,7 +348,9 @@ inline const char *decode_upto( const char *src, char *dst )
   return src;
 }
 
-void pgsql_parse_tags( const char *string, struct keyval *tags )
+// Calls add with each pair of an array literal from postgres */
+template <typename Add>
+void pgsql_parse_pairs( const char *string, Add &add )
 {
   char key[1024];
   char val[1024];
@@ -284,12 +367,48 @@ void pgsql_parse_tags( const char *string, struct keyval *tags )
     string++;
     string = decode_upto( string, val );
     // String points to the comma or closing '}' */
-    keyval::addItem( tags, key, val, 0 );
+    add( key, val );
     if( *string == ',' )
       string++;
   }
 }
 
+struct add_tag
+{
+  explicit add_tag( struct keyval *tags_ ) : tags(tags_) {}
+  void operator()( const char *key, const char *val ) { keyval::addItem( tags, key, val, 0 ); }
+  struct keyval *tags;
+};
+
+void pgsql_parse_tags( const char *string, struct keyval *tags )
+{
+  add_tag add( tags );
+  pgsql_parse_pairs( string, add );
+}
+
+// The roles are interned, so the members don't own them */
+struct add_member
+{
+  explicit add_member( std::vector<member> *members_ ) : members(members_) {}
+  void operator()( const char *key, const char *val )
+  {
+    member m;
+    m.type = (key[0] == 'n')?OSMTYPE_NODE:(key[0] == 'w')?OSMTYPE_WAY:(key[0] == 'r')?OSMTYPE_RELATION:((OsmType)-1);
+    m.id = strtoosmid( key+1, NULL, 10 );
+    m.role = interned_roles().text( val );
+    members->push_back( m );
+  }
+  std::vector<member> *members;
+};
+
+// Gives the members in their original order, see pgsql_store_members */
+void pgsql_parse_members( const char *string, std::vector<member> &members )
+{
+  add_member add( &members );
+  pgsql_parse_pairs( string, add );
+  std::reverse( members.begin(), members.end() );
+}
+
 // Parses an array of integers */
 void pgsql_parse_nodes(const char *src, osmid_t *nds, const int& nd_count )
 {
@@ -341,7 +460,7 @@ int pgsql_endCopy( struct middle_pgsql_t::table_desc *table)
 }
 } // anonymous namespace
 
-int middle_pgsql_t::local_nodes_set(const osmid_t& id, const double& lat, const double& lon, const struct keyval *tags)
+int middle_pgsql_t::local_nodes_set(const osmid_t& id, const double& lat, const double& lon, const taglist &tags)
 {
     // Four params: id, lat, lon, tags */
     const char *paramValues[4];
@@ -480,8 +599,8 @@ void middle_pgsql_t::cleanup(void)
     }
 }
 
-int middle_pgsql_t::nodes_set(osmid_t id, double lat, double lon, struct keyval *tags) {
-    cache->set( id, lat, lon, tags );
+int middle_pgsql_t::nodes_set(osmid_t id, double lat, double lon, const taglist &tags) {
+    cache->set( id, lat, lon );
 
     return (out_options->flat_node_cache_enabled) ? persistent_cache->set(id, lat, lon) : local_nodes_set(id, lat, lon, tags);
 }
@@ -544,7 +663,7 @@ int middle_pgsql_t::node_changed(osmid_t osm_id)
     return 0;
 }
 
-int middle_pgsql_t::ways_set(osmid_t way_id, osmid_t *nds, int nd_count, struct keyval *tags)
+int middle_pgsql_t::ways_set(osmid_t way_id, osmid_t *nds, int nd_count, const taglist &tags)
 {
     // Three params: id, nodes, tags */
     const char *paramValues[4];
@@ -658,12 +777,25 @@ int middle_pgsql_t::ways_get_list(const osmid_t *ids, int way_count, osmid_t *wa
                 way_ids[count] = ids[i];
                 pgsql_parse_tags( PQgetvalue(res, j, 2), &(tags[count]) );
 
-                num_nodes = strtol(PQgetvalue(res, j, 3), NULL, 10);
-                list = (osmid_t *)alloca(sizeof(osmid_t)*num_nodes );
-                nodes_ptr[count] = (struct osmNode *)malloc(sizeof(struct osmNode) * num_nodes);
-                pgsql_parse_nodes( PQgetvalue(res, j, 1), list, num_nodes);
+                // ways shared by several relations only need their
+                // nodes looked up once
+                if (way_cache) {
+                    nodes_ptr[count] = way_cache->get(ids[i], &count_ptr[count]);
+                } else {
+                    nodes_ptr[count] = NULL;
+                }
+
+                if (!nodes_ptr[count]) {
+                    num_nodes = strtol(PQgetvalue(res, j, 3), NULL, 10);
+                    list = (osmid_t *)alloca(sizeof(osmid_t)*num_nodes );
+                    nodes_ptr[count] = (struct osmNode *)malloc(sizeof(struct osmNode) * num_nodes);
+                    pgsql_parse_nodes( PQgetvalue(res, j, 1), list, num_nodes);
 
-                count_ptr[count] = nodes_get_list(nodes_ptr[count], list, num_nodes);
+                    count_ptr[count] = nodes_get_list(nodes_ptr[count], list, num_nodes);
+                    if (way_cache) {
+                        way_cache->set(ids[i], nodes_ptr[count], count_ptr[count]);
+                    }
+                }
 
                 count++;
                 keyval::initList(&(tags[count]));
@@ -738,14 +870,12 @@ int middle_pgsql_t::way_changed(osmid_t osm_id)
     return 0;
 }
 
-int middle_pgsql_t::relations_set(osmid_t id, struct member *members, int member_count, struct keyval *tags)
+int middle_pgsql_t::relations_set(osmid_t id, struct member *members, int member_count, const taglist &tags)
 {
     // Params: id, way_off, rel_off, parts, members, tags */
     const char *paramValues[6];
     char *buffer;
     int i;
-    struct keyval member_list;
-    char buf[64];
 
     int node_count = 0, way_count = 0, rel_count = 0;
 
@@ -754,20 +884,15 @@ int middle_pgsql_t::relations_set(osmid_t id, struct member *members, int member
     way_parts.reserve(member_count);
     rel_parts.reserve(member_count);
 
-    keyval::initList( &member_list );
-
     for( i=0; i<member_count; i++ )
     {
-      char tag = 0;
       switch( members[i].type )
       {
-        case OSMTYPE_NODE:     node_count++; node_parts.push_back(members[i].id); tag = 'n'; break;
-        case OSMTYPE_WAY:      way_count++; way_parts.push_back(members[i].id); tag = 'w'; break;
-        case OSMTYPE_RELATION: rel_count++; rel_parts.push_back(members[i].id); tag = 'r'; break;
+        case OSMTYPE_NODE:     node_count++; node_parts.push_back(members[i].id); break;
+        case OSMTYPE_WAY:      way_count++; way_parts.push_back(members[i].id); break;
+        case OSMTYPE_RELATION: rel_count++; rel_parts.push_back(members[i].id); break;
         default: fprintf( stderr, "Internal error: Unknown member type %d\n", members[i].type ); util::exit_nicely();
       }
-      sprintf( buf, "%c%" PRIdOSMID, tag, members[i].id );
-      keyval::addItem( &member_list, buf, members[i].role, 0 );
     }
 
     int all_count = 0;
@@ -779,7 +904,7 @@ int middle_pgsql_t::relations_set(osmid_t id, struct member *members, int member
     if( rel_table->copyMode )
     {
       char *tag_buf = strdup(pgsql_store_tags(tags,1));
-      const char *member_buf = pgsql_store_tags(&member_list,1);
+      const char *member_buf = pgsql_store_members(members, member_count, 1);
       char *parts_buf = pgsql_store_nodes(&all_parts[0], all_count);
       int length = strlen(member_buf) + strlen(tag_buf) + strlen(parts_buf) + 64;
       buffer = (char *)alloca(length);
@@ -787,7 +912,6 @@ int middle_pgsql_t::relations_set(osmid_t id, struct member *members, int member
               id, node_count, node_count+way_count, parts_buf, member_buf, tag_buf ) > (length-10) )
       { fprintf( stderr, "buffer overflow relation id %" PRIdOSMID "\n", id); return 1; }
       free(tag_buf);
-      keyval::resetList(&member_list);
       pgsql_CopyData(__FUNCTION__, rel_table->sql_conn, buffer);
       return 0;
     }
@@ -800,14 +924,13 @@ int middle_pgsql_t::relations_set(osmid_t id, struct member *members, int member
     paramValues[2] = ptr;
     sprintf( ptr, "%d", node_count+way_count );
     paramValues[3] = pgsql_store_nodes(&all_parts[0], all_count);
-    paramValues[4] = pgsql_store_tags(&member_list,0);
+    paramValues[4] = pgsql_store_members(members, member_count, 0);
     if( paramValues[4] )
         paramValues[4] = strdup(paramValues[4]);
     paramValues[5] = pgsql_store_tags(tags,0);
     pgsql_execPrepared(rel_table->sql_conn, "insert_rel", 6, (const char * const *)paramValues, PGRES_COMMAND_OK);
     if( paramValues[4] )
         free((void *)paramValues[4]);
-    keyval::resetList(&member_list);
     return 0;
 }
 
@@ -818,12 +941,9 @@ int middle_pgsql_t::relations_get(osmid_t id, struct member **members, int *memb
     char tmp[16];
     char const *paramValues[1];
     PGconn *sql_conn = rel_table->sql_conn;
-    struct keyval member_temp;
-    char tag;
+    std::vector<member> member_temp;
     int num_members;
     struct member *list;
-    int i=0;
-    struct keyval *item;
 
     // Make sure we're out of copy mode */
     pgsql_endCopy( rel_table );
@@ -840,26 +960,18 @@ int middle_pgsql_t::relations_get(osmid_t id, struct member **members, int *memb
     }
 
     pgsql_parse_tags( PQgetvalue(res, 0, 1), tags );
-    keyval::initList(&member_temp);
-    pgsql_parse_tags( PQgetvalue(res, 0, 0), &member_temp );
+    pgsql_parse_members( PQgetvalue(res, 0, 0), member_temp );
 
     num_members = strtol(PQgetvalue(res, 0, 2), NULL, 10);
-    list = (struct member *)malloc( sizeof(struct member)*num_members );
-
-    while( (item = keyval::popItem(&member_temp)) )
+    if( member_temp.size() > size_t(num_members) )
     {
-        if( i >= num_members )
-        {
-            fprintf(stderr, "Unexpected member_count reading relation %" PRIdOSMID "\n", id);
-            util::exit_nicely();
-        }
-        tag = item->key[0];
-        list[i].type = (tag == 'n')?OSMTYPE_NODE:(tag == 'w')?OSMTYPE_WAY:(tag == 'r')?OSMTYPE_RELATION:((OsmType)-1);
-        list[i].id = strtoosmid(item->key+1, NULL, 10 );
-        list[i].role = strdup( item->value );
-        keyval::freeItem(item);
-        i++;
+        fprintf(stderr, "Unexpected member_count reading relation %" PRIdOSMID "\n", id);
+        util::exit_nicely();
     }
+    list = (struct member *)malloc( sizeof(struct member)*num_members );
+    if( !member_temp.empty() )
+        memcpy( list, &member_temp[0], sizeof(struct member)*member_temp.size() );
+
     *members = list;
     *member_count = num_members;
     PQclear(res);
@@ -1106,8 +1218,13 @@ int middle_pgsql_t::start(const options_t *out_options_)
     int dropcreate = !out_options->append;
     char * sql;
 
-    ways_pending_tracker.reset(new id_tracker());
-    rels_pending_tracker.reset(new id_tracker());
+    if (out_options->pending_in_db) {
+        ways_pending_tracker.reset(new pgsql_id_tracker(out_options->conninfo, out_options->prefix, "ways_pending", true));
+        rels_pending_tracker.reset(new pgsql_id_tracker(out_options->conninfo, out_options->prefix, "rels_pending", true));
+    } else {
+        ways_pending_tracker.reset(new id_tracker());
+        rels_pending_tracker.reset(new id_tracker());
+    }
 
     Append = out_options->append;
     // reset this on every start to avoid options from last run
@@ -1116,6 +1233,10 @@ int middle_pgsql_t::start(const options_t *out_options_)
 
     cache.reset(new node_ram_cache( out_options->alloc_chunkwise | ALLOC_LOSSY, out_options->cache, out_options->scale));
     if (out_options->flat_node_cache_enabled) persistent_cache.reset(new node_persistent_cache(out_options, out_options->append, cache));
+    // nodes don't move once they are all imported, but they do in updates
+    if (!out_options->append && out_options->way_node_cache > 0) {
+        way_cache.reset(new way_node_cache(size_t(out_options->way_node_cache) << 20));
+    }
 
     fprintf(stderr, "Mid: pgsql, scale=%d cache=%d\n", out_options->scale, out_options->cache);
 
@@ -1313,6 +1434,11 @@ void middle_pgsql_t::stop(void)
 
     cache.reset();
     if (out_options->flat_node_cache_enabled) persistent_cache.reset();
+    if (way_cache) {
+        fprintf(stderr, "Way node cache: %lu hits, %lu misses\n",
+                (unsigned long)way_cache->hits(), (unsigned long)way_cache->misses());
+        way_cache.reset();
+    }
 
 #ifdef HAVE_PTHREAD
     pthread_thunk thunks[num_tables];
@@ -1344,7 +1470,7 @@ void middle_pgsql_t::stop(void)
 
 middle_pgsql_t::middle_pgsql_t()
     : tables(), num_tables(0), node_table(NULL), way_table(NULL), rel_table(NULL),
-      Append(0), cache(), persistent_cache(), build_indexes(0)
+      Append(0), cache(), persistent_cache(), way_cache(), build_indexes(0)
 {
     /*table = t_node,*/
     tables.push_back(table_desc(
@@ -1428,6 +1554,7 @@ boost::shared_ptr<const middle_query_t> middle_pgsql_t::get_instance() const {
     //during that process they are only read from
     mid->cache = cache;
     mid->persistent_cache = persistent_cache;
+    mid->way_cache = way_cache;
 
     // We use a connection per table to enable the use of COPY */
     for(int i=0; i<num_tables; i++) {
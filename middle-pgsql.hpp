@@ -13,6 +13,7 @@
 #include "node-ram-cache.hpp"
 #include "node-persistent-cache.hpp"
 #include "id-tracker.hpp"
+#include "way-node-cache.hpp"
 #include <memory>
 #include <vector>
 #include <boost/shared_ptr.hpp>
@@ -28,12 +29,12 @@ struct middle_pgsql_t : public slim_middle_t {
     void end(void);
     void commit(void);
 
-    int nodes_set(osmid_t id, double lat, double lon, struct keyval *tags);
+    int nodes_set(osmid_t id, double lat, double lon, const taglist &tags);
     int nodes_get_list(struct osmNode *out, const osmid_t *nds, int nd_count) const;
     int nodes_delete(osmid_t id);
     int node_changed(osmid_t id);
 
-    int ways_set(osmid_t id, osmid_t *nds, int nd_count, struct keyval *tags);
+    int ways_set(osmid_t id, osmid_t *nds, int nd_count, const taglist &tags);
     int ways_get(osmid_t id, struct keyval *tag_ptr, struct osmNode **node_ptr, int *count_ptr) const;
     int ways_get_list(const osmid_t *ids, int way_count, osmid_t *way_ids, struct keyval *tag_ptr, struct osmNode **node_ptr, int *count_ptr) const;
 
@@ -41,7 +42,7 @@ struct middle_pgsql_t : public slim_middle_t {
     int way_changed(osmid_t id);
 
     int relations_get(osmid_t id, struct member **members, int *member_count, struct keyval *tags) const;
-    int relations_set(osmid_t id, struct member *members, int member_count, struct keyval *tags);
+    int relations_set(osmid_t id, struct member *members, int member_count, const taglist &tags);
     int relations_delete(osmid_t id);
     int relation_changed(osmid_t id);
 
@@ -86,7 +87,7 @@ struct middle_pgsql_t : public slim_middle_t {
 private:
 
     int connect(table_desc& table);
-    int local_nodes_set(const osmid_t& id, const double& lat, const double& lon, const struct keyval *tags);
+    int local_nodes_set(const osmid_t& id, const double& lat, const double& lon, const taglist &tags);
     int local_nodes_get_list(struct osmNode *nodes, const osmid_t *ndids, const int& nd_count) const;
     int local_nodes_delete(osmid_t osm_id);
 
@@ -98,6 +99,7 @@ private:
 
     boost::shared_ptr<node_ram_cache> cache;
     boost::shared_ptr<node_persistent_cache> persistent_cache;
+    boost::shared_ptr<way_node_cache> way_cache;
 
     boost::shared_ptr<id_tracker> ways_pending_tracker, rels_pending_tracker;
 
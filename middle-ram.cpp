@@ -19,6 +19,7 @@
 #include "osmtypes.hpp"
 #include "middle-ram.hpp"
 #include "node-ram-cache.hpp"
+#include "taglist.hpp"
 #include "output-pgsql.hpp"
 #include "options.hpp"
 #include "util.hpp"
@@ -61,11 +62,18 @@ static int block2id(int block, int offset)
     return ((block - NUM_BLOCKS/2) << BLOCK_SHIFT) + offset;
 }
 
-int middle_ram_t::nodes_set(osmid_t id, double lat, double lon, struct keyval *tags) {
-    return cache->set(id, lat, lon, tags);
+int middle_ram_t::nodes_set(osmid_t id, double lat, double lon, const taglist &) {
+    return cache->set(id, lat, lon);
 }
 
-int middle_ram_t::ways_set(osmid_t id, osmid_t *nds, int nd_count, struct keyval *tags)
+/* Keep a copy of the tags in their original order */
+static void store_tags(struct keyval *list, const taglist &tags)
+{
+    for (size_t i = tags.size(); i > 0; --i)
+        keyval::addItem(list, tags.key(i - 1), tags.value(i - 1), 0);
+}
+
+int middle_ram_t::ways_set(osmid_t id, osmid_t *nds, int nd_count, const taglist &tags)
 {
     int block  = id2block(id);
     int offset = id2offset(id);
@@ -93,12 +101,12 @@ int middle_ram_t::ways_set(osmid_t id, osmid_t *nds, int nd_count, struct keyval
     } else
         keyval::resetList(ways[block][offset].tags);
 
-    keyval::cloneList(ways[block][offset].tags, tags);
+    store_tags(ways[block][offset].tags, tags);
 
     return 0;
 }
 
-int middle_ram_t::relations_set(osmid_t id, struct member *members, int member_count, struct keyval *tags)
+int middle_ram_t::relations_set(osmid_t id, struct member *members, int member_count, const taglist &tags)
 {
     struct member *ptr;
     int block  = id2block(id);
@@ -117,7 +125,7 @@ int middle_ram_t::relations_set(osmid_t id, struct member *members, int member_c
     } else
         keyval::resetList(rels[block][offset].tags);
 
-    keyval::cloneList(rels[block][offset].tags, tags);
+    store_tags(rels[block][offset].tags, tags);
 
     free( rels[block][offset].members );
     rels[block][offset].members = NULL;
@@ -263,8 +271,7 @@ int middle_ram_t::ways_get_list(const osmid_t *ids, int way_count, osmid_t *way_
 }
 
 /* Caller must free members_ptr and keyval::resetList(tags_ptr).
- * Note that the members in members_ptr are copied, but the roles
- * within the members are not, and should not be freed.
+ * The roles of the members are interned, and should not be freed.
  */
 int middle_ram_t::relations_get(osmid_t id, struct member **members_ptr, int *member_count, struct keyval *tags_ptr) const
 {
@@ -25,12 +25,12 @@ struct middle_ram_t : public middle_t {
     void end(void);
     void commit(void);
 
-    int nodes_set(osmid_t id, double lat, double lon, struct keyval *tags);
+    int nodes_set(osmid_t id, double lat, double lon, const taglist &tags);
     int nodes_get_list(struct osmNode *out, const osmid_t *nds, int nd_count) const;
     int nodes_delete(osmid_t id);
     int node_changed(osmid_t id);
 
-    int ways_set(osmid_t id, osmid_t *nds, int nd_count, struct keyval *tags);
+    int ways_set(osmid_t id, osmid_t *nds, int nd_count, const taglist &tags);
     int ways_get(osmid_t id, struct keyval *tag_ptr, struct osmNode **node_ptr, int *count_ptr) const;
     int ways_get_list(const osmid_t *ids, int way_count, osmid_t *way_ids, struct keyval *tag_ptr, struct osmNode **node_ptr, int *count_ptr) const;
 
@@ -38,7 +38,7 @@ struct middle_ram_t : public middle_t {
     int way_changed(osmid_t id);
 
     int relations_get(osmid_t id, struct member **members, int *member_count, struct keyval *tags) const;
-    int relations_set(osmid_t id, struct member *members, int member_count, struct keyval *tags);
+    int relations_set(osmid_t id, struct member *members, int member_count, const taglist &tags);
     int relations_delete(osmid_t id);
     int relation_changed(osmid_t id);
 
@@ -12,6 +12,7 @@
 #include <vector>
 
 struct keyval;
+class taglist;
 struct member;
 
 struct middle_query_t {
@@ -42,9 +43,9 @@ struct middle_t : public middle_query_t {
     virtual void end(void) = 0;
     virtual void commit(void) = 0;
 
-    virtual int nodes_set(osmid_t id, double lat, double lon, struct keyval *tags) = 0;
-    virtual int ways_set(osmid_t id, osmid_t *nds, int nd_count, struct keyval *tags) = 0;
-    virtual int relations_set(osmid_t id, struct member *members, int member_count, struct keyval *tags) = 0;
+    virtual int nodes_set(osmid_t id, double lat, double lon, const taglist &tags) = 0;
+    virtual int ways_set(osmid_t id, osmid_t *nds, int nd_count, const taglist &tags) = 0;
+    virtual int relations_set(osmid_t id, struct member *members, int member_count, const taglist &tags) = 0;
 
     struct pending_processor {
         virtual ~pending_processor();
@@ -113,7 +113,7 @@ struct ramNode *node_ram_cache::next_chunk(size_t count, size_t size) {
 }
 
 
-int node_ram_cache::set_sparse(osmid_t id, double lat, double lon, struct keyval *tags) {
+int node_ram_cache::set_sparse(osmid_t id, double lat, double lon) {
     if ((sizeSparseTuples > maxSparseTuples) || ( cacheUsed > cacheSize)) {
         if ((allocStrategy & ALLOC_LOSSY) > 0)
             return 1;
@@ -136,7 +136,7 @@ int node_ram_cache::set_sparse(osmid_t id, double lat, double lon, struct keyval
     return 0;
 }
 
-int node_ram_cache::set_dense(osmid_t id, double lat, double lon, struct keyval *tags) {
+int node_ram_cache::set_dense(osmid_t id, double lat, double lon) {
     int block  = id2block(id);
     int offset = id2offset(id);
     int i = 0;
@@ -168,12 +168,11 @@ int node_ram_cache::set_dense(osmid_t id, double lat, double lon, struct keyval
                             set_sparse(block2id(queue[usedBlocks - 1]->block_offset,i),
 #ifdef FIXED_POINT
                                                        util::fix_to_double(queue[usedBlocks -1]->nodes[i].lat, scale_),
-                                                       util::fix_to_double(queue[usedBlocks -1]->nodes[i].lon, scale_),
+                                                       util::fix_to_double(queue[usedBlocks -1]->nodes[i].lon, scale_));
 #else
                                                        queue[usedBlocks -1]->nodes[i].lat,
-                                                       queue[usedBlocks -1]->nodes[i].lon,
+                                                       queue[usedBlocks -1]->nodes[i].lon);
 #endif
-                                                       NULL);
                         }
                     }
                     /* reuse previous block, as it's content is now in the dense representation */
@@ -422,17 +421,17 @@ node_ram_cache::~node_ram_cache() {
   }
 }
 
-int node_ram_cache::set(osmid_t id, double lat, double lon, struct keyval *tags) {
+int node_ram_cache::set(osmid_t id, double lat, double lon) {
     totalNodes++;
     /* if ALLOC_DENSE and ALLOC_SPARSE are set, send it through
      * ram_nodes_set_dense. If a block is non dense, it will automatically
      * get pushed to the sparse cache if a block is sparse and ALLOC_SPARSE is set
      */
     if ( (allocStrategy & ALLOC_DENSE) > 0 ) {
-        return set_dense(id, lat, lon, tags);
+        return set_dense(id, lat, lon);
     }
     if ( (allocStrategy & ALLOC_SPARSE) > 0 )
-        return set_sparse(id, lat, lon, tags);
+        return set_sparse(id, lat, lon);
     return 1;
 }
 
@@ -10,6 +10,7 @@
 #endif
 #include <stdio.h>
 #include <string.h>
+#include <algorithm>
 #include <stdexcept>
 #include <sstream>
 #include <boost/format.hpp>
@@ -64,6 +65,12 @@ namespace
         {"flat-nodes",1,0,209},
         {"exclude-invalid-polygon",0,0,210},
         {"tag-transform-script",1,0,212},
+        {"pending-order",1,0,213},
+        {"prescan-relations",0,0,214},
+        {"copy-buffer",1,0,215},
+        {"way-node-cache",1,0,216},
+        {"expire-max-bbox",1,0,217},
+        {"pending-in-db",0,0,218},
         {0, 0, 0, 0}
     };
 
@@ -167,10 +174,35 @@ namespace
                         information in slim mode instead of in PostgreSQL.\n\
                         This file is a single > 16Gb large file. Only recommended\n\
                         for full planet imports. Default is disabled.\n\
+          --pending-order  Specifies the order in which pending ways are\n\
+                        processed. Available options are:\n\
+                        id: process them in order of their ID (default)\n\
+                        spatial: group them by location, which improves\n\
+                            node cache hit rates at the cost of a few bytes\n\
+                            of memory per pending way.\n\
+          --prescan-relations  Read the relations of the input files before\n\
+                        the import, so that only ways which are members of a\n\
+                        relation have to be processed again later. This reads\n\
+                        the input twice and can not be used with --append or\n\
+                        input from stdin.\n\
+          --copy-buffer  Size in MB of the buffers in which the rows for each\n\
+                        output table are collected, while the previous buffer\n\
+                        is sent to the database in the background (default: 1).\n\
+          --way-node-cache  Only with --slim: use up to this many MB to keep\n\
+                        the node locations of the member ways of relations,\n\
+                        for ways which are members of several relations\n\
+                        (default: 0, disabled).\n\
+          --pending-in-db  Only with --slim and --append: keep the ways and\n\
+                        relations which need updating in a database table\n\
+                        instead of in memory, for very large updates.\n\
     \n\
     Expiry options:\n\
        -e|--expire-tiles [min_zoom-]max_zoom    Create a tile expiry list.\n\
        -o|--expire-output filename  Output filename for expired tiles list.\n\
+          --expire-max-bbox  Largest width or height in metres of a polygon\n\
+                        for which all tiles it covers are expired. Only the\n\
+                        tiles along the outline of bigger polygons are\n\
+                        expired (default: 20000).\n\
     \n\
     Other options:\n\
        -b|--bbox        Apply a bounding box filter on the imported data\n\
@@ -260,14 +292,14 @@ std::string build_conninfo(const std::string &db,
 options_t::options_t():
     conninfo(""), prefix("planet_osm"), scale(DEFAULT_SCALE), projection(new reprojection(PROJ_SPHERE_MERC)), append(0), slim(0),
     cache(800), tblsmain_index(boost::none), tblsslim_index(boost::none), tblsmain_data(boost::none), tblsslim_data(boost::none), style(OSM2PGSQL_DATADIR "/default.style"),
-    expire_tiles_zoom(-1), expire_tiles_zoom_min(-1), expire_tiles_filename("dirty_tiles"), hstore_mode(HSTORE_NONE), enable_hstore_index(0),
+    expire_tiles_zoom(-1), expire_tiles_zoom_min(-1), expire_tiles_filename("dirty_tiles"), expire_tiles_max_bbox(20000), hstore_mode(HSTORE_NONE), enable_hstore_index(0),
     enable_multi(false), hstore_columns(), keep_coastlines(0), parallel_indexing(1),
     #ifdef __amd64__
     alloc_chunkwise(ALLOC_SPARSE | ALLOC_DENSE),
     #else
     alloc_chunkwise(ALLOC_SPARSE),
     #endif
-    num_procs(1), droptemp(0),  unlogged(0), hstore_match_only(0), flat_node_cache_enabled(0), excludepoly(0), flat_node_file(boost::none),
+    num_procs(1), droptemp(0),  unlogged(0), hstore_match_only(0), flat_node_cache_enabled(0), excludepoly(0), spatial_pending(false), prescan_relations(false), copy_buffer(1), way_node_cache(0), pending_in_db(false), flat_node_file(boost::none),
     tag_transform_script(boost::none), tag_transform_node_func(boost::none), tag_transform_way_func(boost::none),
     tag_transform_rel_func(boost::none), tag_transform_rel_mem_func(boost::none),
     create(0), sanitize(0), long_usage_bool(0), pass_prompt(0), db("gis"), username(boost::none), host(boost::none),
@@ -378,6 +410,11 @@ options_t options_t::parse(int argc, char *argv[])
         case 'o':
             options.expire_tiles_filename = optarg;
             break;
+        case 217:
+            options.expire_tiles_max_bbox = atof(optarg);
+            if (options.expire_tiles_max_bbox < 0)
+                throw std::runtime_error("ERROR: --expire-max-bbox must not be negative.\n");
+            break;
         case 'O':
             options.output_backend = optarg;
             break;
@@ -455,6 +492,31 @@ options_t options_t::parse(int argc, char *argv[])
         case 212:
             options.tag_transform_script = optarg;
             break;
+        case 213:
+            if (strcmp(optarg, "id") == 0)
+                options.spatial_pending = false;
+            else if (strcmp(optarg, "spatial") == 0)
+                options.spatial_pending = true;
+            else {
+                throw std::runtime_error((boost::format("ERROR: Unrecognized pending order %1%.\n") % optarg).str());
+            }
+            break;
+        case 214:
+            options.prescan_relations = true;
+            break;
+        case 215:
+            options.copy_buffer = atoi(optarg);
+            if (options.copy_buffer < 1)
+                throw std::runtime_error("ERROR: --copy-buffer must be at least 1 MB.\n");
+            break;
+        case 216:
+            options.way_node_cache = atoi(optarg);
+            if (options.way_node_cache < 0)
+                throw std::runtime_error("ERROR: --way-node-cache must not be negative.\n");
+            break;
+        case 218:
+            options.pending_in_db = true;
+            break;
         case 'V':
             exit (EXIT_SUCCESS);
             break;
@@ -494,6 +556,27 @@ options_t options_t::parse(int argc, char *argv[])
         options.unlogged = 0;
     }
 
+    if (options.way_node_cache && (options.append || !options.slim)) {
+        fprintf(stderr, "Warning: --way-node-cache only makes sense with --slim and without --append; ignored.\n");
+        options.way_node_cache = 0;
+    }
+
+    if (options.pending_in_db && (!options.append || !options.slim)) {
+        fprintf(stderr, "Warning: --pending-in-db only makes sense with --slim and --append; ignored.\n");
+        options.pending_in_db = false;
+    }
+
+    if (options.prescan_relations && options.append) {
+        fprintf(stderr, "Warning: --prescan-relations only makes sense without --append; ignored.\n");
+        options.prescan_relations = false;
+    }
+
+    if (options.prescan_relations &&
+        std::find(options.input_files.begin(), options.input_files.end(), "-") != options.input_files.end()) {
+        fprintf(stderr, "Warning: --prescan-relations can not read from stdin; ignored.\n");
+        options.prescan_relations = false;
+    }
+
     if (options.hstore_mode == HSTORE_NONE && options.hstore_columns.size() == 0 && options.hstore_match_only) {
         fprintf(stderr, "Warning: --hstore-match-only only makes sense with --hstore, --hstore-all, or --hstore-column; ignored.\n");
         options.hstore_match_only = 0;
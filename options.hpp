@@ -45,6 +45,7 @@ public:
     int expire_tiles_zoom; /* Zoom level for tile expiry list */
     int expire_tiles_zoom_min; /* Minimum zoom level for tile expiry list */
     std::string expire_tiles_filename; /* File name to output expired tiles list to */
+    double expire_tiles_max_bbox; /* Largest width or height in metres of polygons whose interior is expired */
     int hstore_mode; /* add an additional hstore column with objects key/value pairs */
     int enable_hstore_index; /* add an index on the hstore column */
     bool enable_multi; /* Output multi-geometries intead of several simple geometries */
@@ -58,6 +59,11 @@ public:
     int hstore_match_only; /* only copy rows that match an explicitly listed key */
     int flat_node_cache_enabled;
     int excludepoly;
+    bool spatial_pending; /* hand out pending ways in spatial rather than ID order */
+    bool prescan_relations; /* read relations first so only their member ways go pending */
+    int copy_buffer; /* MB of COPY data collected per table before it is sent */
+    int way_node_cache; /* MB for node locations of relation member ways, 0 to disable */
+    bool pending_in_db; /* keep the ways and relations an update makes pending in the database */
     boost::optional<std::string> flat_node_file;
     boost::optional<std::string> tag_transform_script,
         tag_transform_node_func,    // these options allow you to control the name of the
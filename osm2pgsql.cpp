@@ -30,7 +30,6 @@
 #include "output.hpp"
 #include "osmdata.hpp"
 #include "util.hpp"
-#include "text-tree.hpp"
 
 #include <unistd.h>
 #include <assert.h>
@@ -99,6 +98,24 @@ int main(int argc, char *argv[])
          * tables. Not all ways can be handled before relations are processed, so they're
          * set as pending, to be handled in the next stage.
          */
+        /* Relation prescan
+         * Optionally read just the relations first, so that the outputs know
+         * which ways can be written right away in the processing phase.
+         */
+        if (options.prescan_relations) {
+            parse_delegate_t prescan_parser(options.extra_attributes, options.bbox, options.projection);
+            osmdata.start_prescan();
+            for(std::vector<std::string>::const_iterator filename = options.input_files.begin(); filename != options.input_files.end(); ++filename)
+            {
+                fprintf(stderr, "\nPrescanning relations in file: %s\n", filename->c_str());
+                time_t start = time(NULL);
+                if (prescan_parser.streamFile(options.input_reader.c_str(), filename->c_str(), options.sanitize, &osmdata) != 0)
+                    util::exit_nicely();
+                fprintf(stderr, "  prescan time: %ds\n", (int)(time(NULL) - start));
+            }
+            osmdata.stop_prescan();
+        }
+
         //read in the input files one by one
         for(std::vector<std::string>::const_iterator filename = options.input_files.begin(); filename != options.input_files.end(); ++filename)
         {
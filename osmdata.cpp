@@ -7,6 +7,7 @@
 #include <boost/thread.hpp>
 #include <boost/version.hpp>
 
+#include <algorithm>
 #include <stdexcept>
 #include <utility>
 
@@ -15,13 +16,13 @@
 #include <boost/atomic.hpp>
 #endif
 
-osmdata_t::osmdata_t(boost::shared_ptr<middle_t> mid_, const boost::shared_ptr<output_t>& out_): mid(mid_)
+osmdata_t::osmdata_t(boost::shared_ptr<middle_t> mid_, const boost::shared_ptr<output_t>& out_): mid(mid_), in_prescan(false)
 {
     outs.push_back(out_);
 }
 
 osmdata_t::osmdata_t(boost::shared_ptr<middle_t> mid_, const std::vector<boost::shared_ptr<output_t> > &outs_)
-    : mid(mid_), outs(outs_)
+    : mid(mid_), outs(outs_), in_prescan(false)
 {
     if (outs.empty()) {
         throw std::runtime_error("Must have at least one output, but none have "
@@ -33,7 +34,25 @@ osmdata_t::~osmdata_t()
 {
 }
 
-int osmdata_t::node_add(osmid_t id, double lat, double lon, struct keyval *tags) {
+void osmdata_t::start_prescan() {
+    BOOST_FOREACH(boost::shared_ptr<output_t>& out, outs) {
+        out->start_prescan();
+    }
+    in_prescan = true;
+}
+
+void osmdata_t::stop_prescan() {
+    in_prescan = false;
+}
+
+bool osmdata_t::prescanning() const {
+    return in_prescan;
+}
+
+int osmdata_t::node_add(osmid_t id, double lat, double lon, const taglist &tags) {
+    if (in_prescan)
+        return 0;
+
     mid->nodes_set(id, lat, lon, tags);
 
     int status = 0;
@@ -43,7 +62,10 @@ int osmdata_t::node_add(osmid_t id, double lat, double lon, struct keyval *tags)
     return status;
 }
 
-int osmdata_t::way_add(osmid_t id, osmid_t *nodes, int node_count, struct keyval *tags) {
+int osmdata_t::way_add(osmid_t id, osmid_t *nodes, int node_count, const taglist &tags) {
+    if (in_prescan)
+        return 0;
+
     mid->ways_set(id, nodes, node_count, tags);
 
     int status = 0;
@@ -53,7 +75,14 @@ int osmdata_t::way_add(osmid_t id, osmid_t *nodes, int node_count, struct keyval
     return status;
 }
 
-int osmdata_t::relation_add(osmid_t id, struct member *members, int member_count, struct keyval *tags) {
+int osmdata_t::relation_add(osmid_t id, struct member *members, int member_count, const taglist &tags) {
+    if (in_prescan) {
+        BOOST_FOREACH(boost::shared_ptr<output_t>& out, outs) {
+            out->relation_prescan(id, members, member_count, tags);
+        }
+        return 0;
+    }
+
     mid->relations_set(id, members, member_count, tags);
 
     int status = 0;
@@ -63,7 +92,7 @@ int osmdata_t::relation_add(osmid_t id, struct member *members, int member_count
     return status;
 }
 
-int osmdata_t::node_modify(osmid_t id, double lat, double lon, struct keyval *tags) {
+int osmdata_t::node_modify(osmid_t id, double lat, double lon, const taglist &tags) {
     slim_middle_t *slim = dynamic_cast<slim_middle_t *>(mid.get());
 
     slim->nodes_delete(id);
@@ -79,7 +108,7 @@ int osmdata_t::node_modify(osmid_t id, double lat, double lon, struct keyval *ta
     return status;
 }
 
-int osmdata_t::way_modify(osmid_t id, osmid_t *nodes, int node_count, struct keyval *tags) {
+int osmdata_t::way_modify(osmid_t id, osmid_t *nodes, int node_count, const taglist &tags) {
     slim_middle_t *slim = dynamic_cast<slim_middle_t *>(mid.get());
 
     slim->ways_delete(id);
@@ -95,7 +124,7 @@ int osmdata_t::way_modify(osmid_t id, osmid_t *nodes, int node_count, struct key
     return status;
 }
 
-int osmdata_t::relation_modify(osmid_t id, struct member *members, int member_count, struct keyval *tags) {
+int osmdata_t::relation_modify(osmid_t id, struct member *members, int member_count, const taglist &tags) {
     slim_middle_t *slim = dynamic_cast<slim_middle_t *>(mid.get());
 
     slim->relations_delete(id);
@@ -213,26 +242,13 @@ struct pending_threaded_processor : public middle_t::pending_processor {
         //note that we cant hint to the stack how large it should be ahead of time
         //we could use a different datastructure like a deque or vector but then
         //the outputs the enqueue jobs would need the version check for the push(_back) method
-        : outs(outs), ids_queued(0), append(append), queue(), ids_done(0) {
+        : mid(mid), outs(outs), thread_count(thread_count), ids_queued(0), append(append), queue(), ids_done(0) {
 #else
-        : outs(outs), ids_queued(0), append(append), queue(job_count), ids_done(0) {
+        : mid(mid), outs(outs), thread_count(thread_count), ids_queued(0), append(append), queue(job_count), ids_done(0) {
 #endif
-
-        //clone all the things we need
+        //the clones are only made once there is work for them, so that a
+        //stage with nothing pending doesn't cost any connections
         clones.reserve(thread_count);
-        for (size_t i = 0; i < thread_count; ++i) {
-            //clone the middle
-            boost::shared_ptr<const middle_query_t> mid_clone = mid->get_instance();
-
-            //clone the outs
-            output_vec_t out_clones;
-            BOOST_FOREACH(const boost::shared_ptr<output_t>& out, outs) {
-                out_clones.push_back(out->clone(mid_clone.get()));
-            }
-
-            //keep the clones for a specific thread to use
-            clones.push_back(clone_t(mid_clone, out_clones));
-        }
     }
 
     ~pending_threaded_processor() {}
@@ -250,6 +266,21 @@ struct pending_threaded_processor : public middle_t::pending_processor {
 
         fprintf(stderr, "\nGoing over pending ways...\n");
         fprintf(stderr, "\t%zu ways are pending\n", ids_queued);
+
+        //group the jobs by location so the threads share node cache blocks
+        if (outs[0]->get_options()->spatial_pending) {
+            sort_jobs_spatially();
+        }
+
+        BOOST_FOREACH(const boost::shared_ptr<output_t>& out, outs) {
+            out->pending_ways_queued();
+        }
+
+        //nothing to do so dont bother starting up any threads
+        if (ids_queued == 0)
+            return;
+
+        make_clones(ids_queued);
         fprintf(stderr, "\nUsing %zu helper-processes\n", clones.size());
         time_t start = time(NULL);
 
@@ -286,6 +317,9 @@ struct pending_threaded_processor : public middle_t::pending_processor {
                 clone_output->get()->commit();
                 //merge the pending from this threads copy of output back
                 original_output->get()->merge_pending_relations(*clone_output);
+                //and the tiles the ways expired, the relations stage is
+                //skipped when there are no pending relations
+                original_output->get()->merge_expire_trees(*clone_output);
             }
         }
     }
@@ -302,6 +336,12 @@ struct pending_threaded_processor : public middle_t::pending_processor {
 
         fprintf(stderr, "\nGoing over pending relations...\n");
         fprintf(stderr, "\t%zu relations are pending\n", ids_queued);
+
+        //on import there usually aren't any, so skip the whole stage
+        if (ids_queued == 0)
+            return;
+
+        make_clones(ids_queued);
         fprintf(stderr, "\nUsing %zu helper-processes\n", clones.size());
         time_t start = time(NULL);
 
@@ -341,9 +381,67 @@ struct pending_threaded_processor : public middle_t::pending_processor {
     }
 
 private:
+    //clone the middle and outputs for each thread that will have a job,
+    //reusing any clones an earlier stage already made
+    void make_clones(size_t job_count) {
+        const size_t wanted = std::min(thread_count, job_count);
+        while (clones.size() < wanted) {
+            //clone the middle
+            boost::shared_ptr<const middle_query_t> mid_clone = mid->get_instance();
+
+            //clone the outs
+            output_vec_t out_clones;
+            BOOST_FOREACH(const boost::shared_ptr<output_t>& out, outs) {
+                out_clones.push_back(out->clone(mid_clone.get()));
+            }
+
+            //keep the clones for a specific thread to use
+            clones.push_back(clone_t(mid_clone, out_clones));
+        }
+    }
+
+    //pulls every job off the queue and puts them back ordered by the
+    //spatial key each output recorded for the way when it went pending
+    void sort_jobs_spatially() {
+        typedef std::pair<uint32_t, pending_job_t> keyed_job_t;
+        std::vector<keyed_job_t> jobs;
+        jobs.reserve(ids_queued);
+
+        pending_job_t job;
+#if BOOST_VERSION < 105300
+        while (!queue.empty()) {
+            job = queue.top();
+            queue.pop();
+            jobs.push_back(keyed_job_t(outs.at(job.second)->pending_way_key(job.first), job));
+        }
+#else
+        while (queue.pop(job)) {
+            jobs.push_back(keyed_job_t(outs.at(job.second)->pending_way_key(job.first), job));
+        }
+#endif
+
+        //ties, including all the ways without a key, stay in id order
+        std::sort(jobs.begin(), jobs.end());
+
+#if BOOST_VERSION < 105300
+        //the stack hands them out last in first out
+        for (std::vector<keyed_job_t>::const_reverse_iterator itr = jobs.rbegin(); itr != jobs.rend(); ++itr) {
+            queue.push(itr->second);
+        }
+#else
+        for (std::vector<keyed_job_t>::const_iterator itr = jobs.begin(); itr != jobs.end(); ++itr) {
+            queue.push(itr->second);
+        }
+#endif
+    }
+
+    //the middle to clone for each thread
+    boost::shared_ptr<middle_query_t> mid;
     //middle and output copies
     std::vector<clone_t> clones;
     output_vec_t outs; //would like to move ownership of outs to osmdata_t and middle passed to output_t instead of owned by it
+    //most threads to use
+    size_t thread_count;
     //actual threads
     boost::thread_group workers;
     //how many jobs do we have in the queue to start with
@@ -391,8 +489,8 @@ void osmdata_t::stop() {
         mid->iterate_ways( ptp );
 
         //This is like pending ways, except there aren't pending relations
-        //on import, only on update.
-        //TODO: Can we skip this on import?
+        //on import, only on update. When nothing was marked the processor
+        //skips the stage without making any clones.
         mid->iterate_relations( ptp );
     }
 
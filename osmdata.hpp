@@ -17,13 +17,19 @@ public:
     void start();
     void stop();
 
-    int node_add(osmid_t id, double lat, double lon, struct keyval *tags);
-    int way_add(osmid_t id, osmid_t *nodes, int node_count, struct keyval *tags);
-    int relation_add(osmid_t id, struct member *members, int member_count, struct keyval *tags);
+    // while prescanning only the relations are looked at, so the outputs
+    // can find out which ways they will need in the relation processing
+    void start_prescan();
+    void stop_prescan();
+    bool prescanning() const;
 
-    int node_modify(osmid_t id, double lat, double lon, struct keyval *tags);
-    int way_modify(osmid_t id, osmid_t *nodes, int node_count, struct keyval *tags);
-    int relation_modify(osmid_t id, struct member *members, int member_count, struct keyval *tags);
+    int node_add(osmid_t id, double lat, double lon, const taglist &tags);
+    int way_add(osmid_t id, osmid_t *nodes, int node_count, const taglist &tags);
+    int relation_add(osmid_t id, struct member *members, int member_count, const taglist &tags);
+
+    int node_modify(osmid_t id, double lat, double lon, const taglist &tags);
+    int way_modify(osmid_t id, osmid_t *nodes, int node_count, const taglist &tags);
+    int relation_modify(osmid_t id, struct member *members, int member_count, const taglist &tags);
 
     int node_delete(osmid_t id);
     int way_delete(osmid_t id);
@@ -32,6 +38,7 @@ public:
 private:
     boost::shared_ptr<middle_t> mid;
     std::vector<boost::shared_ptr<output_t> > outs;
+    bool in_prescan;
 };
 
 #endif
@@ -31,7 +31,7 @@ struct osmNode {
 struct member {
     enum OsmType type;
     osmid_t id;
-    char *role;
+    const char *role;   // interned in interned_roles()
 };
 
 #endif
@@ -1,10 +1,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdexcept>
+#include <string>
 
 #include <libpq-fe.h>
 #include <boost/make_shared.hpp>
-#include <boost/algorithm/string/predicate.hpp>
 
 #include "osmtypes.hpp"
 #include "middle.hpp"
@@ -13,6 +14,8 @@
 #include "output-gazetteer.hpp"
 #include "options.hpp"
 #include "util.hpp"
+#include "wkb.hpp"
+#include "text-scan.hpp"
 
 #define SRID (reproj->project_getprojinfo()->srs)
 
@@ -65,10 +68,8 @@ void output_gazetteer_t::require_slim_mode(void)
    return;
 }
 
-void output_gazetteer_t::copy_data(const char *sql)
+void output_gazetteer_t::start_copy(void)
 {
-   unsigned int sqlLen = strlen(sql);
-
    /* Make sure we have an active copy */
    if (!CopyActive)
    {
@@ -76,36 +77,6 @@ void output_gazetteer_t::copy_data(const char *sql)
       CopyActive = 1;
    }
 
-   /* If the combination of old and new data is too big, flush old data */
-   if (BufferLen + sqlLen > BUFFER_SIZE - 10)
-   {
-      pgsql_CopyData("place", Connection, Buffer);
-      BufferLen = 0;
-   }
-
-   /*
-    * If new data by itself is too big, output it immediately,
-    * otherwise just add it to the buffer.
-    */
-   if (sqlLen > BUFFER_SIZE - 10)
-   {
-      pgsql_CopyData("Place", Connection, sql);
-      sqlLen = 0;
-   }
-   else if (sqlLen > 0)
-   {
-      strcpy(Buffer + BufferLen, sql);
-      BufferLen += sqlLen;
-      sqlLen = 0;
-   }
-
-   /* If we have completed a line, output it */
-   if (BufferLen > 0 && Buffer[BufferLen-1] == '\n')
-   {
-      pgsql_CopyData("place", Connection, Buffer);
-      BufferLen = 0;
-   }
-
    return;
 }
 
@@ -116,6 +87,14 @@ void output_gazetteer_t::stop_copy(void)
    /* Do we have a copy active? */
    if (!CopyActive) return;
 
+   /* Wait for the sender and send the rows which are left */
+   sender.wait();
+   if (!buffer.empty())
+   {
+      pgsql_CopyData("place", Connection, buffer.c_str());
+      buffer.clear();
+   }
+
    /* Terminate the copy */
    if (PQputCopyEnd(Connection, NULL) != 1)
    {
@@ -669,233 +648,193 @@ static int split_tags(struct keyval *tags, unsigned int flags,
    return 1;
 }
 
-void escape_array_record(char *out, int len, const char *in)
+void escape_array_record(const char *in, std::string &dst)
 {
-    int count = 0;
-    const char *old_in = in, *old_out = out;
+    size_t length = strlen(in);
+    while(*in) {
+        /* copy everything up to the next char which needs changing at once */
+        size_t plain = text_scan::plain_prefix(in, length);
+        dst.append(in, plain);
+        in += plain;
+        length -= plain;
+        if (!*in)
+            break;
 
-    if (!len)
-        return;
-
-    while(*in && count < len-3) {
         switch(*in) {
-            case '\\': *out++ = '\\'; *out++ = '\\'; *out++ = '\\'; *out++ = '\\'; *out++ = '\\'; *out++ = '\\'; *out++ = '\\'; *out++ = '\\'; count+= 8; break;
+            case '\\': dst.append(8, '\\'); break;
             case '\n':
             case '\r':
             case '\t':
             case '"':
                 /* This is a bit naughty - we know that nominatim ignored these characters so just drop them now for simplicity */
-		*out++ = ' '; count++; break;
-            default:   *out++ = *in; count++; break;
+                dst.push_back(' '); break;
+            default:   dst.push_back(*in); break;
         }
         in++;
+        length--;
     }
-    *out = '\0';
-
-    if (*in)
-        fprintf(stderr, "%s truncated at %d chars: %s\n%s\n", __FUNCTION__, count, old_in, old_out);
 }
 
+/* Number of changed objects whose classes are compared at once */
+#define UNUSED_CLASSES_BATCH 10000
+
+/* Remembers the classes an object changed by the diff still has. Looking up
+ * the classes it had before one object at a time costs a round trip each,
+ * so that is done for many objects at once in flush_unused_classes(). The
+ * lookups go to ConnectionDelete, which doesn't see the rows written since,
+ * so waiting doesn't change what they find. */
 void output_gazetteer_t::delete_unused_classes(char osm_type, osmid_t osm_id, struct keyval *places) {
-    int i,sz, slen;
+    std::vector<const char *> &classes = unused_classes[std::make_pair(osm_type, osm_id)];
+    classes.clear();
+    if (places) {
+        /* the keys are interned, so they stay valid after the list is freed */
+        for (struct keyval *place = keyval::firstItem(places); place; place = keyval::nextItem(places, place))
+            classes.push_back(place->key);
+    }
+
+    if (unused_classes.size() >= UNUSED_CLASSES_BATCH)
+        flush_unused_classes();
+}
+
+/* Deletes the places of the remembered objects whose class they no longer have */
+void output_gazetteer_t::flush_unused_classes() {
     PGresult   *res;
-    char tmp[16];
+    char tmp[32];
     char tmp2[2];
-    char *cls, *clslist = 0;
     char const *paramValues[2];
 
-    tmp2[0] = osm_type; tmp2[1] = '\0';
-    paramValues[0] = tmp2;
-    snprintf(tmp, sizeof(tmp), "%" PRIdOSMID, osm_id);
-    paramValues[1] = tmp;
-    res = pgsql_execPrepared(ConnectionDelete, "get_classes", 2, paramValues, PGRES_TUPLES_OK);
+    if (unused_classes.empty())
+        return;
 
-    sz = PQntuples(res);
-    if (sz > 0 && !places) {
-        PQclear(res);
-        /* uncondtional delete of all places */
-        stop_copy();
-        pgsql_exec(Connection, PGRES_COMMAND_OK, "DELETE FROM place WHERE osm_type = '%c' AND osm_id  = %" PRIdOSMID, osm_type, osm_id);
-    } else {
-        for (i = 0; i < sz; i++) {
-            cls = PQgetvalue(res, i, 0);
-            if (!keyval::getItem(places, cls)) {
-                if (!clslist) {
-                    clslist = (char *)malloc(strlen(cls)+3);
-                    sprintf(clslist, "'%s'", cls);
-                } else {
-                    slen = strlen(clslist);
-                    clslist = (char *)realloc(clslist, slen + 4 + strlen(cls));
-                    sprintf(&(clslist[slen]), ",'%s'", cls);
-                }
+    const char types[] = "NWR";
+    for (const char *type = types; *type; ++type) {
+        unused_classes_t::const_iterator begin = unused_classes.lower_bound(std::make_pair(*type, id_tracker::min()));
+        unused_classes_t::const_iterator end = unused_classes.lower_bound(std::make_pair(*type + 1, id_tracker::min()));
+        if (begin == end)
+            continue;
+
+        /* the ids as an array literal */
+        std::string ids("{");
+        for (unused_classes_t::const_iterator it = begin; it != end; ++it) {
+            snprintf(tmp, sizeof(tmp), "%s%" PRIdOSMID, (it == begin) ? "" : ",", it->first.second);
+            ids.append(tmp);
+        }
+        ids.push_back('}');
+
+        tmp2[0] = *type; tmp2[1] = '\0';
+        paramValues[0] = tmp2;
+        paramValues[1] = ids.c_str();
+        res = pgsql_execPrepared(ConnectionDelete, "get_classes", 2, paramValues, PGRES_TUPLES_OK);
+
+        /* the classes each object had which it doesn't have any more */
+        std::map<osmid_t, std::string> clslists;
+        for (int i = 0; i < PQntuples(res); i++) {
+            const osmid_t osm_id = strtoosmid(PQgetvalue(res, i, 0), NULL, 10);
+            const char *cls = PQgetvalue(res, i, 1);
+
+            const std::vector<const char *> &classes = unused_classes.find(std::make_pair(*type, osm_id))->second;
+            bool kept = false;
+            for (size_t c = 0; c < classes.size() && !kept; c++)
+                kept = !strcmp(classes[c], cls);
+            if (kept)
+                continue;
+
+            std::string &clslist = clslists[osm_id];
+            if (!clslist.empty())
+                clslist.push_back(',');
+            clslist.push_back('\'');
+            for (; *cls; cls++) {
+                if (*cls == '\'')
+                    clslist.push_back('\'');
+                clslist.push_back(*cls);
             }
+            clslist.push_back('\'');
         }
 
         PQclear(res);
 
-        if (clslist) {
-           /* Stop any active copy */
-           stop_copy();
+        if (!clslists.empty()) {
+            /* Stop any active copy */
+            stop_copy();
 
-           /* Delete all places for this object */
-           pgsql_exec(Connection, PGRES_COMMAND_OK, "DELETE FROM place WHERE osm_type = '%c' AND osm_id = %"
-        PRIdOSMID " and class = any(ARRAY[%s])", osm_type, osm_id, clslist);
-           free(clslist);
+            for (std::map<osmid_t, std::string>::const_iterator it = clslists.begin(); it != clslists.end(); ++it) {
+                pgsql_exec(Connection, PGRES_COMMAND_OK, "DELETE FROM place WHERE osm_type = '%c' AND osm_id = %"
+                           PRIdOSMID " and class = any(ARRAY[%s])", *type, it->first, it->second.c_str());
+            }
         }
     }
+
+    unused_classes.clear();
 }
 
-void output_gazetteer_t::add_place(char osm_type, osmid_t osm_id, const char *key_class, const char *type, struct keyval *names, struct keyval *extratags,
-   int adminlevel, struct keyval *housenumber, struct keyval *street, struct keyval *addr_place, const char *isin, struct keyval *postcode, struct keyval *countrycode, const char *wkt)
+/* Adds the escaped value and the tab after it to the row, or NULL */
+void output_gazetteer_t::copy_value(const char *value)
 {
-   int first;
-   struct keyval *name;
-   char sql[2048];
-
-   /* Output a copy line for this place */
-   sprintf(sql, "%c\t%" PRIdOSMID "\t", osm_type, osm_id);
-   copy_data(sql);
-
-   escape(sql, sizeof(sql), key_class);
-   copy_data(sql);
-   copy_data("\t");
-
-   escape(sql, sizeof(sql), type);
-   copy_data(sql);
-   copy_data("\t");
-
-   /* start name array */
-   if (keyval::listHasData(names))
-   {
-      first = 1;
-      for (name = keyval::firstItem(names); name; name = keyval::nextItem(names, name))
-      {
-         if (first) first = 0;
-         else copy_data(", ");
-
-         copy_data("\"");
-
-         escape_array_record(sql, sizeof(sql), name->key);
-         copy_data(sql);
-
-         copy_data("\"=>\"");
-
-         escape_array_record(sql, sizeof(sql), name->value);
-         copy_data(sql);
-
-         copy_data("\"");
-      }
-      copy_data("\t");
-   }
-   else
-   {
-      copy_data("\\N\t");
-   }
-
-   sprintf(sql, "%d\t", adminlevel);
-   copy_data(sql);
-
-   if (housenumber)
-   {
-      escape(sql, sizeof(sql), housenumber->value);
-      copy_data(sql);
-      copy_data("\t");
-   }
-   else
-   {
-      copy_data("\\N\t");
-   }
-
-   if (street)
-   {
-      escape(sql, sizeof(sql), street->value);
-      copy_data(sql);
-      copy_data("\t");
-   }
-   else
-   {
-      copy_data("\\N\t");
-   }
-
-   if (addr_place)
-   {
-      escape(sql, sizeof(sql), addr_place->value);
-      copy_data(sql);
-      copy_data("\t");
-   }
-   else
-   {
-      copy_data("\\N\t");
-   }
-
-   if (isin)
-   {
-       /* Skip the leading ',' from the contactination */
-      escape(sql, sizeof(sql), isin+1);
-      copy_data(sql);
-      copy_data("\t");
-   }
-   else
-   {
-      copy_data("\\N\t");
-   }
-
-   if (postcode)
-   {
-      escape(sql, sizeof(sql), postcode->value);
-      copy_data(sql);
-      copy_data("\t");
-   }
+   if (value)
+      escape(value, buffer);
    else
-   {
-      copy_data("\\N\t");
-   }
-
-   if (countrycode)
-   {
-      escape(sql, sizeof(sql), countrycode->value);
-      copy_data(sql);
-      copy_data("\t");
-   }
-   else
-   {
-     copy_data("\\N\t");
-   }
+      buffer.append("\\N");
+   buffer.push_back('\t');
+}
 
-   /* extra tags array */
-   if (keyval::listHasData(extratags))
+/* Adds the tags as a hstore and the tab after it to the row, or NULL */
+void output_gazetteer_t::copy_hstore(struct keyval *tags)
+{
+   if (keyval::listHasData(tags))
    {
-      first = 1;
-      for (name = keyval::firstItem(extratags); name; name = keyval::nextItem(extratags, name))
+      for (struct keyval *tag = keyval::firstItem(tags); tag; tag = keyval::nextItem(tags, tag))
       {
-         if (first) first = 0;
-         else copy_data(", ");
-
-         copy_data("\"");
-
-         escape_array_record(sql, sizeof(sql), name->key);
-         copy_data(sql);
-
-         copy_data("\"=>\"");
-
-         escape_array_record(sql, sizeof(sql), name->value);
-         copy_data(sql);
-
-         copy_data("\"");
+         if (tag != keyval::firstItem(tags))
+            buffer.append(", ");
+         buffer.push_back('"');
+         escape_array_record(tag->key, buffer);
+         buffer.append("\"=>\"");
+         escape_array_record(tag->value, buffer);
+         buffer.push_back('"');
       }
-      copy_data("\t");
+      buffer.push_back('\t');
    }
    else
    {
-      copy_data("\\N\t");
+      buffer.append("\\N\t");
    }
+}
 
-   sprintf(sql, "SRID=%d;", SRID);
-   copy_data(sql);
-   copy_data(wkt);
+void output_gazetteer_t::add_place(char osm_type, osmid_t osm_id, const char *key_class, const char *type, struct keyval *names, struct keyval *extratags,
+   int adminlevel, struct keyval *housenumber, struct keyval *street, struct keyval *addr_place, const char *isin, struct keyval *postcode, struct keyval *countrycode, const char *wkt)
+{
+   char tmp[64];
 
-   copy_data("\n");
+   start_copy();
 
+   /* Output a copy line for this place */
+   snprintf(tmp, sizeof(tmp), "%c\t%" PRIdOSMID "\t", osm_type, osm_id);
+   buffer.append(tmp);
+
+   copy_value(key_class);
+   copy_value(type);
+   copy_hstore(names);
+
+   snprintf(tmp, sizeof(tmp), "%d\t", adminlevel);
+   buffer.append(tmp);
+
+   copy_value(housenumber ? housenumber->value : NULL);
+   copy_value(street ? street->value : NULL);
+   copy_value(addr_place ? addr_place->value : NULL);
+   /* Skip the leading ',' from the contactination */
+   copy_value(isin ? isin + 1 : NULL);
+   copy_value(postcode ? postcode->value : NULL);
+   copy_value(countrycode ? countrycode->value : NULL);
+   copy_hstore(extratags);
+
+   snprintf(tmp, sizeof(tmp), "SRID=%d;", SRID);
+   buffer.append(tmp);
+   buffer.append(wkt);
+   buffer.push_back('\n');
+
+   /* Send the rows once there are enough, while the next ones are added */
+   if (buffer.size() > (size_t(m_options.copy_buffer) << 20))
+      sender.send(Connection, buffer);
 
    return;
 }
@@ -977,6 +916,9 @@ static void add_polygon_error(char osm_type, osmid_t osm_id,
 
 void output_gazetteer_t::delete_place(char osm_type, osmid_t osm_id)
 {
+   /* All of them go, whatever classes were remembered for it */
+   unused_classes.erase(std::make_pair(osm_type, osm_id));
+
    /* Stop any active copy */
    stop_copy();
 
@@ -1005,7 +947,7 @@ int output_gazetteer_t::connect() {
             return 1;
         }
 
-        pgsql_exec(ConnectionDelete, PGRES_COMMAND_OK, "PREPARE get_classes (CHAR(1), " POSTGRES_OSMID_TYPE ") AS SELECT class FROM place WHERE osm_type = $1 and osm_id = $2");
+        pgsql_exec(ConnectionDelete, PGRES_COMMAND_OK, "PREPARE get_classes (CHAR(1), " POSTGRES_OSMID_TYPE "[]) AS SELECT osm_id, class FROM place WHERE osm_type = $1 and osm_id = any($2)");
     }
     return 0;
 }
@@ -1065,36 +1007,103 @@ int output_gazetteer_t::start()
 
 void output_gazetteer_t::commit()
 {
+   flush_unused_classes();
+   stop_copy();
+
+   /* Commit, so the pending threads can see the table */
+   pgsql_exec(Connection, PGRES_COMMAND_OK, "COMMIT");
+   pgsql_exec(Connection, PGRES_COMMAND_OK, "BEGIN");
+}
+
+namespace {
+
+/* Hands out the ids deferred by this output up to the one passed in. The
+ * ways and relations the middle has pending are of no interest here, the
+ * gazetteer writes everything else when it is added. */
+void enqueue_deferred(id_tracker &tracker, pending_queue_t &job_queue, osmid_t id, size_t output_id, size_t& added)
+{
+    osmid_t popped = tracker.pop_mark();
+    while (id_tracker::is_valid(popped)) {
+        job_queue.push(pending_job_t(popped, output_id));
+        added++;
+        if (popped >= id)
+            break;
+        popped = tracker.pop_mark();
+    }
+}
+
 }
 
 void output_gazetteer_t::enqueue_ways(pending_queue_t &job_queue, osmid_t id, size_t output_id, size_t& added) {
+    enqueue_deferred(*ways_pending_tracker, job_queue, id, output_id, added);
 }
 
 int output_gazetteer_t::pending_way(osmid_t id, int exists) {
+    keyval tags_int;
+    osmNode *nodes_int;
+    int count_int;
+
+    keyval::initList(&tags_int);
+    if (!m_mid->ways_get(id, &tags_int, &nodes_int, &count_int)) {
+        /* the unused classes went when the way was added */
+        gazetteer_process_way(id, NULL, nodes_int, count_int, &tags_int, 0);
+        free(nodes_int);
+    }
+    keyval::resetList(&tags_int);
+
     return 0;
 }
 
 void output_gazetteer_t::enqueue_relations(pending_queue_t &job_queue, osmid_t id, size_t output_id, size_t& added) {
+    enqueue_deferred(*rels_pending_tracker, job_queue, id, output_id, added);
 }
 
 int output_gazetteer_t::pending_relation(osmid_t id, int exists) {
+    keyval tags_int;
+    member *members_int;
+    int count_int;
+
+    keyval::initList(&tags_int);
+    if (!m_mid->relations_get(id, &members_int, &count_int, &tags_int)) {
+        gazetteer_process_relation(id, members_int, count_int, &tags_int, 0, true);
+        free(members_int);
+    }
+    keyval::resetList(&tags_int);
+
     return 0;
 }
 
+size_t output_gazetteer_t::pending_count() const {
+    return ways_pending_tracker->size() + rels_pending_tracker->size();
+}
+
+/* Building the geometries of areas and relations later is only worth it
+ * when the pending threads can build them in parallel */
+bool output_gazetteer_t::defer_geometries() const
+{
+   return m_options.num_procs > 1;
+}
+
 void output_gazetteer_t::stop()
 {
+   flush_unused_classes();
+
    /* Stop any active copy */
    stop_copy();
+   sender.stop();
 
    /* Commit transaction */
    pgsql_exec(Connection, PGRES_COMMAND_OK, "COMMIT");
 
 
    PQfinish(Connection);
+   Connection = NULL;
    if (ConnectionDelete)
        PQfinish(ConnectionDelete);
+   ConnectionDelete = NULL;
    if (ConnectionError)
        PQfinish(ConnectionError);
+   ConnectionError = NULL;
 
    return;
 }
@@ -1112,7 +1121,7 @@ int output_gazetteer_t::gazetteer_process_node(osmid_t id, double lat, double lo
    char * isin;
    struct keyval * postcode;
    struct keyval * countrycode;
-   char wkt[128];
+   std::string wkt;
 
 
    /* Split the tags */
@@ -1124,10 +1133,10 @@ int output_gazetteer_t::gazetteer_process_node(osmid_t id, double lat, double lo
    /* Are we interested in this item? */
    if (keyval::listHasData(&places))
    {
-      sprintf(wkt, "POINT(%.15g %.15g)", lon, lat);
+      wkb::write_point(wkt, lon, lat);
       for (place = keyval::firstItem(&places); place; place = keyval::nextItem(&places, place))
       {
-         add_place('N', id, place->key, place->value, &names, &extratags, adminlevel, housenumber, street, addr_place, isin, postcode, countrycode, wkt);
+         add_place('N', id, place->key, place->value, &names, &extratags, adminlevel, housenumber, street, addr_place, isin, postcode, countrycode, wkt.c_str());
       }
    }
 
@@ -1146,12 +1155,14 @@ int output_gazetteer_t::gazetteer_process_node(osmid_t id, double lat, double lo
    return 0;
 }
 
-int output_gazetteer_t::node_add(osmid_t id, double lat, double lon, struct keyval *tags)
+int output_gazetteer_t::node_add(osmid_t id, double lat, double lon, const taglist &tags)
 {
-    return gazetteer_process_node(id, lat, lon, tags, 0);
+    return gazetteer_process_node(id, lat, lon, keyval_tags(tags), 0);
 }
 
-int output_gazetteer_t::gazetteer_process_way(osmid_t id, osmid_t *ndv, int ndc, struct keyval *tags, int delete_old)
+/* Either the node ids of the way are given, or its nodes when it comes
+ * back from the middle to be processed in a pending thread */
+int output_gazetteer_t::gazetteer_process_way(osmid_t id, const osmid_t *ndv, const struct osmNode *nodes, int ndc, struct keyval *tags, int delete_old)
 {
    struct keyval names;
    struct keyval places;
@@ -1173,18 +1184,30 @@ int output_gazetteer_t::gazetteer_process_way(osmid_t id, osmid_t *ndv, int ndc,
    if (delete_old)
        delete_unused_classes('W', id, &places);
 
+   /* Only closed ways can become polygons, lines are written straight away */
+   int closed = !nodes && ndc >= 4 && ndv[0] == ndv[ndc - 1];
+
    /* Are we interested in this item? */
-   if (keyval::listHasData(&places))
+   if (keyval::listHasData(&places) && area && closed && defer_geometries())
    {
-      struct osmNode *nodev;
-      int nodec;
+      /* Build the polygon in one of the pending threads */
+      ways_pending_tracker->mark(id);
+   }
+   else if (keyval::listHasData(&places))
+   {
+      struct osmNode *nodev = NULL;
+      int nodec = ndc;
 
       /* Fetch the node details */
-      nodev = (struct osmNode *)malloc(ndc * sizeof(struct osmNode));
-      nodec = m_mid->nodes_get_list(nodev, ndv, ndc);
+      if (!nodes)
+      {
+         nodev = (struct osmNode *)malloc(ndc * sizeof(struct osmNode));
+         nodec = m_mid->nodes_get_list(nodev, ndv, ndc);
+         nodes = nodev;
+      }
 
       /* Get the geometry of the object */
-      geometry_builder::maybe_wkt_t wkt = builder.get_wkt_simple(nodev, nodec, area);
+      geometry_builder::maybe_wkt_t wkt = builder.get_wkt_simple(nodes, nodec, area);
       if (wkt)
       {
          for (place = keyval::firstItem(&places); place; place = keyval::nextItem(&places, place))
@@ -1213,12 +1236,12 @@ int output_gazetteer_t::gazetteer_process_way(osmid_t id, osmid_t *ndv, int ndc,
    return 0;
 }
 
-int output_gazetteer_t::way_add(osmid_t id, osmid_t *ndv, int ndc, struct keyval *tags)
+int output_gazetteer_t::way_add(osmid_t id, osmid_t *ndv, int ndc, const taglist &tags)
 {
-    return gazetteer_process_way(id, ndv, ndc, tags, 0);
+    return gazetteer_process_way(id, ndv, NULL, ndc, keyval_tags(tags), 0);
 }
 
-int output_gazetteer_t::gazetteer_process_relation(osmid_t id, struct member *members, int member_count, struct keyval *tags, int delete_old)
+int output_gazetteer_t::gazetteer_process_relation(osmid_t id, struct member *members, int member_count, struct keyval *tags, int delete_old, bool pending)
 {
    struct keyval names;
    struct keyval places;
@@ -1264,7 +1287,12 @@ int output_gazetteer_t::gazetteer_process_relation(osmid_t id, struct member *me
    if (delete_old)
        delete_unused_classes('R', id, &places);
 
-   if (keyval::listHasData(&places))
+   if (keyval::listHasData(&places) && !pending && defer_geometries())
+   {
+      /* Build the geometry in one of the pending threads */
+      rels_pending_tracker->mark(id);
+   }
+   else if (keyval::listHasData(&places))
    {
       /* get the boundary path (ways) */
       int i, count;
@@ -1304,7 +1332,7 @@ int output_gazetteer_t::gazetteer_process_relation(osmid_t id, struct member *me
          geometry_builder::maybe_wkts_t wkts = builder.build_both(xnodes, xcount, 1, 1, 1000000, id);
          for (geometry_builder::wkt_itr wkt = wkts->begin(); wkt != wkts->end(); ++wkt)
          {
-            if ((boost::starts_with(wkt->geom,  "POLYGON") || boost::starts_with(wkt->geom,  "MULTIPOLYGON")))
+            if (wkb::is_polygon(wkt->geom))
             {
                 for (place = keyval::firstItem(&places); place; place = keyval::nextItem(&places, place))
                 {
@@ -1358,9 +1386,9 @@ int output_gazetteer_t::gazetteer_process_relation(osmid_t id, struct member *me
    return 0;
 }
 
-int output_gazetteer_t::relation_add(osmid_t id, struct member *members, int member_count, struct keyval *tags)
+int output_gazetteer_t::relation_add(osmid_t id, struct member *members, int member_count, const taglist &tags)
 {
-    return gazetteer_process_relation(id, members, member_count, tags, 0);
+    return gazetteer_process_relation(id, members, member_count, keyval_tags(tags), 0, false);
 }
 
 int output_gazetteer_t::node_delete(osmid_t id)
@@ -1396,22 +1424,22 @@ int output_gazetteer_t::relation_delete(osmid_t id)
    return 0;
 }
 
-int output_gazetteer_t::node_modify(osmid_t id, double lat, double lon, struct keyval *tags)
+int output_gazetteer_t::node_modify(osmid_t id, double lat, double lon, const taglist &tags)
 {
    require_slim_mode();
-   return gazetteer_process_node(id, lat, lon, tags, 1);
+   return gazetteer_process_node(id, lat, lon, keyval_tags(tags), 1);
 }
 
-int output_gazetteer_t::way_modify(osmid_t id, osmid_t *ndv, int ndc, struct keyval *tags)
+int output_gazetteer_t::way_modify(osmid_t id, osmid_t *ndv, int ndc, const taglist &tags)
 {
    require_slim_mode();
-   return gazetteer_process_way(id, ndv, ndc, tags, 1);
+   return gazetteer_process_way(id, ndv, NULL, ndc, keyval_tags(tags), 1);
 }
 
-int output_gazetteer_t::relation_modify(osmid_t id, struct member *members, int member_count, struct keyval *tags)
+int output_gazetteer_t::relation_modify(osmid_t id, struct member *members, int member_count, const taglist &tags)
 {
    require_slim_mode();
-   return gazetteer_process_relation(id, members, member_count, tags, 1);
+   return gazetteer_process_relation(id, members, member_count, keyval_tags(tags), 1, false);
 }
 
 
@@ -1427,9 +1455,11 @@ output_gazetteer_t::output_gazetteer_t(const middle_query_t* mid_, const options
       ConnectionDelete(NULL),
       ConnectionError(NULL),
       CopyActive(0),
-      BufferLen(0)
+      buffer(),
+      sender("place"),
+      ways_pending_tracker(new id_tracker()),
+      rels_pending_tracker(new id_tracker())
 {
-    memset(Buffer, 0, BUFFER_SIZE);
 }
 
 output_gazetteer_t::output_gazetteer_t(const output_gazetteer_t& other)
@@ -1438,13 +1468,35 @@ output_gazetteer_t::output_gazetteer_t(const output_gazetteer_t& other)
       ConnectionDelete(NULL),
       ConnectionError(NULL),
       CopyActive(0),
-      BufferLen(0),
-      reproj(other.reproj)
+      buffer(),
+      sender("place"),
+      reproj(other.reproj),
+      ways_pending_tracker(new id_tracker()),
+      rels_pending_tracker(new id_tracker())
 {
     builder.set_exclude_broken_polygon(m_options.excludepoly);
-    memset(Buffer, 0, BUFFER_SIZE);
-    connect();
+    if (connect())
+    {
+        /* the destructor doesn't run for a clone which failed to start */
+        std::string err = std::string("Connection to database failed: ") +
+            PQerrorMessage(ConnectionDelete ? ConnectionDelete : Connection);
+        if (ConnectionDelete)
+            PQfinish(ConnectionDelete);
+        PQfinish(Connection);
+        throw std::runtime_error(err);
+    }
+
+    /* Clones write in their own transaction, committed by commit() */
+    pgsql_exec(Connection, PGRES_COMMAND_OK, "BEGIN");
 }
 
 output_gazetteer_t::~output_gazetteer_t() {
+    /* Clones are never stopped, their connections are closed here */
+    sender.stop();
+    if (Connection)
+        PQfinish(Connection);
+    if (ConnectionDelete)
+        PQfinish(ConnectionDelete);
+    if (ConnectionError)
+        PQfinish(ConnectionError);
 }
@@ -2,8 +2,15 @@
 #define OUTPUT_GAZETTEER_H
 
 #include "output.hpp"
+#include "copy-sender.hpp"
 #include "geometry-builder.hpp"
 #include "reprojection.hpp"
+#include "id-tracker.hpp"
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include <boost/shared_ptr.hpp>
 
@@ -25,25 +32,28 @@ public:
     void enqueue_relations(pending_queue_t &job_queue, osmid_t id, size_t output_id, size_t& added);
     int pending_relation(osmid_t id, int exists);
 
-    int node_add(osmid_t id, double lat, double lon, struct keyval *tags);
-    int way_add(osmid_t id, osmid_t *nodes, int node_count, struct keyval *tags);
-    int relation_add(osmid_t id, struct member *members, int member_count, struct keyval *tags);
+    int node_add(osmid_t id, double lat, double lon, const taglist &tags);
+    int way_add(osmid_t id, osmid_t *nodes, int node_count, const taglist &tags);
+    int relation_add(osmid_t id, struct member *members, int member_count, const taglist &tags);
 
-    int node_modify(osmid_t id, double lat, double lon, struct keyval *tags);
-    int way_modify(osmid_t id, osmid_t *nodes, int node_count, struct keyval *tags);
-    int relation_modify(osmid_t id, struct member *members, int member_count, struct keyval *tags);
+    int node_modify(osmid_t id, double lat, double lon, const taglist &tags);
+    int way_modify(osmid_t id, osmid_t *nodes, int node_count, const taglist &tags);
+    int relation_modify(osmid_t id, struct member *members, int member_count, const taglist &tags);
 
     int node_delete(osmid_t id);
     int way_delete(osmid_t id);
     int relation_delete(osmid_t id);
 
-private:
-    static const size_t BUFFER_SIZE = 4096;
+    size_t pending_count() const;
 
+private:
     void require_slim_mode(void);
-    void copy_data(const char *sql);
+    void start_copy(void);
     void stop_copy(void);
+    void copy_value(const char *value);
+    void copy_hstore(struct keyval *tags);
     void delete_unused_classes(char osm_type, osmid_t osm_id, struct keyval *places);
+    void flush_unused_classes();
     void add_place(char osm_type, osmid_t osm_id, const char *key_class, const char *type,
                    struct keyval *names, struct keyval *extratags, int adminlevel,
                    struct keyval *housenumber, struct keyval *street, struct keyval *addr_place,
@@ -52,10 +62,11 @@ private:
     void delete_place(char osm_type, osmid_t osm_id);
     int gazetteer_process_node(osmid_t id, double lat, double lon, struct keyval *tags,
                                int delete_old);
-    int gazetteer_process_way(osmid_t id, osmid_t *ndv, int ndc, struct keyval *tags,
-                              int delete_old);
+    int gazetteer_process_way(osmid_t id, const osmid_t *ndv, const struct osmNode *nodes,
+                              int ndc, struct keyval *tags, int delete_old);
     int gazetteer_process_relation(osmid_t id, struct member *members, int member_count,
-                                   struct keyval *tags, int delete_old);
+                                   struct keyval *tags, int delete_old, bool pending);
+    bool defer_geometries() const;
     int connect();
 
     struct pg_conn *Connection;
@@ -63,14 +74,25 @@ private:
     struct pg_conn *ConnectionError;
 
     int CopyActive;
-    unsigned int BufferLen;
 
-    char Buffer[BUFFER_SIZE];
+    /* The rows for the place table, which are escaped straight into the
+     * buffer and handed over to the sender once there are enough of them */
+    std::string buffer;
+    copy_sender sender;
 
     geometry_builder builder;
 
     boost::shared_ptr<reprojection> reproj;
 
+    /* The areas and relations whose geometries are built in the pending
+     * threads, when there is more than one */
+    boost::shared_ptr<id_tracker> ways_pending_tracker, rels_pending_tracker;
+
+    /* The classes each object changed by the diff still has, which are
+     * compared with the place table in batches, see flush_unused_classes() */
+    typedef std::map<std::pair<char, osmid_t>, std::vector<const char *> > unused_classes_t;
+    unused_classes_t unused_classes;
+
     const static std::string NAME;
 };
 
@@ -1,12 +1,147 @@
 #include "output-multi.hpp"
 #include "taginfo_impl.hpp"
+#include "wkb.hpp"
 
 #include <boost/format.hpp>
 #include <boost/foreach.hpp>
 #include <boost/make_shared.hpp>
-#include <boost/algorithm/string/predicate.hpp>
 #include <vector>
 
+output_multi_dispatch::output_multi_dispatch()
+    : m_export_lists(), m_lua(), m_tags(), m_built(false), m_matched(false), m_resolved(false),
+      m_way_helper(), m_has_nodes(false) {
+}
+
+output_multi_dispatch::~output_multi_dispatch() {
+    for (size_t i = 0; i < m_tags.size(); ++i) {
+        keyval::resetList(&m_tags[i]);
+    }
+}
+
+size_t output_multi_dispatch::add(const export_list *exlist, bool lua) {
+    m_export_lists.push_back(exlist);
+    m_lua.push_back(lua);
+    m_tags.resize(m_export_lists.size());
+    // the lists are still empty, but the vector may have moved them
+    for (size_t i = 0; i < m_tags.size(); ++i) {
+        keyval::initList(&m_tags[i]);
+    }
+    m_built = false;
+    return m_export_lists.size() - 1;
+}
+
+void output_multi_dispatch::build() {
+    const OsmType types[2] = { OSMTYPE_WAY, OSMTYPE_NODE };
+    for (int t = 0; t < 2; ++t) {
+        names_t &names = m_names[types[t]];
+        names = names_t();
+
+        // all the names without wildcards, each once
+        std::vector<std::string> exact;
+        for (size_t i = 0; i < m_export_lists.size(); ++i) {
+            if (m_lua[i]) continue;
+            const std::vector<taginfo> &infos = m_export_lists[i]->get(types[t]);
+            bool wildcards = false;
+            for (std::vector<taginfo>::const_iterator info = infos.begin(); info != infos.end(); ++info) {
+                if (info->name.find_first_of("*?") != std::string::npos) {
+                    wildcards = true;
+                } else if (names.exact.find(info->name.c_str()) < 0) {
+                    names.exact.add(info->name);
+                    exact.push_back(info->name);
+                }
+            }
+            if (wildcards) {
+                names.wildcard_tables.push_back(i);
+            }
+        }
+
+        // which tables keep a key matching each name, which might be one of
+        // their wildcards, so that they are decided by a single lookup
+        names.tables.resize(exact.size());
+        for (size_t n = 0; n < exact.size(); ++n) {
+            for (size_t i = 0; i < m_export_lists.size(); ++i) {
+                if (m_lua[i]) continue;
+                const taginfo *info = m_export_lists[i]->find(types[t], exact[n].c_str());
+                if (info && !(info->flags & FLAG_DELETE)) {
+                    names.tables[n].push_back(i);
+                }
+            }
+        }
+    }
+    m_built = true;
+}
+
+void output_multi_dispatch::next_object() {
+    m_matched = false;
+    m_resolved = false;
+}
+
+/* The index of the name without wildcards which is the key, or -1 if it
+ * is none of them. Keys are looked up by name once, and then by id. */
+int output_multi_dispatch::name_index(names_t &names, taglist::key_id id) {
+    const int unknown = -2;
+    if (id >= names.key_names.size()) {
+        names.key_names.resize(id + 1, unknown);
+    }
+    if (names.key_names[id] == unknown) {
+        names.key_names[id] = names.exact.find(taglist::key_name(id));
+    }
+    return names.key_names[id];
+}
+
+/* Give each table the tags it would keep after filtering its own copy of
+ * them with a strict C tag transform, in the order keyval_tags gives them. */
+void output_multi_dispatch::match(OsmType type, const taglist &all_tags) {
+    if (!m_built) {
+        build();
+    }
+    const OsmType export_type = (type == OSMTYPE_RELATION) ? OSMTYPE_WAY : type;
+    names_t &names = m_names[export_type];
+
+    for (size_t i = 0; i < m_tags.size(); ++i) {
+        keyval::resetList(&m_tags[i]);
+    }
+
+    for (size_t t = 0; t < all_tags.size(); ++t) {
+        const char *key = all_tags.key(t), *value = all_tags.value(t);
+        const int index = name_index(names, all_tags.id(t));
+        if (index >= 0) {
+            const std::vector<size_t> &tables = names.tables[index];
+            for (std::vector<size_t>::const_iterator i = tables.begin(); i != tables.end(); ++i) {
+                keyval::addItem(&m_tags[*i], key, value, 0);
+            }
+        } else {
+            for (std::vector<size_t>::const_iterator i = names.wildcard_tables.begin(); i != names.wildcard_tables.end(); ++i) {
+                const taginfo *info = m_export_lists[*i]->find(export_type, key);
+                if (info && !(info->flags & FLAG_DELETE)) {
+                    keyval::addItem(&m_tags[*i], key, value, 0);
+                }
+            }
+        }
+        for (size_t i = 0; i < m_tags.size(); ++i) {
+            if (m_lua[i]) {
+                keyval::addItem(&m_tags[i], key, value, 0);
+            }
+        }
+    }
+}
+
+keyval *output_multi_dispatch::tags(size_t table, OsmType type, const taglist &all_tags) {
+    if (!m_matched) {
+        match(type, all_tags);
+        m_matched = true;
+    }
+    return &m_tags[table];
+}
+
+way_helper *output_multi_dispatch::way_nodes(const osmid_t *node_ids, int node_count, const middle_query_t *mid) {
+    if (!m_resolved) {
+        m_has_nodes = m_way_helper.set(node_ids, node_count, mid) > 0;
+        m_resolved = true;
+    }
+    return m_has_nodes ? &m_way_helper : NULL;
+}
+
 output_multi_t::output_multi_t(const std::string &name,
                                boost::shared_ptr<geometry_processor> processor_,
                                const struct export_list &export_list_,
@@ -22,16 +157,18 @@ output_multi_t::output_multi_t(const std::string &name,
                           m_options.hstore_columns, m_processor->srid(), m_options.scale,
                           m_options.append, m_options.slim, m_options.droptemp,
                           m_options.hstore_mode, m_options.enable_hstore_index,
-                          m_options.tblsmain_data, m_options.tblsmain_index)),
+                          m_options.tblsmain_data, m_options.tblsmain_index,
+                          size_t(m_options.copy_buffer) << 20)),
       ways_pending_tracker(new id_tracker()), ways_done_tracker(new id_tracker()), rels_pending_tracker(new id_tracker()),
-      m_expire(new expire_tiles(&m_options)) {
+      m_expire(new expire_tiles(&m_options)), m_dispatch_index(0) {
 }
 
 output_multi_t::output_multi_t(const output_multi_t& other):
     output_t(other.m_mid, other.m_options), m_tagtransform(new tagtransform(&m_options)), m_export_list(new export_list(*other.m_export_list)),
     m_processor(other.m_processor), m_osm_type(other.m_osm_type), m_table(new table_t(*other.m_table)),
     ways_pending_tracker(new id_tracker()), ways_done_tracker(new id_tracker()), rels_pending_tracker(new id_tracker()),
-    m_expire(new expire_tiles(&m_options)) {
+    m_expire(new expire_tiles(&m_options)), m_dispatch_index(0) {
+    //clones process pending objects on their own thread, so they don't share
 }
 
 
@@ -161,64 +298,70 @@ void output_multi_t::commit() {
     m_table->commit();
 }
 
-int output_multi_t::node_add(osmid_t id, double lat, double lon, struct keyval *tags) {
+int output_multi_t::node_add(osmid_t id, double lat, double lon, const taglist &tags) {
+    next_object();
     if (m_processor->interests(geometry_processor::interest_node)) {
-        return process_node(id, lat, lon, tags);
+        return process_node(id, lat, lon, object_tags(OSMTYPE_NODE, tags));
     }
     return 0;
 }
 
-int output_multi_t::way_add(osmid_t id, osmid_t *nodes, int node_count, struct keyval *tags) {
+int output_multi_t::way_add(osmid_t id, osmid_t *nodes, int node_count, const taglist &tags) {
+    next_object();
     if (m_processor->interests(geometry_processor::interest_way) && node_count > 1) {
-        return process_way(id, nodes, node_count, tags);
+        return process_way(id, nodes, node_count, object_tags(OSMTYPE_WAY, tags));
     }
     return 0;
 }
 
 
-int output_multi_t::relation_add(osmid_t id, struct member *members, int member_count, struct keyval *tags) {
+int output_multi_t::relation_add(osmid_t id, struct member *members, int member_count, const taglist &tags) {
+    next_object();
     if (m_processor->interests(geometry_processor::interest_relation) && member_count > 0) {
-        return process_relation(id, members, member_count, tags, 0);
+        return process_relation(id, members, member_count, object_tags(OSMTYPE_RELATION, tags), 0);
     }
     return 0;
 }
 
-int output_multi_t::node_modify(osmid_t id, double lat, double lon, struct keyval *tags) {
+int output_multi_t::node_modify(osmid_t id, double lat, double lon, const taglist &tags) {
+    next_object();
     if (m_processor->interests(geometry_processor::interest_node)) {
         // TODO - need to know it's a node?
         delete_from_output(id);
 
         // TODO: need to mark any ways or relations using it - depends on what
         // type of output this is... delegate to the geometry processor??
-        return process_node(id, lat, lon, tags);
+        return process_node(id, lat, lon, object_tags(OSMTYPE_NODE, tags));
 
     } else {
         return 0;
     }
 }
 
-int output_multi_t::way_modify(osmid_t id, osmid_t *nodes, int node_count, struct keyval *tags) {
+int output_multi_t::way_modify(osmid_t id, osmid_t *nodes, int node_count, const taglist &tags) {
+    next_object();
     if (m_processor->interests(geometry_processor::interest_way)) {
         // TODO - need to know it's a way?
         delete_from_output(id);
 
         // TODO: need to mark any relations using it - depends on what
         // type of output this is... delegate to the geometry processor??
-        return process_way(id, nodes, node_count, tags);
+        return process_way(id, nodes, node_count, object_tags(OSMTYPE_WAY, tags));
 
     } else {
         return 0;
     }
 }
 
-int output_multi_t::relation_modify(osmid_t id, struct member *members, int member_count, struct keyval *tags) {
+int output_multi_t::relation_modify(osmid_t id, struct member *members, int member_count, const taglist &tags) {
+    next_object();
     if (m_processor->interests(geometry_processor::interest_relation)) {
         // TODO - need to know it's a relation?
         delete_from_output(-id);
 
         // TODO: need to mark any other relations using it - depends on what
         // type of output this is... delegate to the geometry processor??
-        return process_relation(id, members, member_count, tags, false);
+        return process_relation(id, members, member_count, object_tags(OSMTYPE_RELATION, tags), false);
 
     } else {
         return 0;
@@ -285,7 +428,7 @@ int output_multi_t::reprocess_way(osmid_t id, const osmNode* nodes, int node_cou
             //TODO: need to know if we care about polygons or lines for this output
             //the difference only being that if its a really large bbox for the poly
             //it downgrades to just invalidating the line/perimeter anyway
-            if(boost::starts_with(wkt->geom, "POLYGON") || boost::starts_with(wkt->geom, "MULTIPOLYGON"))
+            if(wkb::is_polygon(wkt->geom))
                 m_expire->from_nodes_poly(nodes, node_count, id);
             else
                 m_expire->from_nodes_line(nodes, node_count);
@@ -301,25 +444,29 @@ int output_multi_t::process_way(osmid_t id, const osmid_t* node_ids, int node_co
     unsigned int filter = m_tagtransform->filter_way_tags(tags, &polygon, &roads, m_export_list.get(), true);
     if (!filter) {
         //get the geom from the middle
-        if(m_way_helper.set(node_ids, node_count, m_mid) < 1)
+        const way_helper *helper = way_nodes(node_ids, node_count);
+        if (!helper)
             return 0;
+        const std::vector<osmNode> &nodes = helper->node_cache;
         //grab its geom
-        geometry_builder::maybe_wkt_t wkt = m_processor->process_way(&m_way_helper.node_cache.front(), m_way_helper.node_cache.size());
+        geometry_builder::maybe_wkt_t wkt = m_processor->process_way(&nodes.front(), nodes.size());
 
         if (wkt) {
             //if we are also interested in relations we need to mark
             //this way pending just in case it shows up in one
-            if (m_processor->interests(geometry_processor::interest_relation)) {
+            if (m_processor->interests(geometry_processor::interest_relation) && way_in_relation(id)) {
                 ways_pending_tracker->mark(id);
-            }//we aren't interested in relations so if it comes in on a relation later we wont keep it
+                set_pending_way_location(id, nodes.front());
+            }//we aren't interested in relations (or the prescan found none using this way)
+            //so if it comes in on a relation later we wont keep it
             else {
                 //TODO: need to know if we care about polygons or lines for this output
                 //the difference only being that if its a really large bbox for the poly
                 //it downgrades to just invalidating the line/perimeter anyway
-                if(boost::starts_with(wkt->geom, "POLYGON") || boost::starts_with(wkt->geom, "MULTIPOLYGON"))
-                    m_expire->from_nodes_poly(&m_way_helper.node_cache.front(), m_way_helper.node_cache.size(), id);
+                if(wkb::is_polygon(wkt->geom))
+                    m_expire->from_nodes_poly(&nodes.front(), nodes.size(), id);
                 else
-                    m_expire->from_nodes_line(&m_way_helper.node_cache.front(), m_way_helper.node_cache.size());
+                    m_expire->from_nodes_line(&nodes.front(), nodes.size());
                 copy_to_table(id, wkt->geom.c_str(), tags);
             }
         }
@@ -344,14 +491,10 @@ int output_multi_t::process_relation(osmid_t id, const member *members, int memb
         //and since the middle is no longer tied to the output it no longer
         //shares any kind of tag transform and therefore has all original tags
         //so we filter here because each individual outputs cares about different tags
-        int polygon, roads;
-        for(size_t i = 0; i < m_relation_helper.way_count; ++i)
-        {
-            m_tagtransform->filter_way_tags(&m_relation_helper.tags[i], &polygon, &roads, m_export_list.get());
-            //TODO: if the filter says that this member is now not interesting we
-            //should decrement the count and remove his nodes and tags etc. for
-            //now we'll just keep him with no tags so he will get filtered later
-        }
+        //TODO: if the filter says that a member is now not interesting we
+        //should decrement the count and remove his nodes and tags etc. for
+        //now we'll just keep him with no tags so he will get filtered later
+        m_tagtransform->filter_way_tags_list(&m_relation_helper.tags.front(), m_relation_helper.way_count, m_export_list.get());
 
         //do the members of this relation have anything interesting to us
         //NOTE: make_polygon is preset here this is to force the tag matching/superseeded stuff
@@ -360,7 +503,7 @@ int output_multi_t::process_relation(osmid_t id, const member *members, int memb
         //if the export list did not include the type tag.
         //TODO: find a less hacky way to do the matching/superseeded and tag copying stuff without
         //all this trickery
-        int make_boundary, make_polygon = 1;
+        int make_boundary, make_polygon = 1, roads;
         filter = m_tagtransform->filter_rel_member_tags(tags, m_relation_helper.way_count, &m_relation_helper.tags.front(),
                                                    &m_relation_helper.roles.front(), &m_relation_helper.superseeded.front(),
                                                    &make_boundary, &make_polygon, &roads, m_export_list.get(), true);
@@ -401,16 +544,37 @@ void output_multi_t::copy_to_table(osmid_t id, const char *wkt, struct keyval *t
     m_table->write_wkt(id, tags, wkt);
 }
 
+void output_multi_t::set_dispatch(boost::shared_ptr<output_multi_dispatch> dispatch) {
+    m_dispatch = dispatch;
+    m_dispatch_index = m_dispatch->add(m_export_list.get(), bool(m_options.tag_transform_script));
+}
+
+//the first table tells the dispatch that the outputs are getting a new object
+void output_multi_t::next_object() {
+    if (m_dispatch && m_dispatch_index == 0)
+        m_dispatch->next_object();
+}
+
+//the tags of a new object for this table to filter, which it may change
+keyval *output_multi_t::object_tags(OsmType type, const taglist &tags) {
+    return m_dispatch ? m_dispatch->tags(m_dispatch_index, type, tags) : keyval_tags(tags);
+}
+
+way_helper *output_multi_t::way_nodes(const osmid_t *node_ids, int node_count) {
+    if (m_dispatch)
+        return m_dispatch->way_nodes(node_ids, node_count, m_mid);
+    return (m_way_helper.set(node_ids, node_count, m_mid) < 1) ? NULL : &m_way_helper;
+}
+
 void output_multi_t::delete_from_output(osmid_t id) {
-    if(m_expire->from_db(m_table.get(), id))
-        m_table->delete_row(id);
+    m_expire->delete_from_db(m_table.get(), id);
 }
 
 void output_multi_t::merge_pending_relations(boost::shared_ptr<output_t> other) {
     boost::shared_ptr<id_tracker> tracker = other.get()->get_pending_relations();
-    osmid_t id;
-    while(tracker.get() && id_tracker::is_valid((id = tracker->pop_mark()))){
-        rels_pending_tracker->mark(id);
+    if (tracker.get()) {
+        rels_pending_tracker->merge(*tracker);
+        tracker->clear();
     }
 }
 
@@ -13,11 +13,62 @@
 #include "geometry-processor.hpp"
 #include "id-tracker.hpp"
 #include "expire-tiles.hpp"
+#include "taginfo_impl.hpp"
 
 #include <vector>
+#include <boost/noncopyable.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/variant.hpp>
 
+/* Shares the work of the tables of a multi backend config between them.
+ * The tags of each object are matched against the export lists of all the
+ * tables in one pass, which gives each table its own list of the tags it
+ * keeps, and the node locations of a way are looked up once for all of
+ * them. Only the objects osmdata_t passes to all outputs in turn go through
+ * here; pending ways and relations are processed by each clone on its own.
+ */
+class output_multi_dispatch : public boost::noncopyable {
+public:
+    output_multi_dispatch();
+    ~output_multi_dispatch();
+
+    // registers a table, returning its index. Tables using a Lua tag
+    // transform can't be matched against their export list, and get a
+    // copy of all the tags instead.
+    size_t add(const export_list *exlist, bool lua);
+
+    // called by the first table before an object is passed to the tables
+    void next_object();
+
+    // the tags of the current object which the table keeps
+    keyval *tags(size_t table, OsmType type, const taglist &all_tags);
+
+    // the node locations of the current way, or NULL if it has none
+    way_helper *way_nodes(const osmid_t *node_ids, int node_count, const middle_query_t *mid);
+
+private:
+    void build();
+    void match(OsmType type, const taglist &all_tags);
+
+    // the names of one object type which any of the tables have
+    struct names_t {
+        tag_matcher exact;                          // names without wildcards
+        std::vector<std::vector<size_t> > tables;   // tables keeping each name
+        std::vector<size_t> wildcard_tables;        // checked for any other key
+        std::vector<int> key_names;                 // name of each key id seen
+    };
+
+    static int name_index(names_t &names, taglist::key_id id);
+
+    std::vector<const export_list *> m_export_lists;
+    std::vector<bool> m_lua;
+    std::vector<keyval> m_tags;
+    names_t m_names[2];                             // indexed by OSMTYPE_WAY/NODE
+    bool m_built, m_matched, m_resolved;
+    way_helper m_way_helper;
+    bool m_has_nodes;
+};
+
 class output_multi_t : public output_t {
 public:
     output_multi_t(const std::string &name,
@@ -39,13 +90,13 @@ public:
     void enqueue_relations(pending_queue_t &job_queue, osmid_t id, size_t output_id, size_t& added);
     int pending_relation(osmid_t id, int exists);
 
-    int node_add(osmid_t id, double lat, double lon, struct keyval *tags);
-    int way_add(osmid_t id, osmid_t *nodes, int node_count, struct keyval *tags);
-    int relation_add(osmid_t id, struct member *members, int member_count, struct keyval *tags);
+    int node_add(osmid_t id, double lat, double lon, const taglist &tags);
+    int way_add(osmid_t id, osmid_t *nodes, int node_count, const taglist &tags);
+    int relation_add(osmid_t id, struct member *members, int member_count, const taglist &tags);
 
-    int node_modify(osmid_t id, double lat, double lon, struct keyval *tags);
-    int way_modify(osmid_t id, osmid_t *nodes, int node_count, struct keyval *tags);
-    int relation_modify(osmid_t id, struct member *members, int member_count, struct keyval *tags);
+    int node_modify(osmid_t id, double lat, double lon, const taglist &tags);
+    int way_modify(osmid_t id, osmid_t *nodes, int node_count, const taglist &tags);
+    int relation_modify(osmid_t id, struct member *members, int member_count, const taglist &tags);
 
     int node_delete(osmid_t id);
     int way_delete(osmid_t id);
@@ -58,6 +109,9 @@ public:
     virtual boost::shared_ptr<id_tracker> get_pending_relations();
     virtual boost::shared_ptr<expire_tiles> get_expire_tree();
 
+    // share the tag matching and node lookups with the other tables
+    void set_dispatch(boost::shared_ptr<output_multi_dispatch> dispatch);
+
 protected:
 
     void delete_from_output(osmid_t id);
@@ -66,6 +120,9 @@ protected:
     int reprocess_way(osmid_t id, const osmNode* nodes, int node_count, struct keyval *tags, bool exists);
     int process_relation(osmid_t id, const member *members, int member_count, struct keyval *tags, bool exists, bool pending=false);
     void copy_to_table(osmid_t id, const char *wkt, struct keyval *tags);
+    void next_object();
+    keyval *object_tags(OsmType type, const taglist &tags);
+    way_helper *way_nodes(const osmid_t *node_ids, int node_count);
 
     boost::scoped_ptr<tagtransform> m_tagtransform;
     boost::scoped_ptr<export_list> m_export_list;
@@ -76,6 +133,8 @@ protected:
     boost::shared_ptr<expire_tiles> m_expire;
     way_helper m_way_helper;
     relation_helper m_relation_helper;
+    boost::shared_ptr<output_multi_dispatch> m_dispatch;
+    size_t m_dispatch_index;
 
     const static std::string NAME;
 };
@@ -38,15 +38,15 @@ int output_null_t::pending_relation(osmid_t id, int exists) {
     return 0;
 }
 
-int output_null_t::node_add(osmid_t a, double b, double c, struct keyval *k) {
+int output_null_t::node_add(osmid_t a, double b, double c, const taglist &) {
   return 0;
 }
 
-int output_null_t::way_add(osmid_t a, osmid_t *b, int c, struct keyval *k) {
+int output_null_t::way_add(osmid_t a, osmid_t *b, int c, const taglist &) {
   return 0;
 }
 
-int output_null_t::relation_add(osmid_t a, struct member *b, int c, struct keyval *k) {
+int output_null_t::relation_add(osmid_t a, struct member *b, int c, const taglist &) {
   return 0;
 }
 
@@ -62,15 +62,15 @@ int output_null_t::relation_delete(osmid_t i) {
   return 0;
 }
 
-int output_null_t::node_modify(osmid_t a, double b, double c, struct keyval * k) {
+int output_null_t::node_modify(osmid_t a, double b, double c, const taglist &) {
   return 0;
 }
 
-int output_null_t::way_modify(osmid_t a, osmid_t *b, int c, struct keyval *k) {
+int output_null_t::way_modify(osmid_t a, osmid_t *b, int c, const taglist &) {
   return 0;
 }
 
-int output_null_t::relation_modify(osmid_t a, struct member *b, int c, struct keyval *k) {
+int output_null_t::relation_modify(osmid_t a, struct member *b, int c, const taglist &) {
   return 0;
 }
 
@@ -33,12 +33,12 @@
 #include "taginfo_impl.hpp"
 #include "tagtransform.hpp"
 #include "util.hpp"
+#include "wkb.hpp"
 
 #include <boost/bind.hpp>
 #include <boost/format.hpp>
 #include <boost/foreach.hpp>
 #include <boost/make_shared.hpp>
-#include <boost/algorithm/string/predicate.hpp>
 #include <iostream>
 #include <limits>
 #include <stdexcept>
@@ -65,15 +65,15 @@ psql - 01 01000020 E6100000 30CCA462B6C3D4BF92998C9B38E04940
 Workaround - output SRID=4326;<WKB>
 */
 
-int output_pgsql_t::pgsql_out_node(osmid_t id, struct keyval *tags, double node_lat, double node_lon)
+int output_pgsql_t::pgsql_out_node(osmid_t id, const taglist &tags, double node_lat, double node_lon)
 {
 
-    int filter = m_tagtransform->filter_node_tags(tags, m_export_list.get());
+    int filter = m_tagtransform->filter_node_tags(tags, m_filtered_tags, m_export_list.get());
 
     if (filter) return 1;
 
     expire->from_bbox(node_lon, node_lat, node_lon, node_lat);
-    m_tables[t_point]->write_node(id, tags, node_lat, node_lon);
+    m_tables[t_point]->write_node(id, m_filtered_tags, node_lat, node_lon);
 
     return 0;
 }
@@ -101,10 +101,9 @@ E4C1421D5BF24D06053E7DF4940
 212696  Oswald Road     \N      \N      \N      \N      \N      \N      minor   \N      \N      \N      \N      \N      \N      \N    0102000020E610000004000000467D923B6C22D5BFA359D93EE4DF4940B3976DA7AD11D5BF84BBB376DBDF4940997FF44D9A06D5BF4223D8B8FEDF49404D158C4AEA04D
 5BF5BB39597FCDF4940
 */
-int output_pgsql_t::pgsql_out_way(osmid_t id, struct keyval *tags, const struct osmNode *nodes, int count, int exists)
+int output_pgsql_t::pgsql_out_way(osmid_t id, const taglist &tags, const struct osmNode *nodes, int count, int exists)
 {
     int polygon = 0, roads = 0;
-    double split_at;
 
     /* If the flag says this object may exist already, delete it first */
     if(exists) {
@@ -119,8 +118,18 @@ int output_pgsql_t::pgsql_out_way(osmid_t id, struct keyval *tags, const struct
         }
     }
 
-    if (m_tagtransform->filter_way_tags(tags, &polygon, &roads, m_export_list.get()))
+    if (m_tagtransform->filter_way_tags(tags, m_filtered_tags, &polygon, &roads, m_export_list.get()))
         return 0;
+
+    pgsql_write_way(id, m_filtered_tags, polygon, roads, nodes, count);
+    return 0;
+}
+
+/* Write a way whose tags have been filtered already */
+void output_pgsql_t::pgsql_write_way(osmid_t id, taglist &tags, int polygon, int roads, const struct osmNode *nodes, int count)
+{
+    double split_at;
+
     /* Split long ways after around 1 degree or 100km */
     if (m_options.projection->get_proj_id() == PROJ_LATLONG)
         split_at = 1;
@@ -131,12 +140,12 @@ int output_pgsql_t::pgsql_out_way(osmid_t id, struct keyval *tags, const struct
     for(geometry_builder::wkt_itr wkt = wkts->begin(); wkt != wkts->end(); ++wkt)
     {
         /* FIXME: there should be a better way to detect polygons */
-        if (boost::starts_with(wkt->geom, "POLYGON") || boost::starts_with(wkt->geom, "MULTIPOLYGON")) {
+        if (wkb::is_polygon(wkt->geom)) {
             expire->from_nodes_poly(nodes, count, id);
             if ((wkt->area > 0.0) && m_enable_way_area) {
                 char tmp[32];
                 snprintf(tmp, sizeof(tmp), "%g", wkt->area);
-                keyval::addItem(tags, "way_area", tmp, 0);
+                tags.add("way_area", tmp);
             }
             m_tables[t_poly]->write_wkt(id, tags, wkt->geom.c_str());
         } else {
@@ -146,8 +155,6 @@ int output_pgsql_t::pgsql_out_way(osmid_t id, struct keyval *tags, const struct
                 m_tables[t_roads]->write_wkt(id, tags, wkt->geom.c_str());
         }
     }
-
-    return 0;
 }
 
 int output_pgsql_t::pgsql_out_relation(osmid_t id, struct keyval *rel_tags, int member_count, const struct osmNode * const *xnodes, struct keyval *xtags, const int *xcount, const osmid_t *xid, const char * const *xrole, bool pending)
@@ -188,7 +195,7 @@ int output_pgsql_t::pgsql_out_relation(osmid_t id, struct keyval *rel_tags, int
     {
         expire->from_wkt(wkt->geom.c_str(), -id);
         /* FIXME: there should be a better way to detect polygons */
-        if (boost::starts_with(wkt->geom, "POLYGON") || boost::starts_with(wkt->geom, "MULTIPOLYGON")) {
+        if (wkb::is_polygon(wkt->geom)) {
             if ((wkt->area > 0.0) && m_enable_way_area) {
                 char tmp[32];
                 snprintf(tmp, sizeof(tmp), "%g", wkt->area);
@@ -297,7 +304,9 @@ int output_pgsql_t::pending_way(osmid_t id, int exists) {
     if (!m_mid->ways_get(id, &tags_int, &nodes_int, &count_int)) {
         // Output the way
         //ret = reprocess_way(id, nodes_int, count_int, &tags_int, exists);
-        ret = pgsql_out_way(id, &tags_int, nodes_int, count_int, exists);
+        m_way_tags.clear();
+        m_way_tags.from_keyval(&tags_int);
+        ret = pgsql_out_way(id, m_way_tags, nodes_int, count_int, exists);
         free(nodes_int);
     }
     keyval::resetList(&tags_int);
@@ -403,32 +412,37 @@ void output_pgsql_t::stop()
     expire.reset();
 }
 
-int output_pgsql_t::node_add(osmid_t id, double lat, double lon, struct keyval *tags)
+int output_pgsql_t::node_add(osmid_t id, double lat, double lon, const taglist &tags)
 {
   pgsql_out_node(id, tags, lat, lon);
 
   return 0;
 }
 
-int output_pgsql_t::way_add(osmid_t id, osmid_t *nds, int nd_count, struct keyval *tags)
+int output_pgsql_t::way_add(osmid_t id, osmid_t *nds, int nd_count, const taglist &tags)
 {
   int polygon = 0;
   int roads = 0;
 
 
   /* Check whether the way is: (1) Exportable, (2) Maybe a polygon */
-  int filter = m_tagtransform->filter_way_tags(tags, &polygon, &roads, m_export_list.get());
+  int filter = m_tagtransform->filter_way_tags(tags, m_filtered_tags, &polygon, &roads, m_export_list.get());
 
   /* If this isn't a polygon then it can not be part of a multipolygon
-     Hence only polygons are "pending" */
-  if (!filter && polygon) { ways_pending_tracker->mark(id); }
+     Hence only polygons are "pending". After a relation prescan we also
+     know which polygons can never be superseded by a relation. */
+  bool pending = !filter && polygon && way_in_relation(id);
+  if (pending) {
+      ways_pending_tracker->mark(id);
+      set_pending_way_location(id, nds, nd_count);
+  }
 
-  if( !polygon && !filter )
+  if( !pending && !filter )
   {
     /* Get actual node data and generate output */
     struct osmNode *nodes = (struct osmNode *)malloc( sizeof(struct osmNode) * nd_count );
     int count = m_mid->nodes_get_list( nodes, nds, nd_count );
-    pgsql_out_way(id, tags, nodes, count, 0);
+    pgsql_write_way(id, m_filtered_tags, polygon, roads, nodes, count);
     free(nodes);
   }
   return 0;
@@ -466,20 +480,20 @@ int output_pgsql_t::pgsql_process_relation(osmid_t id, const struct member *memb
 
   osmid_t *xid = (osmid_t *)malloc( sizeof(osmid_t) * (count + 1));
   count2 = m_mid->ways_get_list(xid2, count, xid, xtags, xnodes, xcount);
-  int polygon = 0, roads = 0;;
+
+  //filter the tags on the members because we got them from the middle
+  //and since the middle is no longer tied to the output it no longer
+  //shares any kind of tag transform and therefore all original tags
+  //will come back and need to be filtered by individual outputs before
+  //using these ways
+  //TODO: if the filter says that a member is now not interesting we
+  //should decrement the count and remove his nodes and tags etc. for
+  //now we'll just keep him with no tags so he will get filtered later
+  m_tagtransform->filter_way_tags_list(xtags, count2, m_export_list.get());
 
   for (i = 0; i < count2; i++) {
       for (j = i; j < member_count; j++) {
           if (members[j].id == xid[i]) {
-              //filter the tags on this member because we got it from the middle
-              //and since the middle is no longer tied to the output it no longer
-              //shares any kind of tag transform and therefore all original tags
-              //will come back and need to be filtered by individual outputs before
-              //using these ways
-              m_tagtransform->filter_way_tags(&xtags[i], &polygon, &roads, m_export_list.get());
-              //TODO: if the filter says that this member is now not interesting we
-              //should decrement the count and remove his nodes and tags etc. for
-              //now we'll just keep him with no tags so he will get filtered later
               break;
           }
       }
@@ -508,9 +522,9 @@ int output_pgsql_t::pgsql_process_relation(osmid_t id, const struct member *memb
   return 0;
 }
 
-int output_pgsql_t::relation_add(osmid_t id, struct member *members, int member_count, struct keyval *tags)
+int output_pgsql_t::relation_add(osmid_t id, struct member *members, int member_count, const taglist &tags)
 {
-  const char *type = keyval::getItem(tags, "type");
+  const char *type = tags.get("type");
 
   /* Must have a type field or we ignore it */
   if (!type)
@@ -521,7 +535,23 @@ int output_pgsql_t::relation_add(osmid_t id, struct member *members, int member_
     return 0;
 
 
-  return pgsql_process_relation(id, members, member_count, tags, 0);
+  return pgsql_process_relation(id, members, member_count, keyval_tags(tags), 0);
+}
+
+void output_pgsql_t::relation_prescan(osmid_t id, const struct member *members, int member_count, const taglist &tags)
+{
+  /* Only the relation types relation_add will process can supersede ways.
+     The builtin tag transform never makes polygons out of routes, but a
+     lua script might. */
+  const char *type = tags.get("type");
+  if (!type)
+      return;
+
+  if ( (strcmp(type, "multipolygon") != 0) && (strcmp(type, "boundary") != 0) &&
+       (!m_options.tag_transform_script || (strcmp(type, "route") != 0)))
+    return;
+
+  mark_relation_ways(members, member_count);
 }
 
 /* Delete is easy, just remove all traces of this object. We don't need to
@@ -535,8 +565,7 @@ int output_pgsql_t::node_delete(osmid_t osm_id)
         util::exit_nicely();
     }
 
-    if ( expire->from_db(m_tables[t_point].get(), osm_id) != 0)
-        m_tables[t_point]->delete_row(osm_id);
+    expire->delete_from_db(m_tables[t_point].get(), osm_id);
 
     return 0;
 }
@@ -552,10 +581,8 @@ int output_pgsql_t::pgsql_delete_way_from_output(osmid_t osm_id)
         return 0;
 
     m_tables[t_roads]->delete_row(osm_id);
-    if ( expire->from_db(m_tables[t_line].get(), osm_id) != 0)
-        m_tables[t_line]->delete_row(osm_id);
-    if ( expire->from_db(m_tables[t_poly].get(), osm_id) != 0)
-        m_tables[t_poly]->delete_row(osm_id);
+    expire->delete_from_db(m_tables[t_line].get(), osm_id);
+    expire->delete_from_db(m_tables[t_poly].get(), osm_id);
     return 0;
 }
 
@@ -574,10 +601,8 @@ int output_pgsql_t::way_delete(osmid_t osm_id)
 int output_pgsql_t::pgsql_delete_relation_from_output(osmid_t osm_id)
 {
     m_tables[t_roads]->delete_row(-osm_id);
-    if ( expire->from_db(m_tables[t_line].get(), -osm_id) != 0)
-        m_tables[t_line]->delete_row(-osm_id);
-    if ( expire->from_db(m_tables[t_poly].get(), -osm_id) != 0)
-        m_tables[t_poly]->delete_row(-osm_id);
+    expire->delete_from_db(m_tables[t_line].get(), -osm_id);
+    expire->delete_from_db(m_tables[t_poly].get(), -osm_id);
     return 0;
 }
 
@@ -595,7 +620,7 @@ int output_pgsql_t::relation_delete(osmid_t osm_id)
 /* Modify is slightly trickier. The basic idea is we simply delete the
  * object and create it with the new parameters. Then we need to mark the
  * objects that depend on this one */
-int output_pgsql_t::node_modify(osmid_t osm_id, double lat, double lon, struct keyval *tags)
+int output_pgsql_t::node_modify(osmid_t osm_id, double lat, double lon, const taglist &tags)
 {
     if( !m_options.slim )
     {
@@ -607,7 +632,7 @@ int output_pgsql_t::node_modify(osmid_t osm_id, double lat, double lon, struct k
     return 0;
 }
 
-int output_pgsql_t::way_modify(osmid_t osm_id, osmid_t *nodes, int node_count, struct keyval *tags)
+int output_pgsql_t::way_modify(osmid_t osm_id, osmid_t *nodes, int node_count, const taglist &tags)
 {
     if( !m_options.slim )
     {
@@ -620,7 +645,7 @@ int output_pgsql_t::way_modify(osmid_t osm_id, osmid_t *nodes, int node_count, s
     return 0;
 }
 
-int output_pgsql_t::relation_modify(osmid_t osm_id, struct member *members, int member_count, struct keyval *tags)
+int output_pgsql_t::relation_modify(osmid_t osm_id, struct member *members, int member_count, const taglist &tags)
 {
     if( !m_options.slim )
     {
@@ -660,6 +685,7 @@ output_pgsql_t::output_pgsql_t(const middle_query_t* mid_, const options_t &opti
 
     reproj = m_options.projection;
     builder.set_exclude_broken_polygon(m_options.excludepoly);
+    builder.set_thread_count(m_options.num_procs);
 
     m_export_list.reset(new export_list());
 
@@ -716,7 +742,8 @@ output_pgsql_t::output_pgsql_t(const middle_query_t* mid_, const options_t &opti
             new table_t(
                 m_options.conninfo, name, type, columns, m_options.hstore_columns, SRID, m_options.scale,
                 m_options.append, m_options.slim, m_options.droptemp, m_options.hstore_mode,
-                m_options.enable_hstore_index, m_options.tblsmain_data, m_options.tblsmain_index
+                m_options.enable_hstore_index, m_options.tblsmain_data, m_options.tblsmain_index,
+                size_t(m_options.copy_buffer) << 20
             )
         ));
     }
@@ -729,6 +756,7 @@ output_pgsql_t::output_pgsql_t(const output_pgsql_t& other):
     expire(new expire_tiles(&m_options))
 {
     builder.set_exclude_broken_polygon(m_options.excludepoly);
+    builder.set_thread_count(m_options.num_procs);
     for(std::vector<boost::shared_ptr<table_t> >::const_iterator t = other.m_tables.begin(); t != other.m_tables.end(); ++t) {
         //copy constructor will just connect to the already there table
         m_tables.push_back(boost::shared_ptr<table_t>(new table_t(**t)));
@@ -744,9 +772,9 @@ size_t output_pgsql_t::pending_count() const {
 
 void output_pgsql_t::merge_pending_relations(boost::shared_ptr<output_t> other) {
     boost::shared_ptr<id_tracker> tracker = other->get_pending_relations();
-    osmid_t id;
-    while(tracker.get() && id_tracker::is_valid((id = tracker->pop_mark()))){
-        rels_pending_tracker->mark(id);
+    if (tracker.get()) {
+        rels_pending_tracker->merge(*tracker);
+        tracker->clear();
     }
 }
 void output_pgsql_t::merge_expire_trees(boost::shared_ptr<output_t> other) {
@@ -39,18 +39,20 @@ public:
     void enqueue_relations(pending_queue_t &job_queue, osmid_t id, size_t output_id, size_t& added);
     int pending_relation(osmid_t id, int exists);
 
-    int node_add(osmid_t id, double lat, double lon, struct keyval *tags);
-    int way_add(osmid_t id, osmid_t *nodes, int node_count, struct keyval *tags);
-    int relation_add(osmid_t id, struct member *members, int member_count, struct keyval *tags);
+    int node_add(osmid_t id, double lat, double lon, const taglist &tags);
+    int way_add(osmid_t id, osmid_t *nodes, int node_count, const taglist &tags);
+    int relation_add(osmid_t id, struct member *members, int member_count, const taglist &tags);
 
-    int node_modify(osmid_t id, double lat, double lon, struct keyval *tags);
-    int way_modify(osmid_t id, osmid_t *nodes, int node_count, struct keyval *tags);
-    int relation_modify(osmid_t id, struct member *members, int member_count, struct keyval *tags);
+    int node_modify(osmid_t id, double lat, double lon, const taglist &tags);
+    int way_modify(osmid_t id, osmid_t *nodes, int node_count, const taglist &tags);
+    int relation_modify(osmid_t id, struct member *members, int member_count, const taglist &tags);
 
     int node_delete(osmid_t id);
     int way_delete(osmid_t id);
     int relation_delete(osmid_t id);
 
+    void relation_prescan(osmid_t id, const struct member *members, int member_count, const taglist &tags);
+
     size_t pending_count() const;
 
     void merge_pending_relations(boost::shared_ptr<output_t> other);
@@ -60,8 +62,9 @@ public:
 
 protected:
 
-    int pgsql_out_node(osmid_t id, struct keyval *tags, double node_lat, double node_lon);
-    int pgsql_out_way(osmid_t id, struct keyval *tags, const struct osmNode *nodes, int count, int exists);
+    int pgsql_out_node(osmid_t id, const taglist &tags, double node_lat, double node_lon);
+    int pgsql_out_way(osmid_t id, const taglist &tags, const struct osmNode *nodes, int count, int exists);
+    void pgsql_write_way(osmid_t id, taglist &tags, int polygon, int roads, const struct osmNode *nodes, int count);
     int pgsql_out_relation(osmid_t id, struct keyval *rel_tags, int member_count, const struct osmNode * const * xnodes, struct keyval *xtags, const int *xcount, const osmid_t *xid, const char * const *xrole, bool pending);
     int pgsql_process_relation(osmid_t id, const struct member *members, int member_count, struct keyval *tags, int exists, bool pending=false);
     int pgsql_delete_way_from_output(osmid_t osm_id);
@@ -78,6 +81,10 @@ protected:
 
     geometry_builder builder;
 
+    //the tags of the object being written after filtering, and of a pending
+    //way read back from the middle, kept to reuse their memory
+    taglist m_filtered_tags, m_way_tags;
+
     boost::shared_ptr<reprojection> reproj;
     boost::shared_ptr<expire_tiles> expire;
 
@@ -27,7 +27,7 @@ void override_if(T &t, const std::string &key, const pt::ptree &conf) {
     }
 }
 
-boost::shared_ptr<output_t> parse_multi_single(const pt::ptree &conf,
+boost::shared_ptr<output_multi_t> parse_multi_single(const pt::ptree &conf,
                              const middle_query_t *mid,
                              const options_t &options) {
     options_t new_opts = options;
@@ -93,8 +93,19 @@ std::vector<boost::shared_ptr<output_t> > parse_multi_config(const middle_query_
             pt::ptree conf;
             pt::read_json(file_name, conf);
 
+            //with several tables they match the tags of each object and
+            //look up the nodes of each way together
+            boost::shared_ptr<output_multi_dispatch> dispatch;
+            if (conf.size() > 1) {
+                dispatch = boost::make_shared<output_multi_dispatch>();
+            }
+
             BOOST_FOREACH(const pt::ptree::value_type &val, conf) {
-                outputs.push_back(parse_multi_single(val.second, mid, options));
+                boost::shared_ptr<output_multi_t> output = parse_multi_single(val.second, mid, options);
+                if (dispatch) {
+                    output->set_dispatch(dispatch);
+                }
+                outputs.push_back(output);
             }
 
         } catch (const std::exception &e) {
@@ -133,11 +144,13 @@ std::vector<boost::shared_ptr<output_t> > output_t::create_outputs(const middle_
 }
 
 output_t::output_t(const middle_query_t *mid_, const options_t &options_): m_mid(mid_), m_options(options_) {
-
+    if (m_options.spatial_pending) {
+        m_pending_order.reset(new spatial_order());
+    }
 }
 
 output_t::~output_t() {
-
+    keyval::resetList(&m_keyval_tags);
 }
 
 size_t output_t::pending_count() const{
@@ -159,3 +172,63 @@ boost::shared_ptr<id_tracker> output_t::get_pending_relations() {
 boost::shared_ptr<expire_tiles> output_t::get_expire_tree() {
     return boost::shared_ptr<expire_tiles>();
 }
+
+uint32_t output_t::pending_way_key(osmid_t id) {
+    if (!m_pending_order) {
+        return spatial_order::unknown_key;
+    }
+    return m_pending_order->get(id);
+}
+
+void output_t::pending_ways_queued() {
+    m_pending_order.reset();
+    m_relation_ways.reset();
+}
+
+void output_t::set_pending_way_location(osmid_t id, const osmid_t *nds, int nd_count) {
+    if (!m_pending_order || (nd_count < 1)) {
+        return;
+    }
+
+    //the first node is a good enough guess at where the way is
+    struct osmNode first;
+    if (m_mid->nodes_get_list(&first, nds, 1) == 1) {
+        set_pending_way_location(id, first);
+    }
+}
+
+void output_t::set_pending_way_location(osmid_t id, const struct osmNode &first) {
+    if (m_pending_order) {
+        m_pending_order->add(id, spatial_order::location_key(m_options.projection.get(), first.lon, first.lat));
+    }
+}
+
+void output_t::start_prescan() {
+    m_relation_ways.reset(new id_tracker());
+}
+
+void output_t::relation_prescan(osmid_t, const struct member *members, int member_count, const taglist &) {
+    mark_relation_ways(members, member_count);
+}
+
+struct keyval *output_t::keyval_tags(const taglist &tags) {
+    keyval::resetList(&m_keyval_tags);
+    tags.to_keyval(&m_keyval_tags);
+    return &m_keyval_tags;
+}
+
+void output_t::mark_relation_ways(const struct member *members, int member_count) {
+    if (!m_relation_ways) {
+        return;
+    }
+
+    for (int i = 0; i < member_count; ++i) {
+        if (members[i].type == OSMTYPE_WAY) {
+            m_relation_ways->mark(members[i].id);
+        }
+    }
+}
+
+bool output_t::way_in_relation(osmid_t id) {
+    return !m_relation_ways || m_relation_ways->is_marked(id);
+}
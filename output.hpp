@@ -11,10 +11,14 @@
 #define OUTPUT_H
 
 #include "middle.hpp"
+#include "keyvals.hpp"
+#include "taglist.hpp"
 #include "id-tracker.hpp"
 #include "expire-tiles.hpp"
+#include "spatial-order.hpp"
 
 #include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/version.hpp>
 
 #include <utility>
@@ -47,18 +51,24 @@ public:
     virtual void enqueue_relations(pending_queue_t &job_queue, osmid_t id, size_t output_id, size_t& added) = 0;
     virtual int pending_relation(osmid_t id, int exists) = 0;
 
-    virtual int node_add(osmid_t id, double lat, double lon, struct keyval *tags) = 0;
-    virtual int way_add(osmid_t id, osmid_t *nodes, int node_count, struct keyval *tags) = 0;
-    virtual int relation_add(osmid_t id, struct member *members, int member_count, struct keyval *tags) = 0;
+    virtual int node_add(osmid_t id, double lat, double lon, const taglist &tags) = 0;
+    virtual int way_add(osmid_t id, osmid_t *nodes, int node_count, const taglist &tags) = 0;
+    virtual int relation_add(osmid_t id, struct member *members, int member_count, const taglist &tags) = 0;
 
-    virtual int node_modify(osmid_t id, double lat, double lon, struct keyval *tags) = 0;
-    virtual int way_modify(osmid_t id, osmid_t *nodes, int node_count, struct keyval *tags) = 0;
-    virtual int relation_modify(osmid_t id, struct member *members, int member_count, struct keyval *tags) = 0;
+    virtual int node_modify(osmid_t id, double lat, double lon, const taglist &tags) = 0;
+    virtual int way_modify(osmid_t id, osmid_t *nodes, int node_count, const taglist &tags) = 0;
+    virtual int relation_modify(osmid_t id, struct member *members, int member_count, const taglist &tags) = 0;
 
     virtual int node_delete(osmid_t id) = 0;
     virtual int way_delete(osmid_t id) = 0;
     virtual int relation_delete(osmid_t id) = 0;
 
+    // the relation prescan reads all relations before the real import so
+    // that ways which are not members of any interesting relation can be
+    // written straight away instead of going pending.
+    void start_prescan();
+    virtual void relation_prescan(osmid_t id, const struct member *members, int member_count, const taglist &tags);
+
     virtual size_t pending_count() const;
 
     const options_t *get_options() const;
@@ -68,10 +78,44 @@ public:
     virtual boost::shared_ptr<id_tracker> get_pending_relations();
     virtual boost::shared_ptr<expire_tiles> get_expire_tree();
 
+    // sort key used to hand out this output's pending ways in spatial
+    // order. returns spatial_order::unknown_key if none was recorded.
+    uint32_t pending_way_key(osmid_t id);
+
+    // called once every pending way has been queued, and sorted if that
+    // was asked for. drops what was only kept to queue them, including
+    // the relation prescan marks.
+    void pending_ways_queued();
+
 protected:
 
+    // remember the location of a way which is going pending, using its
+    // first node. does nothing unless spatial pending order is enabled.
+    void set_pending_way_location(osmid_t id, const osmid_t *nds, int nd_count);
+    // the same for a way whose first node has been looked up already
+    void set_pending_way_location(osmid_t id, const struct osmNode &first);
+
+    // record the way members of a relation seen during the prescan
+    void mark_relation_ways(const struct member *members, int member_count);
+
+    // whether a way might still be needed by a relation. without a
+    // prescan we can't know, so every way might be. the prescan marks
+    // are dropped once the pending ways are queued, so this is only
+    // meaningful while ways are being added.
+    bool way_in_relation(osmid_t id);
+
+    // the tags as a keyval list, for the code which filters and writes
+    // them. the list belongs to the output and is only valid until the
+    // next call.
+    struct keyval *keyval_tags(const taglist &tags);
+
     const middle_query_t* m_mid;
     const options_t m_options;
+    boost::scoped_ptr<spatial_order> m_pending_order;
+    boost::scoped_ptr<id_tracker> m_relation_ways;
+
+private:
+    struct keyval m_keyval_tags;
 };
 
 unsigned int pgsql_filter_tags(enum OsmType type, struct keyval *tags, int *polygon);
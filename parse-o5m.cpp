@@ -809,18 +809,18 @@ return 1;
 
       hisver= pbf_uint32(&bufp);
       uint32toa(hisver,tmpstr);
-      keyval::addItem(&(tags),"osm_version",tmpstr,0);
+      tags.add("osm_version",tmpstr);
       if(hisver!=0) {  /* history information available */
         histime= o5histime+= pbf_sint64(&bufp);
         createtimestamp(histime,tmpstr);
-        keyval::addItem(&(tags),"osm_timestamp",tmpstr, 0);
+        tags.add("osm_timestamp",tmpstr);
         if(histime!=0) {
             hiscset= o5hiscset+= pbf_sint32(&bufp);  /* (not used) */
           str_read(&bufp,&sp,&hisuser);
           hisuid= pbf_uint64((byte**)&sp);
           uint32toa(hisuid,tmpstr);
-          keyval::addItem(&(tags),"osm_uid",tmpstr,0);
-          keyval::addItem(&(tags),"osm_user",hisuser,0);
+          tags.add("osm_uid",tmpstr);
+          tags.add("osm_user",hisuser);
           }
       }  /* end   history information available */
     }  /* end   read history */
@@ -841,7 +841,7 @@ return 1;
         break;
       default: ;
         }
-      keyval::resetList(&(tags));
+      tags.clear();
       continue;  /* end processing for this object */
     }  /* end   delete request */
     else {  /* not a delete request */
@@ -858,7 +858,7 @@ return 1;
         node_lon= (double)(o5lon+= pbf_sint32(&bufp))/10000000;
         node_lat= (double)(o5lat+= pbf_sint32(&bufp))/10000000;
         if(!node_wanted(node_lat,node_lon)) {
-          keyval::resetList(&(tags));
+          tags.clear();
   continue;
           }
         proj->reproject(&(node_lat),&(node_lon));
@@ -901,7 +901,7 @@ return 1;
             break;
             }
           members[member_count].id= o5rid[rt]+= ri;
-          members[member_count].role= rr;
+          members[member_count].role= interned_roles().text(rr);
           member_count++;
           if(member_count>=member_max)
             realloc_members();
@@ -920,7 +920,7 @@ return 1;
             /* replace all blanks in key by underlines */
             p++;
             }
-          keyval::addItem(&(tags),k,v,0);
+          tags.add(k,v);
           }
       }  /* end   for all tags of this object */
 
@@ -929,32 +929,32 @@ return 1;
       case 0:  /* node */
         if(action==ACTION_CREATE)
           osmdata->node_add(osm_id,
-            node_lat,node_lon,&(tags));
+            node_lat,node_lon,tags);
         else /* ACTION_MODIFY */
           osmdata->node_modify(osm_id,
-            node_lat,node_lon,&(tags));
+            node_lat,node_lon,tags);
         break;
       case 1:  /* way */
         if(action==ACTION_CREATE)
           osmdata->way_add(osm_id,
-            nds,nd_count,&(tags));
+            nds,nd_count,tags);
         else /* ACTION_MODIFY */
           osmdata->way_modify(osm_id,
-            nds,nd_count,&(tags));
+            nds,nd_count,tags);
         break;
       case 2:  /* relation */
         if(action==ACTION_CREATE)
           osmdata->relation_add(osm_id,
-            members,member_count,&(tags));
+            members,member_count,tags);
         else /* ACTION_MODIFY */
           osmdata->relation_modify(osm_id,
-            members,member_count,&(tags));
+            members,member_count,tags);
         break;
       default: ;
         }
 
       /* reset temporary storage lists */
-      keyval::resetList(&(tags));
+      tags.clear();
 
     }  /* end   not a delete request */
 
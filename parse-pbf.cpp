@@ -170,59 +170,41 @@ static size_t uncompress_blob(Blob *bmsg, void *buf, int32_t max_size)
   return 0;
 }
 
-int addProtobufItem(struct keyval *head, ProtobufCBinaryData key, ProtobufCBinaryData val, int noDupe)
+void addProtobufItem(taglist &tags, ProtobufCBinaryData key, ProtobufCBinaryData val)
 {
-  char *keystr, *valstr;
-  int retval;
-
-  keystr = (char *)calloc(key.len + 1, 1);
-  memcpy(keystr, key.data, key.len);
+  const char *keystr = (const char *)key.data;
 
   /* drop certain keys (matching parse-xml2) */
-  if ((strcmp(keystr, "created_by") == 0) || (strcmp(keystr, "source") == 0)) {
-    free(keystr);
-    return 0;
+  if ((key.len == 10 && memcmp(keystr, "created_by", 10) == 0) ||
+      (key.len == 6 && memcmp(keystr, "source", 6) == 0)) {
+    return;
   }
 
-  valstr = (char *)calloc(val.len + 1, 1);
-  memcpy(valstr, val.data, val.len);
-
-  retval = keyval::addItem(head, keystr, valstr, noDupe);
-
-  free(keystr);
-  free(valstr);
-
-  return retval;
+  tags.add(keystr, key.len, (const char *)val.data, val.len);
 }
 
-int addIntItem(struct keyval *head, const char *key, int val, int noDupe)
+void addIntItem(taglist &tags, const char *key, int val)
 {
   char buf[100];
 
   sprintf(buf, "%d", val);
-  return keyval::addItem(head, key, buf, noDupe);
+  tags.add(key, buf);
 }
 
-int addInfoItems(struct keyval *head, Info *info, StringTable *string_table)
+int addInfoItems(taglist &tags, Info *info, StringTable *string_table)
 {
       if (info->has_version) {
-	addIntItem(head, "osm_version", info->version, 0);
+	addIntItem(tags, "osm_version", info->version);
       }
       if (info->has_changeset) {
-	addIntItem(head, "osm_changeset", info->changeset, 0);
+	addIntItem(tags, "osm_changeset", info->changeset);
       }
       if (info->has_uid) {
-	addIntItem(head, "osm_uid", info->uid, 0);
+	addIntItem(tags, "osm_uid", info->uid);
       }
       if (info->has_user_sid) {
 	ProtobufCBinaryData user = string_table->s[info->user_sid];
-	char *username;
-
-        username = (char *)calloc(user.len + 1, 1);
-	memcpy(username, user.data, user.len);
-
-	keyval::addItem(head, "osm_user", username, 0);
-    free(username);
+	tags.add("osm_user", 8, (const char *)user.data, user.len);
       }
 
       /* TODO timestamp */
@@ -250,17 +232,16 @@ int parse_pbf_t::processOsmDataNodes(struct osmdata_t *osmdata, PrimitiveGroup *
     Node *node = group->nodes[node_id];
     double lat, lon;
 
-    keyval::resetList(&(tags));
+    tags.clear();
 
     if (node->info && extra_attributes) {
-      addInfoItems(&(tags), node->info, string_table);
+      addInfoItems(tags, node->info, string_table);
     }
 
     for (key_id = 0; key_id < node->n_keys; key_id++) {
-      addProtobufItem(&(tags),
+      addProtobufItem(tags,
 		      string_table->s[node->keys[key_id]],
-		      string_table->s[node->vals[key_id]],
-		      0);
+		      string_table->s[node->vals[key_id]]);
     }
 
     lat = lat_offset + (node->lat * granularity);
@@ -268,7 +249,7 @@ int parse_pbf_t::processOsmDataNodes(struct osmdata_t *osmdata, PrimitiveGroup *
     if (node_wanted(lat, lon)) {
         proj->reproject(&lat, &lon);
 
-        osmdata->node_add(node->id, lat, lon, &(tags));
+        osmdata->node_add(node->id, lat, lon, tags);
 
         if (node->id > max_node) {
             max_node = node->id;
@@ -303,7 +284,7 @@ int parse_pbf_t::processOsmDataDenseNodes(struct osmdata_t *osmdata, PrimitiveGr
         DenseNodes *dense = group->dense;
 
         for (node_id = 0; node_id < dense->n_id; node_id++) {
-            keyval::resetList(&(tags));
+            tags.clear();
 
             deltaid += dense->id[node_id];
             deltalat += dense->lat[node_id];
@@ -317,25 +298,21 @@ int parse_pbf_t::processOsmDataDenseNodes(struct osmdata_t *osmdata, PrimitiveGr
                 deltauid += denseinfo->uid[node_id];
                 deltauser_sid += denseinfo->user_sid[node_id];
 
-                addIntItem(&(tags), "osm_version", denseinfo->version[node_id], 0);
-                addIntItem(&(tags), "osm_changeset", deltachangeset, 0);
+                addIntItem(tags, "osm_version", denseinfo->version[node_id]);
+                addIntItem(tags, "osm_changeset", deltachangeset);
 
                 if (deltauid != -1) { /* osmosis devs failed to read the specs */
-                    char * valstr;
-                    addIntItem(&(tags), "osm_uid", deltauid, 0);
-                    valstr = (char *)calloc(string_table->s[deltauser_sid].len + 1, 1);
-                    memcpy(valstr, string_table->s[deltauser_sid].data, string_table->s[deltauser_sid].len);
-                    keyval::addItem(&(tags), "osm_user", valstr, 0);
-                    free(valstr);
+                    addIntItem(tags, "osm_uid", deltauid);
+                    tags.add("osm_user", 8, (const char *)string_table->s[deltauser_sid].data,
+                             string_table->s[deltauser_sid].len);
                 }
             }
 
             if (l < dense->n_keys_vals) {
                 while (dense->keys_vals[l] != 0 && l < dense->n_keys_vals) {
-                    addProtobufItem(&(tags),
+                    addProtobufItem(tags,
                                     string_table->s[dense->keys_vals[l]],
-                                    string_table->s[dense->keys_vals[l+1]],
-                                    0);
+                                    string_table->s[dense->keys_vals[l+1]]);
 
                     l += 2;
                 }
@@ -347,7 +324,7 @@ int parse_pbf_t::processOsmDataDenseNodes(struct osmdata_t *osmdata, PrimitiveGr
             if (node_wanted(lat, lon)) {
                 proj->reproject(&lat, &lon);
 
-                osmdata->node_add(deltaid, lat, lon, &(tags));
+                osmdata->node_add(deltaid, lat, lon, tags);
 
                 if (deltaid > max_node) {
                     max_node = deltaid;
@@ -373,10 +350,10 @@ int parse_pbf_t::processOsmDataWays(struct osmdata_t *osmdata, PrimitiveGroup *g
     Way *way = group->ways[way_id];
     osmid_t deltaref = 0;
 
-    keyval::resetList(&(tags));
+    tags.clear();
 
     if (way->info && extra_attributes) {
-      addInfoItems(&(tags), way->info, string_table);
+      addInfoItems(tags, way->info, string_table);
     }
 
     nd_count = 0;
@@ -391,16 +368,15 @@ int parse_pbf_t::processOsmDataWays(struct osmdata_t *osmdata, PrimitiveGroup *g
     }
 
     for (key_id = 0; key_id < way->n_keys; key_id++) {
-      addProtobufItem(&(tags),
+      addProtobufItem(tags,
 		      string_table->s[way->keys[key_id]],
-		      string_table->s[way->vals[key_id]],
-		      0);
+		      string_table->s[way->vals[key_id]]);
     }
 
     osmdata->way_add(way->id,
                      nds,
                      nd_count,
-                     &(tags) );
+                     tags );
 
     if (way->id > max_way) {
       max_way = way->id;
@@ -424,25 +400,21 @@ int parse_pbf_t::processOsmDataRelations(struct osmdata_t *osmdata, PrimitiveGro
     Relation *relation = group->relations[rel_id];
     osmid_t deltamemids = 0;
 
-    keyval::resetList(&(tags));
+    tags.clear();
 
     member_count = 0;
 
     if (relation->info && extra_attributes) {
-      addInfoItems(&(tags), relation->info, string_table);
+      addInfoItems(tags, relation->info, string_table);
     }
 
     for (member_id = 0; member_id < relation->n_memids; member_id++) {
       ProtobufCBinaryData role =  string_table->s[relation->roles_sid[member_id]];
-      char *rolestr;
 
       deltamemids += relation->memids[member_id];
 
       members[member_count].id = deltamemids;
-
-      rolestr = (char *)calloc(role.len + 1, 1);
-      memcpy(rolestr, role.data, role.len);
-      members[member_count].role = rolestr;
+      members[member_count].role = interned_roles().text((const char *)role.data, role.len);
 
       switch (relation->types[member_id]) {
       case RELATION__MEMBER_TYPE__NODE:
@@ -467,20 +439,15 @@ int parse_pbf_t::processOsmDataRelations(struct osmdata_t *osmdata, PrimitiveGro
     }
 
     for (key_id = 0; key_id < relation->n_keys; key_id++) {
-      addProtobufItem(&(tags),
+      addProtobufItem(tags,
 		      string_table->s[relation->keys[key_id]],
-		      string_table->s[relation->vals[key_id]],
-		      0);
+		      string_table->s[relation->vals[key_id]]);
     }
 
     osmdata->relation_add(relation->id,
                           members,
                           member_count,
-                          &(tags));
-
-    for (member_id = 0; member_id < member_count; member_id++) {
-      free(members[member_id].role);
-    }
+                          tags);
 
     if (relation->id > max_rel) {
       max_rel = relation->id;
@@ -516,6 +483,10 @@ int parse_pbf_t::processOsmData(struct osmdata_t *osmdata, void *data, size_t le
     PrimitiveGroup *group = pmsg->primitivegroup[j];
     StringTable *string_table = pmsg->stringtable;
 
+    /* Groups only hold one type of object, so the prescan can skip
+       decoding everything but the relations */
+    if (osmdata->prescanning() && group->n_relations == 0) continue;
+
     if (!processOsmDataNodes(osmdata, group, string_table, lat_offset, lon_offset, granularity)) return 0;
     if (!processOsmDataDenseNodes(osmdata, group, string_table, lat_offset, lon_offset, granularity)) return 0;
     if (!processOsmDataWays(osmdata, group, string_table)) return 0;
@@ -181,7 +181,7 @@ void parse_xml2_t::StartElement(xmlTextReaderPtr reader, const xmlChar *name, st
       while ((p = strchr(k, ' ')))
         *p = '_';
 
-      keyval::addItem(&(tags), k, (char *)xv, 0);
+      tags.add(k, (char *)xv);
       xmlFree(k);
       xmlFree(xv);
     }
@@ -206,7 +206,7 @@ void parse_xml2_t::StartElement(xmlTextReaderPtr reader, const xmlChar *name, st
     assert(xid);
 
     members[member_count].id = strtoosmid((char *) xid, NULL, 0);
-    members[member_count].role = strdup((char *) xrole);
+    members[member_count].role = interned_roles().text((char *) xrole);
 
     /* Currently we are only interested in 'way' members since these form polygons with holes */
     if (xmlStrEqual(xtype, BAD_CAST "way"))
@@ -246,31 +246,31 @@ void parse_xml2_t::StartElement(xmlTextReaderPtr reader, const xmlChar *name, st
 
       xtmp = xmlTextReaderGetAttribute(reader, BAD_CAST "user");
       if (xtmp) {
-    keyval::addItem(&(tags), "osm_user", (char *)xtmp, 0);
+    tags.add("osm_user", (char *)xtmp);
           xmlFree(xtmp);
       }
 
       xtmp = xmlTextReaderGetAttribute(reader, BAD_CAST "uid");
       if (xtmp) {
-    keyval::addItem(&(tags), "osm_uid", (char *)xtmp, 0);
+    tags.add("osm_uid", (char *)xtmp);
           xmlFree(xtmp);
       }
 
       xtmp = xmlTextReaderGetAttribute(reader, BAD_CAST "version");
       if (xtmp) {
-    keyval::addItem(&(tags), "osm_version", (char *)xtmp, 0);
+    tags.add("osm_version", (char *)xtmp);
           xmlFree(xtmp);
       }
 
       xtmp = xmlTextReaderGetAttribute(reader, BAD_CAST "timestamp");
       if (xtmp) {
-    keyval::addItem(&(tags), "osm_timestamp", (char *)xtmp, 0);
+    tags.add("osm_timestamp", (char *)xtmp);
           xmlFree(xtmp);
       }
 
       xtmp = xmlTextReaderGetAttribute(reader, BAD_CAST "changeset");
       if (xtmp) {
-    keyval::addItem(&(tags), "osm_changeset", (char *)xtmp, 0);
+    tags.add("osm_changeset", (char *)xtmp);
           xmlFree(xtmp);
       }
   }
@@ -283,9 +283,9 @@ void parse_xml2_t::EndElement(const xmlChar *name, struct osmdata_t *osmdata)
       if (node_wanted(node_lat, node_lon)) {
 	  proj->reproject(&(node_lat), &(node_lon));
             if( action == ACTION_CREATE )
-	        osmdata->node_add(osm_id, node_lat, node_lon, &(tags));
+	        osmdata->node_add(osm_id, node_lat, node_lon, tags);
             else if( action == ACTION_MODIFY )
-	        osmdata->node_modify(osm_id, node_lat, node_lon, &(tags));
+	        osmdata->node_modify(osm_id, node_lat, node_lon, tags);
             else if( action == ACTION_DELETE )
                 osmdata->node_delete(osm_id);
             else
@@ -294,12 +294,12 @@ void parse_xml2_t::EndElement(const xmlChar *name, struct osmdata_t *osmdata)
                 util::exit_nicely();
             }
         }
-        keyval::resetList(&(tags));
+        tags.clear();
     } else if (xmlStrEqual(name, BAD_CAST "way")) {
         if( action == ACTION_CREATE )
-	    osmdata->way_add(osm_id, nds, nd_count, &(tags) );
+	    osmdata->way_add(osm_id, nds, nd_count, tags );
         else if( action == ACTION_MODIFY )
-	    osmdata->way_modify(osm_id, nds, nd_count, &(tags) );
+	    osmdata->way_modify(osm_id, nds, nd_count, tags );
         else if( action == ACTION_DELETE )
             osmdata->way_delete(osm_id);
         else
@@ -307,12 +307,12 @@ void parse_xml2_t::EndElement(const xmlChar *name, struct osmdata_t *osmdata)
             fprintf( stderr, "Don't know action for way %" PRIdOSMID "\n", osm_id );
             util::exit_nicely();
         }
-        keyval::resetList(&(tags));
+        tags.clear();
     } else if (xmlStrEqual(name, BAD_CAST "relation")) {
         if( action == ACTION_CREATE )
-	    osmdata->relation_add(osm_id, members, member_count, &(tags));
+	    osmdata->relation_add(osm_id, members, member_count, tags);
         else if( action == ACTION_MODIFY )
-	    osmdata->relation_modify(osm_id, members, member_count, &(tags));
+	    osmdata->relation_modify(osm_id, members, member_count, tags);
         else if( action == ACTION_DELETE )
             osmdata->relation_delete(osm_id);
         else
@@ -320,7 +320,7 @@ void parse_xml2_t::EndElement(const xmlChar *name, struct osmdata_t *osmdata)
             fprintf( stderr, "Don't know action for relation %" PRIdOSMID "\n", osm_id );
             util::exit_nicely();
         }
-        keyval::resetList(&(tags));
+        tags.clear();
         resetMembers();
     } else if (xmlStrEqual(name, BAD_CAST "tag")) {
         /* ignore */
@@ -343,7 +343,7 @@ void parse_xml2_t::EndElement(const xmlChar *name, struct osmdata_t *osmdata)
         /* ignore */
     } else if (xmlStrEqual(name, BAD_CAST "changeset")) {
         /* ignore */
-	keyval::resetList(&(tags)); /* We may have accumulated some tags even if we ignored the changeset */
+	tags.clear(); /* We may have accumulated some tags even if we ignored the changeset */
     } else if (xmlStrEqual(name, BAD_CAST "add")) {
         action = ACTION_NONE;
     } else if (xmlStrEqual(name, BAD_CAST "create")) {
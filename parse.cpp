@@ -196,9 +196,8 @@ void parse_t::realloc_members()
 
 void parse_t::resetMembers()
 {
-  unsigned i;
-  for(i = 0; i < member_count; i++ )
-    free( members[i].role );
+  /* the roles are interned, so there is nothing to free */
+  member_count = 0;
 }
 
 void parse_t::printStatus()
@@ -4,7 +4,8 @@
 #include <time.h>
 #include <config.h>
 
-#include "keyvals.hpp"
+#include "taglist.hpp"
+#include "string-interner.hpp"
 #include "reprojection.hpp"
 #include "osmdata.hpp"
 
@@ -72,7 +73,7 @@ protected:
 	start tag and can therefore be cached.
 	*/
 	double node_lon, node_lat;
-	keyval tags;
+	taglist tags;
 	osmid_t *nds;
 	int nd_count, nd_max;
 	member *members;
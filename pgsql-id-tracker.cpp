@@ -1,12 +1,23 @@
 #include "pgsql-id-tracker.hpp"
 
 #include <libpq-fe.h>
+#include <stdlib.h>
+#include <cassert>
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
 #include <boost/format.hpp>
 
 #include "osmtypes.hpp"
 #include "pgsql.hpp"
-#include "util.hpp"
+
+/* marks are collected in memory and sent to the database with COPY once
+ * there are this many of them. */
+#define MARK_BUFFER_SIZE (65536)
+/* number of ids removed from the database in one go by pop_mark */
+#define POP_BATCH_SIZE (16384)
 
 struct pgsql_id_tracker::pimpl {
     pimpl(const std::string &conninfo,
@@ -15,10 +26,22 @@ struct pgsql_id_tracker::pimpl {
           bool owns_table);
     ~pimpl();
 
+    // send the buffered marks to the database
+    void flush();
+    // take the next batch of smallest ids out of the database
+    void fetch();
+
     PGconn *conn;
     std::string table_name;
     bool owns_table;
     osmid_t old_id;
+
+    // marks not yet copied to the database, in any order
+    std::vector<osmid_t> buffer;
+    // ids already removed from the database, sorted and unique. the ones
+    // from popped onwards haven't been handed out yet.
+    std::vector<osmid_t> batch;
+    size_t popped;
 };
 
 pgsql_id_tracker::pimpl::pimpl(const std::string &conninfo,
@@ -28,10 +51,11 @@ pgsql_id_tracker::pimpl::pimpl(const std::string &conninfo,
     : conn(PQconnectdb(conninfo.c_str())),
       table_name((boost::format("%1%_%2%") % prefix % type).str()),
       owns_table(owns_table_),
-      old_id(0) {
+      old_id(std::numeric_limits<osmid_t>::min()), buffer(), batch(), popped(0) {
     if (PQstatus(conn) != CONNECTION_OK) {
-        fprintf(stderr, "Connection to database failed: %s\n", PQerrorMessage(conn));
-        util::exit_nicely();
+        std::string err = (boost::format("Connection to database failed: %1%") % PQerrorMessage(conn)).str();
+        PQfinish(conn);
+        throw std::runtime_error(err);
     }
     if (owns_table) {
         pgsql_exec(conn, PGRES_COMMAND_OK,
@@ -40,34 +64,85 @@ pgsql_id_tracker::pimpl::pimpl(const std::string &conninfo,
         pgsql_exec(conn, PGRES_COMMAND_OK,
                    "CREATE TABLE \"%s\" (id " POSTGRES_OSMID_TYPE ")",
                    table_name.c_str());
+        pgsql_exec(conn, PGRES_COMMAND_OK,
+                   "CREATE INDEX ON \"%s\" (id)",
+                   table_name.c_str());
     }
-    pgsql_exec(conn, PGRES_COMMAND_OK,
-               "PREPARE set_mark(" POSTGRES_OSMID_TYPE ") AS INSERT INTO \"%s\" (id) "
-               "SELECT $1 WHERE NOT EXISTS (SELECT id FROM \"%s\" WHERE id = $1)",
-               table_name.c_str(), table_name.c_str());
+    buffer.reserve(MARK_BUFFER_SIZE);
     pgsql_exec(conn, PGRES_COMMAND_OK,
                "PREPARE get_mark(" POSTGRES_OSMID_TYPE ") AS SELECT id FROM \"%s\" "
-               "WHERE id = $1",
+               "WHERE id = $1 LIMIT 1",
                table_name.c_str());
+    /* The table may hold an id more than once, as marks are copied in
+     * without checking. Deleting by value removes every copy, and the
+     * duplicates that come back are dropped in fetch(). */
     pgsql_exec(conn, PGRES_COMMAND_OK,
-               "PREPARE get_min AS SELECT min(id) AS id FROM \"%s\"",
-               table_name.c_str());
-    pgsql_exec(conn, PGRES_COMMAND_OK,
-               "PREPARE drop_mark(" POSTGRES_OSMID_TYPE ") AS DELETE FROM \"%s\" "
-               "WHERE id = $1",
-               table_name.c_str());
+               "PREPARE pop_marks AS DELETE FROM \"%s\" WHERE id IN "
+               "(SELECT id FROM \"%s\" ORDER BY id LIMIT %d) RETURNING id",
+               table_name.c_str(), table_name.c_str(), POP_BATCH_SIZE);
     pgsql_exec(conn, PGRES_COMMAND_OK, "BEGIN");
 }
 
+/* Nothing here may throw, so the buffered marks aren't sent. Anything
+ * which should be kept has to be sent with commit() first. */
 pgsql_id_tracker::pimpl::~pimpl() {
-    if (conn) {
-        pgsql_exec(conn, PGRES_COMMAND_OK, "COMMIT");
-        if (owns_table) {
-            pgsql_exec(conn, PGRES_COMMAND_OK, "DROP TABLE \"%s\"", table_name.c_str());
-        }
-        PQfinish(conn);
+    if (owns_table) {
+        PQclear(PQexec(conn, "ROLLBACK"));
+        const std::string sql = (boost::format("DROP TABLE IF EXISTS \"%1%\"") % table_name).str();
+        PQclear(PQexec(conn, sql.c_str()));
+    }
+    PQfinish(conn);
+}
+
+void pgsql_id_tracker::pimpl::flush() {
+    if (buffer.empty()) {
+        return;
+    }
+
+    // don't send the same id twice in one go
+    std::sort(buffer.begin(), buffer.end());
+    buffer.erase(std::unique(buffer.begin(), buffer.end()), buffer.end());
+
+    pgsql_exec(conn, PGRES_COPY_IN, "COPY \"%s\" (id) FROM STDIN", table_name.c_str());
+
+    std::string data;
+    char tmp[32];
+    for (std::vector<osmid_t>::const_iterator itr = buffer.begin(); itr != buffer.end(); ++itr) {
+        snprintf(tmp, sizeof(tmp), "%" PRIdOSMID "\n", *itr);
+        data.append(tmp);
+    }
+    pgsql_CopyData(table_name.c_str(), conn, data.c_str());
+
+    if (PQputCopyEnd(conn, NULL) != 1) {
+        throw std::runtime_error((boost::format("stop COPY_END for %1% failed: %2%\n") % table_name % PQerrorMessage(conn)).str());
+    }
+    PGresult *res = PQgetResult(conn);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        PQclear(res);
+        throw std::runtime_error((boost::format("result COPY_END for %1% failed: %2%\n") % table_name % PQerrorMessage(conn)).str());
+    }
+    PQclear(res);
+
+    buffer.clear();
+}
+
+void pgsql_id_tracker::pimpl::fetch() {
+    flush();
+
+    batch.clear();
+    popped = 0;
+
+    PGresult *result = pgsql_execPrepared(conn, "pop_marks", 0, NULL, PGRES_TUPLES_OK);
+    const int count = PQntuples(result);
+    batch.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        batch.push_back(strtoosmid(PQgetvalue(result, i, 0), NULL, 10));
     }
-    conn = NULL;
+    PQclear(result);
+
+    // RETURNING doesn't keep the order of the sub-select
+    std::sort(batch.begin(), batch.end());
+    batch.erase(std::unique(batch.begin(), batch.end()), batch.end());
 }
 
 pgsql_id_tracker::pgsql_id_tracker(const std::string &conninfo,
@@ -82,17 +157,33 @@ pgsql_id_tracker::~pgsql_id_tracker() {
 }
 
 void pgsql_id_tracker::mark(osmid_t id) {
-    char tmp[16];
-    char const *paramValues[1];
-
-    snprintf(tmp, sizeof(tmp), "%" PRIdOSMID, id);
-    paramValues[0] = tmp;
+    // everything in the database is bigger than the current batch, so a
+    // smaller id has to go into the batch or it would be popped too late
+    if (impl->popped < impl->batch.size() && id <= impl->batch.back()) {
+        std::vector<osmid_t>::iterator itr =
+            std::lower_bound(impl->batch.begin() + impl->popped, impl->batch.end(), id);
+        if (itr == impl->batch.end() || *itr != id) {
+            impl->batch.insert(itr, id);
+        }
+    } else {
+        impl->buffer.push_back(id);
+        if (impl->buffer.size() >= MARK_BUFFER_SIZE) {
+            impl->flush();
+        }
+    }
 
-    pgsql_execPrepared(impl->conn, "set_mark", 1, paramValues, PGRES_COMMAND_OK);
+    // allow ids below the last popped one to be popped again
+    impl->old_id = std::numeric_limits<osmid_t>::min();
 }
 
 bool pgsql_id_tracker::is_marked(osmid_t id) {
-    char tmp[16];
+    if (std::binary_search(impl->batch.begin() + impl->popped, impl->batch.end(), id)) {
+        return true;
+    }
+
+    impl->flush();
+
+    char tmp[32];
     char const *paramValues[1] = {NULL};
     PGresult *result = NULL;
 
@@ -107,18 +198,12 @@ bool pgsql_id_tracker::is_marked(osmid_t id) {
 
 osmid_t pgsql_id_tracker::pop_mark() {
     osmid_t id = std::numeric_limits<osmid_t>::max();
-    PGresult *result = NULL;
 
-    result = pgsql_execPrepared(impl->conn, "get_min", 0, NULL, PGRES_TUPLES_OK);
-    if ((PQntuples(result) == 1) &&
-        (PQgetisnull(result, 0, 0) == 0)) {
-        id = strtoosmid(PQgetvalue(result, 0, 0), NULL, 10);
+    if (impl->popped == impl->batch.size()) {
+        impl->fetch();
     }
-
-    PQclear(result);
-
-    if (id != std::numeric_limits<osmid_t>::max()) {
-        unmark(id);
+    if (impl->popped < impl->batch.size()) {
+        id = impl->batch[impl->popped++];
     }
 
     assert((id > impl->old_id) || (id == std::numeric_limits<osmid_t>::max()));
@@ -127,25 +212,19 @@ osmid_t pgsql_id_tracker::pop_mark() {
     return id;
 }
 
-void pgsql_id_tracker::unmark(osmid_t id) {
-    char tmp[16];
-    char const *paramValues[1] = {NULL};
+size_t pgsql_id_tracker::size() {
+    impl->flush();
 
-    snprintf(tmp, sizeof(tmp), "%" PRIdOSMID, id);
-    paramValues[0] = tmp;
+    // the table can hold an id more than once, but never one of the batch
+    boost::shared_ptr<PGresult> result = pgsql_exec_simple(impl->conn, PGRES_TUPLES_OK,
+        (boost::format("SELECT count(DISTINCT id) FROM \"%1%\"") % impl->table_name).str());
+    const size_t stored = strtoul(PQgetvalue(result.get(), 0, 0), NULL, 10);
 
-    pgsql_execPrepared(impl->conn, "drop_mark", 1, paramValues, PGRES_COMMAND_OK);
+    return stored + (impl->batch.size() - impl->popped);
 }
 
 void pgsql_id_tracker::commit() {
-    if (impl->owns_table) {
-        pgsql_exec(impl->conn, PGRES_COMMAND_OK, "CREATE INDEX ON \"%s\" (id)", impl->table_name.c_str());
-    }
+    impl->flush();
     pgsql_exec(impl->conn, PGRES_COMMAND_OK, "COMMIT");
     pgsql_exec(impl->conn, PGRES_COMMAND_OK, "BEGIN");
 }
-
-void pgsql_id_tracker::force_release() {
-    impl->owns_table = false;
-    impl->conn = NULL;
-}
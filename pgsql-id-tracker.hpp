@@ -3,24 +3,27 @@
 
 #include "id-tracker.hpp"
 
+/* An id tracker whose marks are kept in a database table, for sets of
+ * pending ids which are too large to keep in memory. Marks are buffered
+ * and copied in, and popped in ordered batches. */
 struct pgsql_id_tracker : public id_tracker {
     pgsql_id_tracker(const std::string &conninfo,
                      const std::string &prefix,
                      const std::string &type,
                      bool owns_table);
+    // doesn't send anything, marks which weren't committed are lost
     ~pgsql_id_tracker();
 
     void mark(osmid_t id);
     bool is_marked(osmid_t id);
 
     osmid_t pop_mark();
+    size_t size();
 
+    // send the buffered marks and commit them, throws on failure
     void commit();
-    void force_release(); // to avoid brain-damages with fork()
 
 private:
-    void unmark(osmid_t id);
-
     struct pimpl;
     boost::scoped_ptr<pimpl> impl;
 };
@@ -1,5 +1,6 @@
 /* Helper functions for the postgresql connections */
 #include "pgsql.hpp"
+#include "text-scan.hpp"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,6 +15,13 @@ void escape(const char* src, std::string& dst)
     size_t length = strlen(src);
     for(size_t i = 0; i < length; ++i)
     {
+        //copy everything up to the next char which might need escaping at once
+        size_t plain = text_scan::plain_prefix(src + i, length - i);
+        dst.append(src + i, plain);
+        i += plain;
+        if (i == length)
+            break;
+
         switch(src[i]) {
             case '\\':  dst.append("\\\\"); break;
             //case 8:   dst.append("\\\b"); break;
@@ -39,7 +47,21 @@ void escape(char *out, const int len, const char *in)
     if (!len)
         return;
 
+    size_t length = strlen(in);
     while(*in && count < len-3) {
+        //copy everything up to the next char which might need escaping at once
+        size_t plain = text_scan::plain_prefix(in, length);
+        if (plain > (size_t)(len - 3 - count))
+            plain = len - 3 - count;
+        if (plain) {
+            memcpy(out, in, plain);
+            out += plain;
+            in += plain;
+            length -= plain;
+            count += plain;
+            continue;
+        }
+
         switch(*in) {
             case '\\': *out++ = '\\'; *out++ = '\\'; count+= 2; break;
                 /*    case    8: *out++ = '\\'; *out++ = '\b'; count+= 2; break; */
@@ -51,6 +73,7 @@ void escape(char *out, const int len, const char *in)
             default:   *out++ = *in; count++; break;
         }
         in++;
+        length--;
     }
     *out = '\0';
 
@@ -126,21 +149,35 @@ int pgsql_exec(PGconn *sql_conn, const ExecStatusType expect, const char *fmt, .
     return 0;
 }
 
+namespace {
+//at most the first 80 characters of the first line of COPY data
+std::string copy_excerpt(const char *sql)
+{
+    const size_t max_length = 80;
+    size_t length = strcspn(sql, "\n");
+    if (length <= max_length)
+        return std::string(sql, length);
+    return std::string(sql, max_length) + "...";
+}
+}
+
 void pgsql_CopyData(const char *context, PGconn *sql_conn, const char *sql)
 {
 #ifdef DEBUG_PGSQL
     fprintf(stderr, "%s>>> %s\n", context, sql );
 #endif
     int r = PQputCopyData(sql_conn, sql, strlen(sql));
+    //the data can be a whole COPY buffer of many rows, so it is left out
+    //of the message apart from the start of its first row
     switch(r)
     {
         //need to wait for write ready
         case 0:
-            throw std::runtime_error((boost::format("%1% - bad result during COPY, data %2%") % context % sql % PQerrorMessage(sql_conn)).str());
+            throw std::runtime_error((boost::format("%1% - bad result during COPY: %2%, data starts with %3%") % context % PQerrorMessage(sql_conn) % copy_excerpt(sql)).str());
             break;
         //error occurred
         case -1:
-            throw std::runtime_error((boost::format("%1%: %2% - bad result during COPY, data %3%") % PQerrorMessage(sql_conn) % context % sql).str());
+            throw std::runtime_error((boost::format("%1%: %2% - bad result during COPY, data starts with %3%") % PQerrorMessage(sql_conn) % context % copy_excerpt(sql)).str());
             break;
         //other possibility is 1 which means success
     }
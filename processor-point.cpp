@@ -1,7 +1,6 @@
 #include "processor-point.hpp"
 #include "util.hpp"
-
-#include <boost/format.hpp>
+#include "wkb.hpp"
 
 processor_point::processor_point(int srid, double scale)
     : geometry_processor(srid, "POINT", interest_node),
@@ -18,6 +17,6 @@ geometry_builder::maybe_wkt_t processor_point::process_node(double lat, double l
     lat = util::fix_to_double(util::double_to_fix(lat, m_scale), m_scale);
 #endif
     geometry_builder::maybe_wkt_t wkt(new geometry_builder::wkt_t());
-    wkt->geom = (boost::format("POINT(%.15g %.15g)") % lon % lat).str();
+    wkb::write_point(wkt->geom, lon, lat);
     return wkt;
 }
@@ -2,8 +2,9 @@
 
 #include <boost/format.hpp>
 
-processor_polygon::processor_polygon(int srid, bool enable_multi) : geometry_processor(srid, "GEOMETRY", interest_way | interest_relation), enable_multi(enable_multi)
+processor_polygon::processor_polygon(int srid, bool enable_multi, int threads) : geometry_processor(srid, "GEOMETRY", interest_way | interest_relation), enable_multi(enable_multi)
 {
+    builder.set_thread_count(threads);
 }
 
 processor_polygon::~processor_polygon()
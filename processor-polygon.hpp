@@ -4,7 +4,7 @@
 #include "geometry-processor.hpp"
 
 struct processor_polygon : public geometry_processor {
-    processor_polygon(int srid, bool enable_multi);
+    processor_polygon(int srid, bool enable_multi, int threads);
     virtual ~processor_polygon();
 
     geometry_builder::maybe_wkt_t process_way(const osmNode *nodes, const size_t node_count);
@@ -0,0 +1,107 @@
+#include "spatial-order.hpp"
+#include "reprojection.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#define ORDER_BITS (15)
+#define ORDER_SIZE (1 << ORDER_BITS)
+
+namespace {
+// only compare the ids so that a later key for the same id can be found
+struct id_less {
+    bool operator()(const std::pair<osmid_t, uint32_t> &a, const std::pair<osmid_t, uint32_t> &b) const {
+        return a.first < b.first;
+    }
+};
+} // anonymous namespace
+
+const uint32_t spatial_order::unknown_key = std::numeric_limits<uint32_t>::max();
+
+spatial_order::spatial_order()
+    : keys(), sorted(true) {
+}
+
+spatial_order::~spatial_order() {
+}
+
+void spatial_order::add(osmid_t id, uint32_t key) {
+    if (!keys.empty() && keys.back().first >= id) {
+        sorted = false;
+    }
+    keys.push_back(std::make_pair(id, key));
+}
+
+uint32_t spatial_order::get(osmid_t id) {
+    if (!sorted) {
+        sort();
+    }
+
+    std::vector<std::pair<osmid_t, uint32_t> >::const_iterator itr =
+        std::lower_bound(keys.begin(), keys.end(), std::make_pair(id, uint32_t(0)), id_less());
+
+    if ((itr != keys.end()) && (itr->first == id)) {
+        return itr->second;
+    }
+    return unknown_key;
+}
+
+void spatial_order::clear() {
+    keys.clear();
+    sorted = true;
+}
+
+size_t spatial_order::size() const {
+    return keys.size();
+}
+
+void spatial_order::sort() {
+    // in diff processing an id can be added more than once, the last
+    // position recorded wins.
+    std::stable_sort(keys.begin(), keys.end(), id_less());
+    std::vector<std::pair<osmid_t, uint32_t> >::iterator out = keys.begin();
+    for (std::vector<std::pair<osmid_t, uint32_t> >::iterator itr = keys.begin(); itr != keys.end(); ++itr) {
+        if ((out != keys.begin()) && ((out - 1)->first == itr->first)) {
+            (out - 1)->second = itr->second;
+        } else {
+            *out++ = *itr;
+        }
+    }
+    keys.erase(out, keys.end());
+    sorted = true;
+}
+
+uint32_t spatial_order::location_key(reprojection *proj, double lon, double lat) {
+    double tile_x, tile_y;
+    proj->coords_to_tile(&tile_x, &tile_y, lon, lat, ORDER_SIZE);
+
+    //clamp anything outside the tile extent onto its edge
+    const uint32_t x = std::max(0, std::min(ORDER_SIZE - 1, int(tile_x)));
+    const uint32_t y = std::max(0, std::min(ORDER_SIZE - 1, int(tile_y)));
+
+    return hilbert_key(x, y);
+}
+
+/* Classic conversion of a grid cell to its distance along the hilbert
+ * curve, rotating the quadrant at each level. Neighbouring distances are
+ * always neighbouring cells, which is what keeps the node lookups local. */
+uint32_t spatial_order::hilbert_key(uint32_t x, uint32_t y) {
+    uint32_t d = 0;
+
+    for (uint32_t s = ORDER_SIZE / 2; s > 0; s /= 2) {
+        const uint32_t rx = (x & s) > 0;
+        const uint32_t ry = (y & s) > 0;
+        d += s * s * ((3 * rx) ^ ry);
+
+        //rotate the quadrant
+        if (ry == 0) {
+            if (rx == 1) {
+                x = s - 1 - (x & (s - 1));
+                y = s - 1 - (y & (s - 1));
+            }
+            std::swap(x, y);
+        }
+    }
+
+    return d;
+}
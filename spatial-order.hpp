@@ -0,0 +1,52 @@
+/* Spatial sort keys for pending objects.
+ *
+ * Pending ways are normally handed to the worker threads in ID order,
+ * which correlates only loosely with their location. This keeps a coarse
+ * Hilbert curve index of each pending way's position so the jobs can be
+ * sorted before processing, meaning consecutive jobs touch neighbouring
+ * node cache blocks.
+ */
+
+#ifndef SPATIAL_ORDER_HPP
+#define SPATIAL_ORDER_HPP
+
+#include "osmtypes.hpp"
+
+#include <vector>
+#include <boost/noncopyable.hpp>
+
+struct reprojection;
+
+struct spatial_order : public boost::noncopyable {
+    // key returned for ids which were never added. sorts after everything
+    // else so that those jobs keep their ID order at the end of the queue.
+    static const uint32_t unknown_key;
+
+    spatial_order();
+    ~spatial_order();
+
+    // record the key for an id. ids are expected to arrive mostly in
+    // increasing order, as they do when parsing a file.
+    void add(osmid_t id, uint32_t key);
+
+    // look up the key for an id, or unknown_key if it was never added.
+    uint32_t get(osmid_t id);
+
+    void clear();
+    size_t size() const;
+
+    // the hilbert index of the given (target projection) coordinate on a
+    // grid of zoom level 15 tiles.
+    static uint32_t location_key(reprojection *proj, double lon, double lat);
+
+    // the hilbert index of a cell on a 2^15 x 2^15 grid.
+    static uint32_t hilbert_key(uint32_t x, uint32_t y);
+
+private:
+    void sort();
+
+    std::vector<std::pair<osmid_t, uint32_t> > keys;
+    bool sorted;
+};
+
+#endif /* SPATIAL_ORDER_HPP */
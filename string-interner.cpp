@@ -0,0 +1,170 @@
+/* Table of interned strings, see string-interner.hpp */
+
+#include "string-interner.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdexcept>
+
+string_interner::shard::shard()
+    : mutex(), slots(64), count(0), text_blocks(), text_pos(NULL), text_left(0) {
+    memset(index, 0, sizeof(index));
+}
+
+string_interner::string_interner() {
+}
+
+string_interner::~string_interner() {
+    for (int i = 0; i < shard_count; ++i) {
+        shard &s = m_shards[i];
+        for (int b = 0; b < index_blocks; ++b) {
+            delete [] s.index[b];
+        }
+        for (size_t b = 0; b < s.text_blocks.size(); ++b) {
+            free(s.text_blocks[b]);
+        }
+    }
+}
+
+// FNV-1a, the low bits pick the shard and the rest the slot
+uint32_t string_interner::hash(const char *str, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)str[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+size_t string_interner::lookup(const shard &s, const char *str, size_t len, uint32_t hash) {
+    const size_t mask = s.slots.size() - 1;
+    for (size_t pos = (hash >> shard_bits) & mask; ; pos = (pos + 1) & mask) {
+        const slot &sl = s.slots[pos];
+        if (sl.index == 0) {
+            return pos;
+        }
+        if (sl.hash == hash) {
+            const uint32_t i = sl.index - 1;
+            const char *text = s.index[i >> index_bits][i & ((1 << index_bits) - 1)];
+            uint32_t text_len;
+            memcpy(&text_len, text - sizeof(text_len), sizeof(text_len));
+            if (text_len == len && memcmp(text, str, len) == 0) {
+                return pos;
+            }
+        }
+    }
+}
+
+// keep the table at most half full, so that probes stay short
+void string_interner::grow(shard &s) {
+    std::vector<slot> old(s.slots.size() * 2);
+    old.swap(s.slots);
+    const size_t mask = s.slots.size() - 1;
+    for (size_t i = 0; i < old.size(); ++i) {
+        if (old[i].index == 0) {
+            continue;
+        }
+        size_t pos = (old[i].hash >> shard_bits) & mask;
+        while (s.slots[pos].index != 0) {
+            pos = (pos + 1) & mask;
+        }
+        s.slots[pos] = old[i];
+    }
+}
+
+// copies the string into the shard's text blocks, after its length
+const char *string_interner::store(shard &s, const char *str, size_t len) {
+    const uint32_t len32 = len;
+    const size_t bytes = sizeof(len32) + len + 1;
+    if (bytes > s.text_left) {
+        const size_t block = (bytes > text_block_size) ? bytes : size_t(text_block_size);
+        char *mem = (char *)malloc(block);
+        if (!mem) {
+            throw std::bad_alloc();
+        }
+        s.text_blocks.push_back(mem);
+        s.text_pos = mem;
+        s.text_left = block;
+    }
+    char *text = s.text_pos + sizeof(len32);
+    memcpy(s.text_pos, &len32, sizeof(len32));
+    memcpy(text, str, len);
+    text[len] = '\0';
+    s.text_pos += bytes;
+    s.text_left -= bytes;
+    return text;
+}
+
+string_interner::handle string_interner::intern(const char *str) {
+    return intern(str, strlen(str));
+}
+
+string_interner::handle string_interner::intern(const char *str, size_t len) {
+    const uint32_t h = hash(str, len);
+    const int shard_no = h & (shard_count - 1);
+    shard &s = m_shards[shard_no];
+
+    boost::mutex::scoped_lock lock(s.mutex);
+    size_t pos = lookup(s, str, len, h);
+    if (s.slots[pos].index == 0) {
+        const uint32_t i = s.count;
+        if (i >= uint32_t(index_blocks) << index_bits) {
+            throw std::runtime_error("Too many distinct strings to intern.");
+        }
+        const char **&block = s.index[i >> index_bits];
+        if (!block) {
+            block = new const char *[1 << index_bits];
+        }
+        block[i & ((1 << index_bits) - 1)] = store(s, str, len);
+        ++s.count;
+
+        if (s.count * 2 > s.slots.size()) {
+            grow(s);
+            pos = lookup(s, str, len, h);
+        }
+        s.slots[pos].hash = h;
+        s.slots[pos].index = i + 1;
+    }
+    return ((s.slots[pos].index - 1) << shard_bits) | shard_no;
+}
+
+bool string_interner::find(const char *str, size_t len, handle *result) const {
+    const uint32_t h = hash(str, len);
+    const int shard_no = h & (shard_count - 1);
+    const shard &s = m_shards[shard_no];
+
+    boost::mutex::scoped_lock lock(s.mutex);
+    const slot &sl = s.slots[lookup(s, str, len, h)];
+    if (sl.index == 0) {
+        return false;
+    }
+    *result = ((sl.index - 1) << shard_bits) | shard_no;
+    return true;
+}
+
+const char *string_interner::get(handle h) const {
+    const shard &s = m_shards[h & (shard_count - 1)];
+    const handle i = h >> shard_bits;
+    return s.index[i >> index_bits][i & ((1 << index_bits) - 1)];
+}
+
+size_t string_interner::size() const {
+    size_t total = 0;
+    for (int i = 0; i < shard_count; ++i) {
+        boost::mutex::scoped_lock lock(m_shards[i].mutex);
+        total += m_shards[i].count;
+    }
+    return total;
+}
+
+// constructed on first use, so that they exist before anything static
+// which uses them
+string_interner &interned_keys() {
+    static string_interner table;
+    return table;
+}
+
+string_interner &interned_roles() {
+    static string_interner table;
+    return table;
+}
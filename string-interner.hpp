@@ -0,0 +1,87 @@
+/* Table of interned strings.
+ *
+ * Each distinct string is stored once, for the life of the table, and
+ * gets a small integer handle, so that strings which repeat throughout
+ * the data like tag keys and member roles can be compared by handle or
+ * by pointer. The strings live in large blocks instead of being allocated
+ * one by one, and are found with open addressing on a hash computed once
+ * per lookup. The table is split into shards which are locked on their
+ * own, so threads interning at the same time rarely wait on each other,
+ * and the text of a handle can be read without taking any lock.
+*/
+
+#ifndef STRING_INTERNER_H
+#define STRING_INTERNER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+class string_interner : public boost::noncopyable {
+public:
+    typedef unsigned int handle;
+
+    string_interner();
+    ~string_interner();
+
+    // the handle of the string, which is added if it is new
+    handle intern(const char *str);
+    handle intern(const char *str, size_t len);
+
+    // the stored copy of the string, which is added if it is new
+    const char *text(const char *str) { return get(intern(str)); }
+    const char *text(const char *str, size_t len) { return get(intern(str, len)); }
+
+    // looks the string up without adding it
+    bool find(const char *str, size_t len, handle *h) const;
+
+    // the text of a handle, which stays where it is until the table goes
+    const char *get(handle h) const;
+
+    size_t size() const;
+
+private:
+    enum {
+        shard_bits = 4,
+        shard_count = 1 << shard_bits,
+        index_bits = 12,                    // strings per index block
+        index_blocks = 1 << 12,             // index blocks per shard
+        text_block_size = 64 * 1024
+    };
+
+    struct slot {
+        uint32_t hash;
+        uint32_t index;                     // one more than the string's index, 0 if unused
+    };
+
+    struct shard {
+        shard();
+
+        mutable boost::mutex mutex;
+        std::vector<slot> slots;
+        uint32_t count;
+        // the strings by index, in blocks which are allocated as needed
+        // and never move, so readers don't have to lock
+        const char **index[index_blocks];
+        std::vector<char *> text_blocks;
+        char *text_pos;
+        size_t text_left;
+    };
+
+    static uint32_t hash(const char *str, size_t len);
+
+    // the position of the string's slot, or of the empty slot where it belongs
+    static size_t lookup(const shard &s, const char *str, size_t len, uint32_t hash);
+    static void grow(shard &s);
+    static const char *store(shard &s, const char *str, size_t len);
+
+    shard m_shards[shard_count];
+};
+
+// tables shared by the whole program
+string_interner &interned_keys();
+string_interner &interned_roles();
+
+#endif
@@ -119,6 +119,18 @@ function filter_tags_way (keyvalues, nokeys)
    return filter, keyvalues, poly, roads
 end
 
+function filter_tags_way_batch (keyvaluelist, nokeyslist, waycount)
+   filters = {}
+   polys = {}
+   roadslist = {}
+
+   for i = 1, waycount do
+      filters[i], keyvaluelist[i], polys[i], roadslist[i] = filter_tags_way(keyvaluelist[i], nokeyslist[i])
+   end
+
+   return filters, keyvaluelist, polys, roadslist
+end
+
 function filter_tags_relation_member (keyvalues, keyvaluemembers, roles, membercount)
    
    filter = 0
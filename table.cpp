@@ -1,21 +1,25 @@
 #include "table.hpp"
 #include "options.hpp"
+#include "string-interner.hpp"
+#include "text-scan.hpp"
 #include "util.hpp"
+#include "wkb.hpp"
 
 #include <string.h>
+#include <algorithm>
 #include <utility>
 
 using std::string;
 
-#define BUFFER_SEND_SIZE 1024
-
 
 table_t::table_t(const string& conninfo, const string& name, const string& type, const columns_t& columns, const hstores_t& hstore_columns,
     const int srid, const int scale, const bool append, const bool slim, const bool drop_temp, const int hstore_mode,
-    const bool enable_hstore_index, const boost::optional<string>& table_space, const boost::optional<string>& table_space_index) :
+    const bool enable_hstore_index, const boost::optional<string>& table_space, const boost::optional<string>& table_space_index,
+    const size_t copy_buffer_size) :
     conninfo(conninfo), name(name), type(type), sql_conn(NULL), copyMode(false), srid((fmt("%1%") % srid).str()), scale(scale),
     append(append), slim(slim), drop_temp(drop_temp), hstore_mode(hstore_mode), enable_hstore_index(enable_hstore_index),
-    columns(columns), hstore_columns(hstore_columns), table_space(table_space), table_space_index(table_space_index)
+    columns(columns), hstore_columns(hstore_columns), table_space(table_space), table_space_index(table_space_index),
+    copy_buffer_size(copy_buffer_size), sender(name)
 {
     //if we dont have any columns
     if(columns.size() == 0)
@@ -26,23 +30,28 @@ table_t::table_t(const string& conninfo, const string& name, const string& type,
 
     //we use these a lot, so instead of constantly allocating them we predefine these
     single_fmt = fmt("%1%");
-    point_fmt = fmt("POINT(%.15g %.15g)");
     del_fmt = fmt("DELETE FROM %1% WHERE osm_id = %2%");
+
+    init_columns();
 }
 
 table_t::table_t(const table_t& other):
     conninfo(other.conninfo), name(other.name), type(other.type), sql_conn(NULL), copyMode(false), buffer(), srid(other.srid), scale(other.scale),
     append(other.append), slim(other.slim), drop_temp(other.drop_temp), hstore_mode(other.hstore_mode), enable_hstore_index(other.enable_hstore_index),
     columns(other.columns), hstore_columns(other.hstore_columns), copystr(other.copystr), table_space(other.table_space),
-    table_space_index(other.table_space_index), single_fmt(other.single_fmt), point_fmt(other.point_fmt), del_fmt(other.del_fmt)
+    table_space_index(other.table_space_index), single_fmt(other.single_fmt), del_fmt(other.del_fmt),
+    copy_buffer_size(other.copy_buffer_size), sender(other.name)
 {
+    init_columns();
+
     // if the other table has already started, then we want to execute
     // the same stuff to get into the same state. but if it hasn't, then
     // this would be premature.
     if (other.sql_conn) {
         connect();
         //let postgres cache this query as it will presumably happen a lot
-        pgsql_exec_simple(sql_conn, PGRES_COMMAND_OK, (fmt("PREPARE get_wkt (" POSTGRES_OSMID_TYPE ") AS SELECT ST_AsText(way) FROM %1% WHERE osm_id = $1") % name).str());
+        pgsql_exec_simple(sql_conn, PGRES_COMMAND_OK, (fmt("PREPARE delete_wkt (" POSTGRES_OSMID_TYPE ", float8) AS DELETE FROM %1% WHERE osm_id = $1 "
+                                                           "RETURNING COALESCE(ST_Simplify(way, $2), ST_Envelope(way))") % name).str());
         //start the copy
         begin();
         pgsql_exec_simple(sql_conn, PGRES_COPY_IN, copystr);
@@ -55,12 +64,30 @@ table_t::~table_t()
     teardown();
 }
 
+void table_t::init_columns()
+{
+    //tag keys are interned, so the key's text is enough to find its column
+    for(size_t i = 0; i < columns.size(); ++i)
+        column_index.insert(std::make_pair(interned_keys().text(columns[i].first.c_str()), i));
+    z_order_key = interned_keys().text("z_order");
+
+    null_columns.clear();
+    for(size_t i = 0; i < columns.size(); ++i)
+        null_columns.append("\\N\t");
+
+    column_tags.resize(columns.size());
+    hstore_tags.resize(hstore_columns.size());
+}
+
 std::string const& table_t::get_name() {
     return name;
 }
 
 void table_t::teardown()
 {
+    //the sender must be done with the connection before it goes away
+    sender.stop();
+
     if(sql_conn != NULL)
     {
         PQfinish(sql_conn);
@@ -184,7 +211,8 @@ void table_t::start()
     }
 
     //let postgres cache this query as it will presumably happen a lot
-    pgsql_exec_simple(sql_conn, PGRES_COMMAND_OK, (fmt("PREPARE get_wkt (" POSTGRES_OSMID_TYPE ") AS SELECT ST_AsText(way) FROM %1% WHERE osm_id = $1") % name).str());
+    pgsql_exec_simple(sql_conn, PGRES_COMMAND_OK, (fmt("PREPARE delete_wkt (" POSTGRES_OSMID_TYPE ", float8) AS DELETE FROM %1% WHERE osm_id = $1 "
+                                                       "RETURNING COALESCE(ST_Simplify(way, $2), ST_Envelope(way))") % name).str());
 
     //generate column list for COPY
     string cols = "osm_id,";
@@ -270,8 +298,12 @@ void table_t::stop_copy()
     //we werent copying anyway
     if(!copyMode)
         return;
+
+    //let the sender finish whatever it has, this also reports its errors
+    sender.wait();
+
     //if there is stuff left over in the copy buffer send it offand copy it before we stop
-    else if(buffer.length() != 0)
+    if(buffer.length() != 0)
     {
         pgsql_CopyData(name.c_str(), sql_conn, buffer.c_str());
         buffer.clear();
@@ -293,7 +325,7 @@ void table_t::stop_copy()
     copyMode = false;
 }
 
-void table_t::write_node(const osmid_t id, struct keyval *tags, double lat, double lon)
+std::string table_t::point_wkb(double lat, double lon) const
 {
 #ifdef FIXED_POINT
     // guarantee that we use the same values as in the node cache
@@ -301,7 +333,19 @@ void table_t::write_node(const osmid_t id, struct keyval *tags, double lat, doub
     lat = util::fix_to_double(util::double_to_fix(lat, scale), scale);
 #endif
 
-    write_wkt(id, tags, (point_fmt % lon % lat).str().c_str());
+    std::string wkb;
+    wkb::write_point(wkb, lon, lat);
+    return wkb;
+}
+
+void table_t::write_node(const osmid_t id, struct keyval *tags, double lat, double lon)
+{
+    write_wkt(id, tags, point_wkb(lat, lon).c_str());
+}
+
+void table_t::write_node(const osmid_t id, const taglist &tags, double lat, double lon)
+{
+    write_wkt(id, tags, point_wkb(lat, lon).c_str());
 }
 
 void table_t::delete_row(const osmid_t id)
@@ -311,20 +355,31 @@ void table_t::delete_row(const osmid_t id)
 }
 
 void table_t::write_wkt(const osmid_t id, struct keyval *tags, const char *wkt)
+{
+    clear_row_tags();
+    for (keyval* xtags = tags->next; xtags->key != NULL; xtags = xtags->next)
+        add_row_tag(xtags->key, xtags->value);
+    write_row(id, wkt);
+}
+
+void table_t::write_wkt(const osmid_t id, const taglist &tags, const char *wkt)
+{
+    clear_row_tags();
+    //backwards, which is the order the same tags have in a keyval list
+    //made by taglist::to_keyval, so both give the same rows
+    for (size_t i = tags.size(); i-- > 0; )
+        add_row_tag(tags.key(i), tags.value(i));
+    write_row(id, wkt);
+}
+
+void table_t::write_row(const osmid_t id, const char *wkt)
 {
     //add the osm id
     buffer.append((single_fmt % id).str());
     buffer.push_back('\t');
 
-    //get the regular columns' values
-    write_columns(tags, buffer);
-
-    //get the hstore columns' values
-    write_hstore_columns(tags, buffer);
-
-    //get the key value pairs for the tags column
-    if (hstore_mode != HSTORE_NONE)
-        write_tags_column(tags, buffer);
+    //get the regular, hstore and tags columns' values
+    write_tags(buffer);
 
     //give the wkt an srid
     buffer.append("SRID=");
@@ -343,102 +398,106 @@ void table_t::write_wkt(const osmid_t id, struct keyval *tags, const char *wkt)
     }
 
     //send all the data to postgres
-    if(buffer.length() > BUFFER_SEND_SIZE)
-    {
-        pgsql_CopyData(name.c_str(), sql_conn, buffer.c_str());
-        buffer.clear();
-    }
+    if(buffer.length() > copy_buffer_size)
+        sender.send(sql_conn, buffer);
 }
 
-void table_t::write_columns(keyval *tags, string& values)
+void table_t::clear_row_tags()
 {
-    //for each column
-    for(columns_t::const_iterator column = columns.begin(); column != columns.end(); ++column)
-    {
-        keyval *tag = NULL;
-        if ((tag = keyval::getTag(tags, column->first.c_str())))
-        {
-            escape_type(tag->value, column->second.c_str(), values);
-            //remember we already used this one so we cant use again later in the hstore column
-            if (hstore_mode == HSTORE_NORM)
-                tag->has_column = 1;
-        }
-        else
-            values.append("\\N");
-        values.push_back('\t');
-    }
+    std::fill(column_tags.begin(), column_tags.end(), (const char *)NULL);
+    for(size_t i = 0; i < hstore_tags.size(); ++i)
+        hstore_tags[i].clear();
+    tags_column.clear();
 }
 
-void table_t::write_tags_column(keyval *tags, std::string& values)
+//sort a tag into the columns it goes to, the key must be interned
+void table_t::add_row_tag(const char *key, const char *value)
 {
-    //iterate through the list of tags, first one is always null
-    bool added = false;
-    for (keyval* xtags = tags->next; xtags->key != NULL; xtags = xtags->next)
+    bool has_column = false;
+    column_index_t::const_iterator column = column_index.find(key);
+    if (column != column_index.end() && column_tags[column->second] == NULL)
     {
-        //skip z_order tag and keys which have their own column
-        if ((xtags->has_column) || (strcmp("z_order", xtags->key) == 0))
-            continue;
-
-        //hstore ASCII representation looks like "key"=>"value"
-        if(added)
-            values.push_back(',');
-        escape4hstore(xtags->key, values);
-        values.append("=>");
-        escape4hstore(xtags->value, values);
+        column_tags[column->second] = value;
+        //remember we already used this one so we cant use again later in the hstore column
+        has_column = (hstore_mode == HSTORE_NORM);
+    }
 
-        //we did at least one so we need commas from here on out
-        added = true;
+    //check if the tag's key starts with the name of the hstore column
+    for(size_t i = 0; i < hstore_columns.size(); ++i)
+    {
+        if (strncmp(key, hstore_columns[i].c_str(), hstore_columns[i].size()) == 0)
+            hstore_tags[i].push_back(row_tag_t(key, value));
     }
 
-    //finish the hstore column by placing a TAB into the data stream
-    values.push_back('\t');
+    //skip z_order tag and keys which have their own column
+    if (hstore_mode != HSTORE_NONE && !has_column && key != z_order_key)
+        tags_column.push_back(row_tag_t(key, value));
 }
 
-/* write an hstore column to the database */
-void table_t::write_hstore_columns(keyval *tags, std::string& values)
+void table_t::write_tags(string& values)
 {
-    //iterate over all configured hstore columns in the options
-    for(hstores_t::const_iterator hstore_column = hstore_columns.begin(); hstore_column != hstore_columns.end(); ++hstore_column)
+    //the regular columns, copying runs of empty ones in one go
+    size_t empty = 0;
+    for(size_t i = 0; i < columns.size(); ++i)
     {
-        //a clone of the tags pointer
-        bool added = false;
-
-        //iterate through the list of tags, first one is always null
-        for (keyval* xtags = tags->next; xtags->key != NULL; xtags = xtags->next)
+        if (column_tags[i] == NULL)
         {
-            //check if the tag's key starts with the name of the hstore column
-            if(hstore_column->find(xtags->key) == 0)
-            {
-                //generate the short key name, somehow pointer arithmetic works against this member of the keyval data structure...
-                char* shortkey = xtags->key + hstore_column->size();
-
-                //and pack the shortkey with its value into the hstore
-                //hstore ASCII representation looks like "key"=>"value"
-                if(added)
-                    values.push_back(',');
-                escape4hstore(shortkey, values);
-                values.append("=>");
-                escape4hstore(xtags->value, values);
-
-                //we did at least one so we need commas from here on out
-                added = true;
-            }
+            ++empty;
+            continue;
+        }
+        if (empty)
+        {
+            values.append(null_columns, 0, empty * 3);
+            empty = 0;
         }
+        escape_type(column_tags[i], columns[i].second.c_str(), values);
+        values.push_back('\t');
+    }
+    values.append(null_columns, 0, empty * 3);
 
-        //if you found not matching tags write a NULL
-        if(!added)
+    //the hstore columns hold the tags with their prefix taken off, or NULL
+    for(size_t i = 0; i < hstore_columns.size(); ++i)
+    {
+        if (hstore_tags[i].empty())
             values.append("\\N");
+        else
+            write_hstore(hstore_tags[i], hstore_columns[i].size(), values);
+        values.push_back('\t');
+    }
 
-        //finish the column off with a tab
+    if (hstore_mode != HSTORE_NONE)
+    {
+        write_hstore(tags_column, 0, values);
         values.push_back('\t');
     }
 }
 
+void table_t::write_hstore(const std::vector<row_tag_t>& tags, size_t prefix_len, string& values)
+{
+    for(size_t i = 0; i < tags.size(); ++i)
+    {
+        //hstore ASCII representation looks like "key"=>"value"
+        if (i > 0)
+            values.push_back(',');
+        escape4hstore(tags[i].first + prefix_len, values);
+        values.append("=>");
+        escape4hstore(tags[i].second, values);
+    }
+}
+
 //create an escaped version of the string for hstore table insert
 void table_t::escape4hstore(const char *src, string& dst)
 {
     dst.push_back('"');
-    for (size_t i = 0; i < strlen(src); ++i) {
+    const size_t length = strlen(src);
+    for (size_t i = 0; i < length; ++i) {
+        //copy everything up to the next char which needs escaping at once
+        const size_t plain = text_scan::plain_prefix(src + i, length - i);
+        dst.append(src + i, plain);
+        i += plain;
+        if (i == length)
+            break;
+
         switch (src[i]) {
             case '\\':
                 dst.append("\\\\\\\\");
@@ -513,19 +572,22 @@ void table_t::escape_type(const char *value, const char *type, string& dst) {
         escape(value, dst);
 }
 
-boost::shared_ptr<table_t::wkt_reader> table_t::get_wkt_reader(const osmid_t id)
+boost::shared_ptr<table_t::wkt_reader> table_t::delete_wkt_reader(const osmid_t id, const double tolerance)
 {
-    //cant get wkt using the prepared statement without stopping the copy first
+    //cant delete using the prepared statement without stopping the copy first
     stop_copy();
 
-    char const *paramValues[1];
+    char const *paramValues[2];
     char tmp[16];
+    char tmp2[32];
     snprintf(tmp, sizeof(tmp), "%" PRIdOSMID, id);
+    snprintf(tmp2, sizeof(tmp2), "%.17g", tolerance);
     paramValues[0] = tmp;
+    paramValues[1] = tmp2;
 
-    //the prepared statement get_wkt will behave differently depending on the sql_conn
-    //each table has its own sql_connection with the get_way referring to the appropriate table
-    PGresult* res = pgsql_execPrepared(sql_conn, "get_wkt", 1, (const char * const *)paramValues, PGRES_TUPLES_OK);
+    //the prepared statement delete_wkt will behave differently depending on the sql_conn
+    //each table has its own sql_connection with the delete_wkt referring to the appropriate table
+    PGresult* res = pgsql_execPrepared(sql_conn, "delete_wkt", 2, (const char * const *)paramValues, PGRES_TUPLES_OK);
     return boost::shared_ptr<wkt_reader>(new wkt_reader(res));
 }
 
@@ -1,15 +1,18 @@
 #ifndef TABLE_H
 #define TABLE_H
 
+#include "copy-sender.hpp"
 #include "keyvals.hpp"
 #include "pgsql.hpp"
 #include "osmtypes.hpp"
+#include "taglist.hpp"
 
 #include <string>
 #include <vector>
 
 #include <boost/optional.hpp>
 #include <boost/format.hpp>
+#include <boost/unordered_map.hpp>
 
 typedef std::vector<std::string> hstores_t;
 typedef std::vector<std::pair<std::string, std::string> > columns_t;
@@ -20,7 +23,8 @@ class table_t
     public:
         table_t(const std::string& conninfo, const std::string& name, const std::string& type, const columns_t& columns, const hstores_t& hstore_columns, const int srid,
                 const int scale, const bool append, const bool slim, const bool droptemp, const int hstore_mode, const bool enable_hstore_index,
-                const boost::optional<std::string>& table_space, const boost::optional<std::string>& table_space_index);
+                const boost::optional<std::string>& table_space, const boost::optional<std::string>& table_space_index,
+                const size_t copy_buffer_size);
         table_t(const table_t& other);
         ~table_t();
 
@@ -31,12 +35,14 @@ class table_t
         void commit();
 
         void write_wkt(const osmid_t id, struct keyval *tags, const char *wkt);
+        void write_wkt(const osmid_t id, const taglist &tags, const char *wkt);
         void write_node(const osmid_t id, struct keyval *tags, double lat, double lon);
+        void write_node(const osmid_t id, const taglist &tags, double lat, double lon);
         void delete_row(const osmid_t id);
 
         std::string const& get_name();
 
-        //interface from retrieving well known text geometry from the table
+        //interface for retrieving the geometries of deleted rows, as hex EWKB
         struct wkt_reader
         {
             friend class table_t;
@@ -51,16 +57,25 @@ class table_t
                 size_t count;
                 size_t current;
         };
-        boost::shared_ptr<wkt_reader> get_wkt_reader(const osmid_t id);
+        //deletes the rows of an object, returning their geometries simplified
+        //to within tolerance (in the units of the table's projection)
+        boost::shared_ptr<wkt_reader> delete_wkt_reader(const osmid_t id, const double tolerance);
 
     protected:
         void connect();
         void stop_copy();
         void teardown();
 
-        void write_columns(struct keyval *tags, std::string& values);
-        void write_tags_column(keyval *tags, std::string& values);
-        void write_hstore_columns(keyval *tags, std::string& values);
+        //a tag of the row being written, pointing into the caller's tags
+        typedef std::pair<const char *, const char *> row_tag_t;
+
+        void init_columns();
+        std::string point_wkb(double lat, double lon) const;
+        void clear_row_tags();
+        void add_row_tag(const char *key, const char *value);
+        void write_row(const osmid_t id, const char *wkt);
+        void write_tags(std::string& values);
+        void write_hstore(const std::vector<row_tag_t>& tags, size_t prefix_len, std::string& values);
 
         void escape4hstore(const char *src, std::string& dst);
         void escape_type(const char *value, const char *type, std::string& dst);
@@ -84,7 +99,24 @@ class table_t
         boost::optional<std::string> table_space;
         boost::optional<std::string> table_space_index;
 
-        fmt single_fmt, point_fmt, del_fmt;
+        //the column of each key, by the key's interned text, so the tags
+        //of a row are sorted into their columns in one pass over them
+        typedef boost::unordered_map<const char *, size_t> column_index_t;
+        column_index_t column_index;
+        const char *z_order_key;
+        //a \N and a tab for every column, runs of empty columns are copied from it
+        std::string null_columns;
+        //the tags of the row being written, by column
+        std::vector<const char *> column_tags;
+        std::vector<std::vector<row_tag_t> > hstore_tags;
+        std::vector<row_tag_t> tags_column;
+
+        fmt single_fmt, del_fmt;
+
+        //COPY data is collected in buffer and handed over to the sender
+        //once it is large enough, so writing rows doesn't wait on the database
+        size_t copy_buffer_size;
+        copy_sender sender;
 };
 
 #endif
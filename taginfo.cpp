@@ -1,8 +1,11 @@
 #include "taginfo_impl.hpp"
 #include "table.hpp"
 #include "util.hpp"
+#include "wildcmp.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <cctype>
 #include <cstring>
 #include <stdexcept>
 #include <boost/format.hpp>
@@ -46,18 +49,111 @@ taginfo::taginfo(const taginfo &other)
       flags(other.flags) {
 }
 
+namespace {
+
+size_t hash_folded(const char *str, size_t len) {
+    size_t seed = 0;
+    for (size_t i = 0; i < len; ++i) {
+        boost::hash_combine(seed, toupper((unsigned char)str[i]));
+    }
+    return seed;
+}
+
+bool equal_folded(const char *a, size_t a_len, const std::string &b) {
+    if (a_len != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a_len; ++i) {
+        if (toupper((unsigned char)a[i]) != toupper((unsigned char)b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+size_t tag_matcher::key_hash::operator()(const std::string &key) const {
+    return hash_folded(key.data(), key.size());
+}
+
+size_t tag_matcher::key_hash::operator()(const key_ref &key) const {
+    return hash_folded(key.str, key.len);
+}
+
+bool tag_matcher::key_equal::operator()(const std::string &a, const std::string &b) const {
+    return equal_folded(a.data(), a.size(), b);
+}
+
+bool tag_matcher::key_equal::operator()(const key_ref &a, const std::string &b) const {
+    return equal_folded(a.str, a.len, b);
+}
+
+tag_matcher::tag_matcher()
+    : count(0), exact(), prefixes(), prefix_lengths() {
+}
+
+void tag_matcher::add(const std::string &name) {
+    const int index = count++;
+    const size_t wildcard = name.find_first_of("*?");
+
+    if (wildcard == std::string::npos) {
+        // only the first of several entries for the same key can match
+        exact.insert(std::make_pair(name, index));
+    } else {
+        prefixes[name.substr(0, wildcard)].push_back(std::make_pair(index, name));
+        if (std::find(prefix_lengths.begin(), prefix_lengths.end(), wildcard) == prefix_lengths.end()) {
+            prefix_lengths.insert(std::lower_bound(prefix_lengths.begin(), prefix_lengths.end(), wildcard), wildcard);
+        }
+    }
+}
+
+int tag_matcher::find(const char *key) const {
+    const size_t len = strlen(key);
+    const key_hash hash;
+    const key_equal equal;
+    int found = -1;
+
+    exact_t::const_iterator itr = exact.find(key_ref(key, len), hash, equal);
+    if (itr != exact.end()) {
+        found = itr->second;
+    }
+
+    for (size_t i = 0; i < prefix_lengths.size() && prefix_lengths[i] <= len; ++i) {
+        prefixes_t::const_iterator bucket = prefixes.find(key_ref(key, prefix_lengths[i]), hash, equal);
+        if (bucket == prefixes.end()) {
+            continue;
+        }
+        // the wildcards in a bucket are in list order, so the first match
+        // is the only one which can come before what was found already
+        for (wildcards_t::const_iterator wc = bucket->second.begin(); wc != bucket->second.end(); ++wc) {
+            if (found >= 0 && wc->first > found) {
+                break;
+            }
+            if (wildMatch(wc->second.c_str(), key)) {
+                found = wc->first;
+                break;
+            }
+        }
+    }
+
+    return found;
+}
+
 export_list::export_list()
-    : num_tables(0), exportList() {
+    : num_tables(0), exportList(), matchers() {
 }
 
 void export_list::add(enum OsmType id, const taginfo &info) {
     std::vector<taginfo> &infos = get(id);
     infos.push_back(info);
+    matchers[id].add(info.name);
 }
 
 std::vector<taginfo> &export_list::get(enum OsmType id) {
     if (id >= num_tables) {
         exportList.resize(id+1);
+        matchers.resize(id+1);
         num_tables = id + 1;
     }
     return exportList[id];
@@ -76,6 +172,14 @@ const std::vector<taginfo> &export_list::get(enum OsmType id) const {
     }
 }
 
+const taginfo *export_list::find(enum OsmType id, const char *key) const {
+    if (id >= num_tables) {
+        return NULL;
+    }
+    const int index = matchers[id].find(key);
+    return (index >= 0) ? &exportList[id][index] : NULL;
+}
+
 columns_t export_list::normal_columns(enum OsmType id) const {
     columns_t columns;
     const std::vector<taginfo> &infos = get(id);
@@ -6,6 +6,7 @@
 #include <string>
 #include <vector>
 #include <utility>
+#include <boost/unordered_map.hpp>
 
 #define FLAG_POLYGON 1    /* For polygon table */
 #define FLAG_LINEAR  2    /* For lines table */
@@ -21,6 +22,48 @@ struct taginfo {
     int flags;
 };
 
+/* Finds the first of a list of style entry names which matches a key, in
+ * the same way as trying wildMatch on each name in turn would. Names without
+ * wildcards are looked up in a hash table. Names with wildcards are bucketed
+ * by the literal prefix before their first wildcard, so that wildMatch is
+ * only tried on the few whose prefix the key starts with.
+ */
+struct tag_matcher {
+    tag_matcher();
+
+    // add the next name of the list
+    void add(const std::string &name);
+
+    // returns the position in the list of the first name matching key,
+    // or -1 if none do.
+    int find(const char *key) const;
+
+    // a string which is compared and hashed ignoring case, like wildMatch
+    struct key_ref {
+        key_ref(const char *str_, size_t len_) : str(str_), len(len_) {}
+        const char *str;
+        size_t len;
+    };
+    struct key_hash {
+        size_t operator()(const std::string &key) const;
+        size_t operator()(const key_ref &key) const;
+    };
+    struct key_equal {
+        bool operator()(const std::string &a, const std::string &b) const;
+        bool operator()(const key_ref &a, const std::string &b) const;
+    };
+
+private:
+    typedef boost::unordered_map<std::string, int, key_hash, key_equal> exact_t;
+    typedef std::vector<std::pair<int, std::string> > wildcards_t;
+    typedef boost::unordered_map<std::string, wildcards_t, key_hash, key_equal> prefixes_t;
+
+    int count;
+    exact_t exact;
+    prefixes_t prefixes;
+    std::vector<size_t> prefix_lengths; /* distinct lengths of the prefixes, ascending */
+};
+
 struct export_list {
     export_list();
 
@@ -30,8 +73,12 @@ struct export_list {
 
     std::vector<std::pair<std::string, std::string> > normal_columns(enum OsmType id) const;
 
+    // returns the first entry in get(id) whose name matches key, or NULL.
+    const taginfo *find(enum OsmType id, const char *key) const;
+
     int num_tables;
     std::vector<std::vector<taginfo> > exportList; /* Indexed by enum OsmType */
+    std::vector<tag_matcher> matchers; /* Indexed by enum OsmType */
 };
 
 /* Parse a comma or whitespace delimited list of tags to apply to
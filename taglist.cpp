@@ -0,0 +1,84 @@
+/* Contiguous storage of the tags of one object, see taglist.hpp */
+
+#include "taglist.hpp"
+#include "keyvals.hpp"
+#include "string-interner.hpp"
+
+#include <string.h>
+
+taglist::key_id taglist::intern(const char *key) {
+    return interned_keys().intern(key);
+}
+
+taglist::key_id taglist::intern(const char *key, size_t len) {
+    return interned_keys().intern(key, len);
+}
+
+const char *taglist::key_name(key_id id) {
+    return interned_keys().get(id);
+}
+
+taglist::taglist()
+    : m_tags(), m_text() {
+}
+
+void taglist::clear() {
+    m_tags.clear();
+    m_text.clear();
+}
+
+void taglist::add(const char *key, const char *value) {
+    add(key, strlen(key), value, strlen(value));
+}
+
+void taglist::add(const char *key, size_t key_len, const char *value, size_t value_len) {
+    string_interner &keys = interned_keys();
+    tag t;
+    t.id = keys.intern(key, key_len);
+    t.key = keys.get(t.id);
+    t.value = m_text.size();
+    m_tags.push_back(t);
+
+    m_text.insert(m_text.end(), value, value + value_len);
+    m_text.push_back('\0');
+}
+
+void taglist::add(key_id id, const char *value) {
+    tag t;
+    t.id = id;
+    t.key = key_name(id);
+    t.value = m_text.size();
+    m_tags.push_back(t);
+
+    m_text.insert(m_text.end(), value, value + strlen(value) + 1);
+}
+
+const char *taglist::get(key_id id) const {
+    for (size_t i = 0; i < m_tags.size(); ++i) {
+        if (m_tags[i].id == id) {
+            return value(i);
+        }
+    }
+    return NULL;
+}
+
+const char *taglist::get(const char *key) const {
+    key_id id;
+    if (m_tags.empty() || !interned_keys().find(key, strlen(key), &id)) {
+        return NULL;
+    }
+    return get(id);
+}
+
+void taglist::to_keyval(keyval *list) const {
+    for (size_t i = 0; i < m_tags.size(); ++i) {
+        keyval::addItem(list, key(i), value(i), 0);
+    }
+}
+
+void taglist::from_keyval(const keyval *list) {
+    // backwards, so that to_keyval gives the same list again
+    for (const keyval *item = list->prev; item != list; item = item->prev) {
+        add(item->key, item->value);
+    }
+}
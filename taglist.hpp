@@ -0,0 +1,65 @@
+/* Contiguous storage of the tags of one object
+ *
+ * Used in place of a keyval list where tags are collected once per
+ * object, like in the parsers, so that they don't cost an allocation
+ * per tag.
+ */
+
+#ifndef TAGLIST_H
+#define TAGLIST_H
+
+#include "string-interner.hpp"
+
+#include <stddef.h>
+#include <vector>
+
+struct keyval;
+
+class taglist {
+public:
+    typedef string_interner::handle key_id;
+
+    // the id of a key, which is the same wherever the key is used. new keys
+    // are interned, and their text is kept for the life of the program.
+    static key_id intern(const char *key);
+    static key_id intern(const char *key, size_t len);
+    static const char *key_name(key_id id);
+
+    taglist();
+
+    // forget the tags, but keep the memory for the next object
+    void clear();
+
+    void add(const char *key, const char *value);
+    void add(const char *key, size_t key_len, const char *value, size_t value_len);
+    // a tag whose key is interned already, like one from another taglist
+    void add(key_id id, const char *value);
+
+    size_t size() const { return m_tags.size(); }
+    bool empty() const { return m_tags.empty(); }
+
+    key_id id(size_t i) const { return m_tags[i].id; }
+    const char *key(size_t i) const { return m_tags[i].key; }
+    const char *value(size_t i) const { return &m_text[m_tags[i].value]; }
+
+    // the value of the first tag with the key, or NULL if there is none
+    const char *get(key_id id) const;
+    const char *get(const char *key) const;
+
+    // for code still using keyval lists. to_keyval adds the tags to the
+    // front of the list one after the other, like the parsers used to.
+    void to_keyval(keyval *list) const;
+    void from_keyval(const keyval *list);
+
+private:
+    struct tag {
+        key_id id;
+        const char *key;    // the interned text of the key
+        size_t value;       // offset of the value in m_text
+    };
+
+    std::vector<tag> m_tags;
+    std::vector<char> m_text;
+};
+
+#endif
@@ -9,7 +9,6 @@
 #include "output-pgsql.hpp"
 #include "options.hpp"
 #include "config.h"
-#include "wildcmp.hpp"
 #include "taginfo_impl.hpp"
 
 
@@ -37,13 +36,32 @@ static const struct {
 static const unsigned int nLayers = (sizeof(layers)/sizeof(*layers));
 
 namespace {
-int add_z_order(keyval *tags, int *roads) {
-    const char *layer = keyval::getItem(tags, "layer");
-    const char *highway = keyval::getItem(tags, "highway");
-    const char *bridge = keyval::getItem(tags, "bridge");
-    const char *tunnel = keyval::getItem(tags, "tunnel");
-    const char *railway = keyval::getItem(tags, "railway");
-    const char *boundary = keyval::getItem(tags, "boundary");
+/* the tag transform works on keyval lists and on taglists, these are the
+ * few things it needs to do to either */
+const char *tag_value(keyval *tags, const char *key) {
+    return keyval::getItem(tags, key);
+}
+
+const char *tag_value(const taglist &tags, const char *key) {
+    return tags.get(key);
+}
+
+void add_tag(keyval *tags, const char *key, const char *value) {
+    keyval::addItem(tags, key, value, 0);
+}
+
+void add_tag(taglist &tags, const char *key, const char *value) {
+    tags.add(key, value);
+}
+
+template <typename TAGS>
+int add_z_order(TAGS &tags, int *roads) {
+    const char *layer = tag_value(tags, "layer");
+    const char *highway = tag_value(tags, "highway");
+    const char *bridge = tag_value(tags, "bridge");
+    const char *tunnel = tag_value(tags, "tunnel");
+    const char *railway = tag_value(tags, "railway");
+    const char *boundary = tag_value(tags, "boundary");
 
     int z_order = 0;
     int l;
@@ -83,11 +101,40 @@ int add_z_order(keyval *tags, int *roads) {
         z_order -= 10;
 
     snprintf(z, sizeof(z), "%d", z_order);
-    keyval::addItem(tags, "z_order", z, 0);
+    add_tag(tags, "z_order", z);
 
     return 0;
 }
 
+/* The last step of the C transform, once the tags to keep are known */
+template <typename TAGS>
+unsigned int finish_basic_tags(const OsmType type, TAGS &tags, int filter, int flags, int add_area_tag,
+                               int *polygon, int *roads) {
+    *polygon = flags & FLAG_POLYGON;
+
+    /* Special case allowing area= to override anything else */
+    const char *area;
+    if ((area = tag_value(tags, "area"))) {
+        if (!strcmp(area, "yes") || !strcmp(area, "true") || !strcmp(area, "1"))
+            *polygon = 1;
+        else if (!strcmp(area, "no") || !strcmp(area, "false")
+                || !strcmp(area, "0"))
+            *polygon = 0;
+    } else {
+        /* If we need to force this as a polygon, append an area tag */
+        if (add_area_tag) {
+            add_tag(tags, "area", "yes");
+            *polygon = 1;
+        }
+    }
+
+    if (!filter && (type == OSMTYPE_WAY)) {
+        add_z_order(tags,roads);
+    }
+
+    return filter;
+}
+
 unsigned int c_filter_rel_member_tags(
         keyval *rel_tags, const int member_count,
         keyval *member_tags, const char * const *member_roles,
@@ -373,49 +420,54 @@ unsigned int c_filter_rel_member_tags(
 }
 
 #ifdef HAVE_LUA
+/* Move the tags into a new table on top of the stack, sized up front so it
+ * doesn't have to grow while they are added. Returns the number of tags. */
+int push_tags(lua_State* L, keyval *tags) {
+    int count = keyval::countList(tags);
+    struct keyval *item;
+
+    lua_createtable(L, 0, count);
+    while( (item = keyval::popItem(tags)) != NULL ) {
+        lua_pushstring(L, item->key);
+        lua_pushstring(L, item->value);
+        lua_rawset(L, -3);
+        keyval::freeItem(item);
+    }
+    return count;
+}
+
+/* Add the tags of the table on top of the stack to the list */
+void read_tags(lua_State* L, keyval *tags) {
+    lua_pushnil(L);
+    while (lua_next(L,-2) != 0) {
+        keyval::addItem(tags, lua_tostring(L,-2), lua_tostring(L,-1), 0);
+        lua_pop(L,1);
+    }
+}
+
 unsigned int lua_filter_rel_member_tags(lua_State* L, const char* rel_mem_func, keyval *rel_tags, const int member_count,
         keyval *member_tags,const char * const * member_roles,
         int * member_superseeded, int * make_boundary, int * make_polygon, int * roads) {
 
     int i;
     int filter;
-    int count = 0;
-    struct keyval *item;
-    const char * key, * value;
 
     lua_getglobal(L, rel_mem_func);
 
-    lua_newtable(L);    /* relations key value table */
-
-    while( (item = keyval::popItem(rel_tags)) != NULL ) {
-        lua_pushstring(L, item->key);
-        lua_pushstring(L, item->value);
-        lua_rawset(L, -3);
-        keyval::freeItem(item);
-        count++;
-    }
+    push_tags(L, rel_tags);    /* relations key value table */
 
-    lua_newtable(L);    /* member tags table */
+    lua_createtable(L, member_count, 0);    /* member tags table */
 
     for (i = 1; i <= member_count; i++) {
-        lua_pushnumber(L, i);
-        lua_newtable(L);    /* member key value table */
-        while( (item = keyval::popItem(&(member_tags[i - 1]))) != NULL ) {
-            lua_pushstring(L, item->key);
-            lua_pushstring(L, item->value);
-            lua_rawset(L, -3);
-            keyval::freeItem(item);
-            count++;
-        }
-        lua_rawset(L, -3);
+        push_tags(L, &(member_tags[i - 1]));    /* member key value table */
+        lua_rawseti(L, -2, i);
     }
 
-    lua_newtable(L);    /* member roles table */
+    lua_createtable(L, member_count, 0);    /* member roles table */
 
     for (i = 0; i < member_count; i++) {
-        lua_pushnumber(L, i + 1);
         lua_pushstring(L, member_roles[i]);
-        lua_rawset(L, -3);
+        lua_rawseti(L, -2, i + 1);
     }
 
     lua_pushnumber(L, member_count);
@@ -444,13 +496,7 @@ unsigned int lua_filter_rel_member_tags(lua_State* L, const char* rel_mem_func,
     }
     lua_pop(L,2);
 
-    lua_pushnil(L);
-    while (lua_next(L,-2) != 0) {
-        key = lua_tostring(L,-2);
-        value = lua_tostring(L,-1);
-        keyval::addItem(rel_tags, key, value, 0);
-        lua_pop(L,1);
-    }
+    read_tags(L, rel_tags);
     lua_pop(L,1);
 
     filter = lua_tointeger(L, -1);
@@ -460,13 +506,40 @@ unsigned int lua_filter_rel_member_tags(lua_State* L, const char* rel_mem_func,
     return filter;
 }
 
-void check_lua_function_exists(lua_State *L, const std::string &func_name) {
+#ifdef HAVE_LUAJIT
+/* Run before the script: declares the structs the _ffi functions work on
+ * and returns the function used to call them, which turns the light
+ * userdata passed from C into typed pointers. */
+const char ffi_prelude[] =
+    "local ffi = require('ffi')\n"
+    "ffi.cdef[[\n"
+    "struct osm2pgsql_tag { const char *key; size_t key_len; const char *value; size_t value_len; };\n"
+    "struct osm2pgsql_result { int filter; int polygon; int roads; unsigned char *keep; };\n"
+    "int memcmp(const void *s1, const void *s2, size_t n);\n"
+    "]]\n"
+    "local tag_ptr = ffi.typeof('const struct osm2pgsql_tag *')\n"
+    "local result_ptr = ffi.typeof('struct osm2pgsql_result *')\n"
+    "osm2pgsql_ffi = {}\n"
+    "function osm2pgsql_ffi.equals(str, len, s)\n"
+    "    return len == #s and ffi.C.memcmp(str, s, len) == 0\n"
+    "end\n"
+    "return function(func, tags, count, result)\n"
+    "    return func(ffi.cast(tag_ptr, tags), count, ffi.cast(result_ptr, result))\n"
+    "end\n";
+#endif
+
+bool lua_function_exists(lua_State *L, const std::string &func_name) {
     lua_getglobal(L, func_name.c_str());
-    if (!lua_isfunction (L, -1)) {
+    const bool exists = lua_isfunction (L, -1);
+    lua_pop(L,1);
+    return exists;
+}
+
+void check_lua_function_exists(lua_State *L, const std::string &func_name) {
+    if (!lua_function_exists(L, func_name)) {
         throw std::runtime_error((boost::format("Tag transform style does not contain a function %1%")
                                   % func_name).str());
     }
-    lua_pop(L,1);
 }
 #endif
 } // anonymous namespace
@@ -479,19 +552,38 @@ tagtransform::tagtransform(const options_t *options_)
     , m_way_func(    options->tag_transform_way_func.    get_value_or("filter_tags_way"))
     , m_rel_func(    options->tag_transform_rel_func.    get_value_or("filter_basic_tags_rel"))
     , m_rel_mem_func(options->tag_transform_rel_mem_func.get_value_or("filter_tags_relation_member"))
+    , m_way_batch_func(m_way_func + "_batch"), m_has_way_batch_func(false)
 #endif /* HAVE_LUA */
+#ifdef HAVE_LUAJIT
+    , m_node_ffi_func(m_node_func + "_ffi"), m_way_ffi_func(m_way_func + "_ffi"), m_rel_ffi_func(m_rel_func + "_ffi")
+    , m_has_node_ffi_func(false), m_has_way_ffi_func(false), m_has_rel_ffi_func(false)
+    , m_ffi_call(LUA_NOREF)
+#endif
  {
 	if (transform_method) {
                 fprintf(stderr, "Using lua based tag processing pipeline with script %s\n", options->tag_transform_script->c_str());
 #ifdef HAVE_LUA
 		L = luaL_newstate();
 		luaL_openlibs(L);
+#ifdef HAVE_LUAJIT
+		if (luaL_loadstring(L, ffi_prelude) || lua_pcall(L, 0, 1, 0)) {
+			throw std::runtime_error((boost::format("Could not set up the LuaJIT FFI tag transform: %1%")
+			                          % lua_tostring(L, -1)).str());
+		}
+		m_ffi_call = luaL_ref(L, LUA_REGISTRYINDEX);
+#endif
 		luaL_dofile(L, options->tag_transform_script->c_str());
 
                 check_lua_function_exists(L, m_node_func);
                 check_lua_function_exists(L, m_way_func);
                 check_lua_function_exists(L, m_rel_func);
                 check_lua_function_exists(L, m_rel_mem_func);
+                m_has_way_batch_func = lua_function_exists(L, m_way_batch_func);
+#ifdef HAVE_LUAJIT
+                m_has_node_ffi_func = lua_function_exists(L, m_node_ffi_func);
+                m_has_way_ffi_func = lua_function_exists(L, m_way_ffi_func);
+                m_has_rel_ffi_func = lua_function_exists(L, m_rel_ffi_func);
+#endif
 #else
 		throw std::runtime_error("Error: Could not init lua tag transform, as lua support was not compiled into this version");
 #endif
@@ -532,6 +624,46 @@ unsigned int tagtransform::filter_way_tags(struct keyval *tags, int * polygon, i
     }
 }
 
+unsigned int tagtransform::filter_node_tags(const taglist &tags, taglist &out, const export_list *exlist, bool strict) {
+    int poly, roads;
+    if (transform_method) {
+        return lua_filter_basic_tags(OSMTYPE_NODE, tags, out, &poly, &roads);
+    } else {
+        return c_filter_basic_tags(OSMTYPE_NODE, tags, out, &poly, &roads, exlist, strict);
+    }
+}
+
+unsigned int tagtransform::filter_way_tags(const taglist &tags, taglist &out, int * polygon, int * roads,
+                                          const export_list *exlist, bool strict) {
+    if (transform_method) {
+#ifdef HAVE_LUA
+        return lua_filter_basic_tags(OSMTYPE_WAY, tags, out, polygon, roads);
+#else
+        return 1;
+#endif
+    } else {
+        return c_filter_basic_tags(OSMTYPE_WAY, tags, out, polygon, roads, exlist, strict);
+    }
+}
+
+/*
+ * Filter the tags of several ways whose filter results aren't needed, like
+ * the member ways of a relation. A Lua script can handle all of them in one
+ * call by implementing the way function with a _batch suffix.
+ */
+void tagtransform::filter_way_tags_list(struct keyval *tags, int count, const export_list *exlist) {
+    int polygon, roads;
+#ifdef HAVE_LUA
+    if (transform_method && m_has_way_batch_func && count > 1) {
+        lua_filter_way_batch(tags, count);
+        return;
+    }
+#endif
+    for (int i = 0; i < count; i++) {
+        filter_way_tags(&tags[i], &polygon, &roads, exlist);
+    }
+}
+
 unsigned int tagtransform::filter_rel_tags(struct keyval *tags, const export_list *exlist, bool strict) {
     int poly, roads;
     if (transform_method) {
@@ -556,12 +688,25 @@ unsigned int tagtransform::filter_rel_member_tags(struct keyval *rel_tags, int m
 unsigned int tagtransform::lua_filter_basic_tags(const OsmType type, keyval *tags, int * polygon, int * roads) {
 #ifdef HAVE_LUA
     int filter;
-    int count = 0;
-    struct keyval *item;
-    const char * key, * value;
+    int count;
 
     *polygon = 0; *roads = 0;
 
+#ifdef HAVE_LUAJIT
+    /* prefer the FFI version of the function if the script has one */
+    switch (type) {
+    case OSMTYPE_NODE:
+        if (m_has_node_ffi_func) return lua_filter_ffi_tags(m_node_ffi_func, tags, polygon, roads);
+        break;
+    case OSMTYPE_WAY:
+        if (m_has_way_ffi_func) return lua_filter_ffi_tags(m_way_ffi_func, tags, polygon, roads);
+        break;
+    case OSMTYPE_RELATION:
+        if (m_has_rel_ffi_func) return lua_filter_ffi_tags(m_rel_ffi_func, tags, polygon, roads);
+        break;
+    }
+#endif
+
     switch (type) {
     case OSMTYPE_NODE: {
         lua_getglobal(L, m_node_func.c_str());
@@ -577,17 +722,8 @@ unsigned int tagtransform::lua_filter_basic_tags(const OsmType type, keyval *tag
     }
     }
 
-    lua_newtable(L);    /* key value table */
-
-    while( (item = keyval::popItem(tags)) != NULL ) {
-        lua_pushstring(L, item->key);
-        lua_pushstring(L, item->value);
-        lua_rawset(L, -3);
-        keyval::freeItem(item);
-        count++;
-    }
+    count = push_tags(L, tags);    /* key value table */
 
-    //printf("C count %i\n", count);
     lua_pushinteger(L, count);
 
     if (lua_pcall(L,2,type == OSMTYPE_WAY ? 4 : 2,0)) {
@@ -603,13 +739,7 @@ unsigned int tagtransform::lua_filter_basic_tags(const OsmType type, keyval *tag
         lua_pop(L,1);
     }
 
-    lua_pushnil(L);
-    while (lua_next(L,-2) != 0) {
-        key = lua_tostring(L,-2);
-        value = lua_tostring(L,-1);
-        keyval::addItem(tags, key, value, 0);
-        lua_pop(L,1);
-    }
+    read_tags(L, tags);
 
     filter = lua_tointeger(L, -2);
 
@@ -621,6 +751,176 @@ unsigned int tagtransform::lua_filter_basic_tags(const OsmType type, keyval *tag
 #endif
 }
 
+/* Scripts work on keyval lists, so the tags of a new object are made into one */
+unsigned int tagtransform::lua_filter_basic_tags(const OsmType type, const taglist &tags, taglist &out,
+                                                 int * polygon, int * roads) {
+    keyval list;
+    keyval::initList(&list);
+    tags.to_keyval(&list);
+
+    unsigned int filter = lua_filter_basic_tags(type, &list, polygon, roads);
+
+    out.clear();
+    out.from_keyval(&list);
+    keyval::resetList(&list);
+    return filter;
+}
+
+#ifdef HAVE_LUA
+void tagtransform::lua_filter_way_batch(keyval *tags, int count) {
+    int i;
+
+    lua_getglobal(L, m_way_batch_func.c_str());
+
+    lua_createtable(L, count, 0);    /* key value tables */
+    lua_createtable(L, count, 0);    /* tag counts */
+    for (i = 0; i < count; i++) {
+        lua_pushinteger(L, push_tags(L, &tags[i]));
+        lua_rawseti(L, -3, i + 1);
+        lua_rawseti(L, -3, i + 1);
+    }
+    lua_pushinteger(L, count);
+
+    if (lua_pcall(L,3,4,0)) {
+        fprintf(stderr, "Failed to execute lua function for batch way tag processing: %s\n", lua_tostring(L, -1));
+        /* lua function failed */
+        lua_pop(L,1);
+        return;
+    }
+
+    /* only the tags are used, the filter, polygon and roads flags are
+       returned for symmetry with the way function */
+    for (i = 0; i < count; i++) {
+        lua_rawgeti(L, -3, i + 1);
+        if (lua_istable(L, -1)) {
+            read_tags(L, &tags[i]);
+        }
+        lua_pop(L,1);
+    }
+
+    lua_pop(L,4);
+}
+#endif
+
+#ifdef HAVE_LUAJIT
+/*
+ * Call an _ffi function, which gets the tags as an array of osm2pgsql_tag
+ * pointing at the strings of the list and fills in an osm2pgsql_result.
+ * Nothing is copied into Lua unless the script asks for it. Tags it drops
+ * are removed from the list, and it can return a table of tags to add or
+ * change.
+ */
+unsigned int tagtransform::lua_filter_ffi_tags(const std::string &func, keyval *tags, int * polygon, int * roads) {
+    m_ffi_tags.clear();
+    for (keyval *item = keyval::firstItem(tags); item; item = keyval::nextItem(tags, item)) {
+        osm2pgsql_tag tag = { item->key, strlen(item->key), item->value, strlen(item->value) };
+        m_ffi_tags.push_back(tag);
+    }
+    /* one more than needed, so there is an address to pass without tags */
+    m_ffi_keep.assign(m_ffi_tags.size() + 1, 1);
+
+    osm2pgsql_result result = { 0, 0, 0, &m_ffi_keep[0] };
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, m_ffi_call);
+    lua_getglobal(L, func.c_str());
+    lua_pushlightuserdata(L, m_ffi_tags.empty() ? NULL : &m_ffi_tags[0]);
+    lua_pushinteger(L, m_ffi_tags.size());
+    lua_pushlightuserdata(L, &result);
+
+    if (lua_pcall(L,4,1,0)) {
+        fprintf(stderr, "Failed to execute lua function for FFI tag processing: %s\n", lua_tostring(L, -1));
+        /* lua function failed */
+        lua_pop(L,1);
+        return 1;
+    }
+
+    /* the list hasn't changed since the array was built from it */
+    size_t i = 0;
+    keyval *item = tags->next;
+    while (item != tags) {
+        keyval *next = item->next;
+        if (!m_ffi_keep[i++]) {
+            keyval::removeTag(item);
+        }
+        item = next;
+    }
+
+    if (lua_istable(L, -1)) {
+        lua_pushnil(L);
+        while (lua_next(L,-2) != 0) {
+            keyval::updateItem(tags, lua_tostring(L,-2), lua_tostring(L,-1));
+            lua_pop(L,1);
+        }
+    }
+    lua_pop(L,1);
+
+    *polygon = result.polygon;
+    *roads = result.roads;
+    return result.filter;
+}
+#endif
+
+/* Whether the C transform keeps a tag, noting what the tag says about the
+ * object in filter, flags and add_area_tag */
+bool tagtransform::c_keep_tag(const OsmType type, const char *key, const char *value,
+    const export_list *exlist, bool strict, int *filter, int *flags, int *add_area_tag) const {
+
+    //if we want to do more than the export list says
+    if(!strict) {
+        if (type == OSMTYPE_RELATION && !strcmp("type", key)) {
+            *filter = 0;
+            return true;
+        }
+        /* Allow named islands to appear as polygons */
+        if (!strcmp("natural", key) && !strcmp("coastline", value)) {
+            *add_area_tag = 1;
+
+            /* Discard natural=coastline tags (we render these from a shapefile instead) */
+            if (!options->keep_coastlines)
+                return false;
+        }
+    }
+
+    //keep the tag if it is in the export list
+    const taginfo *info = exlist->find(type == OSMTYPE_RELATION ? OSMTYPE_WAY : type, key);
+    if (info) {
+        if (info->flags & FLAG_DELETE)
+            return false;
+
+        *filter = 0;
+        *flags |= info->flags;
+        return true;
+    }
+
+    //if we didnt find any tags that we wanted to export we only keep them
+    //for hstore columns and only if we aren't strictly adhering to the list
+    if (strict)
+        return false;
+
+    if (options->hstore_mode == HSTORE_NONE) {
+        /* does this column match any of the hstore column prefixes? */
+        size_t j = 0;
+        for(; j < options->hstore_columns.size(); ++j) {
+            const std::string &column = options->hstore_columns[j];
+            if (strncmp(key, column.c_str(), column.size()) == 0)
+                break;
+        }
+        /* if not, skip the tag */
+        if (j == options->hstore_columns.size())
+            return false;
+    }
+
+    /* with hstore, copy all tags, but if hstore_match_only is set then
+       don't take this as a reason for keeping the object */
+    if (!options->hstore_match_only && strcmp("osm_uid", key)
+            && strcmp("osm_user", key)
+            && strcmp("osm_timestamp", key)
+            && strcmp("osm_version", key)
+            && strcmp("osm_changeset", key))
+        *filter = 0;
+    return true;
+}
+
 /* Go through the given tags and determine the union of flags. Also remove
  * any tags from the list that we don't know about */
 unsigned int tagtransform::c_filter_basic_tags(
@@ -637,129 +937,40 @@ unsigned int tagtransform::c_filter_basic_tags(
     struct keyval temp;
     keyval::initList(&temp);
 
-    enum OsmType export_type;
-    if (type == OSMTYPE_RELATION) {
-        export_type = OSMTYPE_WAY;
-    } else {
-        export_type = type;
-    }
-
     /* We used to only go far enough to determine if it's a polygon or not, but now we go through and filter stuff we don't need */
     //pop each tag off and keep it in the temp list if we like it
     struct keyval *item;
     while ((item = keyval::popItem(tags)) != NULL ) {
-        //if we want to do more than the export list says
-        if(!strict) {
-            if (type == OSMTYPE_RELATION && !strcmp("type", item->key)) {
-                keyval::pushItem(&temp, item);
-                item = NULL;
-                filter = 0;
-                continue;
-            }
-            /* Allow named islands to appear as polygons */
-            if (!strcmp("natural", item->key)
-                    && !strcmp("coastline", item->value)) {
-                add_area_tag = 1;
-            }
-
-            /* Discard natural=coastline tags (we render these from a shapefile instead) */
-            if (!options->keep_coastlines && !strcmp("natural", item->key)
-                    && !strcmp("coastline", item->value)) {
-                keyval::freeItem(item);
-                item = NULL;
-                continue;
-            }
-        }
-
-        //go through the actual tags found on the item and keep the ones in the export list
-        const std::vector<taginfo> &infos = exlist->get(export_type);
-        size_t i = 0;
-        for (; i < infos.size(); i++) {
-            const taginfo &info = infos[i];
-            if (wildMatch(info.name.c_str(), item->key)) {
-                if (info.flags & FLAG_DELETE) {
-                    keyval::freeItem(item);
-                    item = NULL;
-                    break;
-                }
-
-                filter = 0;
-                flags |= info.flags;
-
-                keyval::pushItem(&temp, item);
-                item = NULL;
-                break;
-            }
-        }
-
-        //if we didnt find any tags that we wanted to export and we aren't strictly adhering to the list
-        if (i == infos.size() && !strict) {
-            if (options->hstore_mode != HSTORE_NONE) {
-                /* with hstore, copy all tags... */
-                keyval::pushItem(&temp, item);
-                /* ... but if hstore_match_only is set then don't take this
-                 as a reason for keeping the object */
-                if (!options->hstore_match_only && strcmp("osm_uid", item->key)
-                        && strcmp("osm_user", item->key)
-                        && strcmp("osm_timestamp", item->key)
-                        && strcmp("osm_version", item->key)
-                        && strcmp("osm_changeset", item->key))
-                    filter = 0;
-            } else if (options->hstore_columns.size() > 0) {
-                /* does this column match any of the hstore column prefixes? */
-                size_t j = 0;
-                for(; j < options->hstore_columns.size(); ++j) {
-                    char *pos = strstr(item->key, options->hstore_columns[j].c_str());
-                    if (pos == item->key) {
-                        keyval::pushItem(&temp, item);
-                        /* ... but if hstore_match_only is set then don't take this
-                         as a reason for keeping the object */
-                        if (!options->hstore_match_only
-                                && strcmp("osm_uid", item->key)
-                                && strcmp("osm_user", item->key)
-                                && strcmp("osm_timestamp", item->key)
-                                && strcmp("osm_version", item->key)
-                                && strcmp("osm_changeset", item->key))
-                            filter = 0;
-                        break;
-                    }
-                }
-                /* if not, skip the tag */
-                if (j == options->hstore_columns.size()) {
-                    keyval::freeItem(item);
-                }
-            } else {
-                keyval::freeItem(item);
-            }
-            item = NULL;
-        }
+        if (c_keep_tag(type, item->key, item->value, exlist, strict, &filter, &flags, &add_area_tag))
+            keyval::pushItem(&temp, item);
+        else
+            keyval::freeItem(item);
     }
 
     /* Move from temp list back to original list */
     while ((item = keyval::popItem(&temp)) != NULL )
         keyval::pushItem(tags, item);
 
-    *polygon = flags & FLAG_POLYGON;
+    return finish_basic_tags(type, tags, filter, flags, add_area_tag, polygon, roads);
+}
 
-    /* Special case allowing area= to override anything else */
-    const char *area;
-    if ((area = keyval::getItem(tags, "area"))) {
-        if (!strcmp(area, "yes") || !strcmp(area, "true") || !strcmp(area, "1"))
-            *polygon = 1;
-        else if (!strcmp(area, "no") || !strcmp(area, "false")
-                || !strcmp(area, "0"))
-            *polygon = 0;
-    } else {
-        /* If we need to force this as a polygon, append an area tag */
-        if (add_area_tag) {
-            keyval::addItem(tags, "area", "yes", 0);
-            *polygon = 1;
-        }
-    }
+/* The same for the tags of a new object, copying the ones to keep to out
+ * so that nothing is allocated per tag */
+unsigned int tagtransform::c_filter_basic_tags(
+    const OsmType type, const taglist &tags, taglist &out, int *polygon, int * roads,
+    const export_list *exlist, bool strict) {
 
-    if (!filter && (type == OSMTYPE_WAY)) {
-        add_z_order(tags,roads);
+    //assume we dont like this set of tags
+    int filter = 1;
+
+    int flags = 0;
+    int add_area_tag = 0;
+
+    out.clear();
+    for (size_t i = 0; i < tags.size(); ++i) {
+        if (c_keep_tag(type, tags.key(i), tags.value(i), exlist, strict, &filter, &flags, &add_area_tag))
+            out.add(tags.id(i), tags.value(i));
     }
 
-    return filter;
+    return finish_basic_tags(type, out, filter, flags, add_area_tag, polygon, roads);
 }
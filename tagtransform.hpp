@@ -4,6 +4,9 @@
 
 #include "output.hpp"
 #include "taginfo.hpp"
+#include "config.h"
+
+#include <vector>
 
 #ifdef HAVE_LUA
 extern "C" {
@@ -13,6 +16,27 @@ extern "C" {
 }
 #endif
 
+#ifdef HAVE_LUAJIT
+/* A tag as the _ffi functions of a script see it, pointing into the keyval
+ * list instead of being copied into Lua. The FFI declarations in
+ * tagtransform.cpp must match these. */
+struct osm2pgsql_tag {
+	const char *key;
+	size_t key_len;
+	const char *value;
+	size_t value_len;
+};
+
+/* The decisions of an _ffi function. keep has one entry per tag, which the
+ * script sets to 0 to drop that tag. */
+struct osm2pgsql_result {
+	int filter;
+	int polygon;
+	int roads;
+	unsigned char *keep;
+};
+#endif
+
 
 
 class tagtransform {
@@ -22,6 +46,10 @@ public:
 
 	unsigned int filter_node_tags(keyval *tags, const export_list *exlist, bool strict = false);
 	unsigned int filter_way_tags(keyval *tags, int * polygon, int * roads, const export_list *exlist, bool strict = false);
+	// the same, reading the tags of a new object and leaving the ones to keep in out
+	unsigned int filter_node_tags(const taglist &tags, taglist &out, const export_list *exlist, bool strict = false);
+	unsigned int filter_way_tags(const taglist &tags, taglist &out, int * polygon, int * roads, const export_list *exlist, bool strict = false);
+	void filter_way_tags_list(keyval *tags, int count, const export_list *exlist);
 	unsigned int filter_rel_tags(keyval *tags, const export_list *exlist, bool strict = false);
 	unsigned int filter_rel_member_tags(keyval *rel_tags, int member_count,
 		keyval *member_tags, const char * const * member_roles, int * member_superseeded,
@@ -30,14 +58,35 @@ public:
 
 private:
 	unsigned int lua_filter_basic_tags(const OsmType type, keyval *tags, int * polygon, int * roads);
+	unsigned int lua_filter_basic_tags(const OsmType type, const taglist &tags, taglist &out, int * polygon, int * roads);
+#ifdef HAVE_LUA
+	void lua_filter_way_batch(keyval *tags, int count);
+#endif
+#ifdef HAVE_LUAJIT
+	unsigned int lua_filter_ffi_tags(const std::string &func, keyval *tags, int * polygon, int * roads);
+#endif
 	unsigned int c_filter_basic_tags(const OsmType type, keyval *tags, int *polygon, int * roads,
 	    const export_list *exlist, bool strict);
+	unsigned int c_filter_basic_tags(const OsmType type, const taglist &tags, taglist &out, int *polygon, int * roads,
+	    const export_list *exlist, bool strict);
+	bool c_keep_tag(const OsmType type, const char *key, const char *value, const export_list *exlist, bool strict,
+	    int *filter, int *flags, int *add_area_tag) const;
 
 	const options_t* options;
 	const bool transform_method;
 #ifdef HAVE_LUA
 	lua_State *L;
     const std::string m_node_func, m_way_func, m_rel_func, m_rel_mem_func;
+    const std::string m_way_batch_func;
+    bool m_has_way_batch_func;
+#endif
+#ifdef HAVE_LUAJIT
+    const std::string m_node_ffi_func, m_way_ffi_func, m_rel_ffi_func;
+    bool m_has_node_ffi_func, m_has_way_ffi_func, m_has_rel_ffi_func;
+    int m_ffi_call;
+    // reused between objects so they don't allocate
+    std::vector<osm2pgsql_tag> m_ffi_tags;
+    std::vector<unsigned char> m_ffi_keep;
 #endif
 
 };
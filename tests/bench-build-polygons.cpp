@@ -0,0 +1,109 @@
+/* Times geometry_builder::build_polygons on a large synthetic multipolygon
+ * relation: an outer ring split into many ways around a grid of lakes,
+ * some of which have islands in them. Run with the number of lakes per
+ * side and the number of threads as arguments, the default gives about
+ * 35000 member ways built on one thread. */
+
+#include "geometry-builder.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+typedef std::vector<osmNode> way_t;
+
+osmNode make_node(double lon, double lat) {
+    osmNode n;
+    n.lon = lon;
+    n.lat = lat;
+    return n;
+}
+
+way_t square(double x, double y, double size) {
+    way_t way;
+    way.push_back(make_node(x, y));
+    way.push_back(make_node(x + size, y));
+    way.push_back(make_node(x + size, y + size));
+    way.push_back(make_node(x, y + size));
+    way.push_back(make_node(x, y));
+    return way;
+}
+
+// the outer ring of the relation, cut into ways of a few nodes each
+void add_outer(std::vector<way_t> &ways, double size, int nodes_per_side) {
+    way_t ring;
+    const double step = size / nodes_per_side;
+    for (int i = 0; i < nodes_per_side; ++i) ring.push_back(make_node(i * step, 0));
+    for (int i = 0; i < nodes_per_side; ++i) ring.push_back(make_node(size, i * step));
+    for (int i = nodes_per_side; i > 0; --i) ring.push_back(make_node(i * step, size));
+    for (int i = nodes_per_side; i > 0; --i) ring.push_back(make_node(0, i * step));
+    ring.push_back(ring.front());
+
+    for (size_t i = 0; i + 1 < ring.size(); i += 4) {
+        const size_t last = std::min(i + 4, ring.size() - 1);
+        ways.push_back(way_t(ring.begin() + i, ring.begin() + last + 1));
+    }
+}
+
+double now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    const int lakes_per_side = (argc > 1) ? atoi(argv[1]) : 150;
+    const int threads = (argc > 2) ? atoi(argv[2]) : 1;
+    if (lakes_per_side < 1 || threads < 1) {
+        fprintf(stderr, "Usage: %s [lakes per side] [threads]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<way_t> ways;
+    const double cell = 10.0;
+    add_outer(ways, lakes_per_side * cell + cell, lakes_per_side * 10);
+
+    int islands = 0;
+    for (int y = 0; y < lakes_per_side; ++y) {
+        for (int x = 0; x < lakes_per_side; ++x) {
+            const double lake_x = cell + x * cell, lake_y = cell + y * cell;
+            ways.push_back(square(lake_x, lake_y, cell / 2));
+            if ((x + y) % 2 == 0) {
+                ways.push_back(square(lake_x + 1, lake_y + 1, cell / 10));
+                ++islands;
+            }
+        }
+    }
+
+    std::vector<const osmNode *> xnodes;
+    std::vector<int> xcount;
+    for (size_t i = 0; i < ways.size(); ++i) {
+        xnodes.push_back(&ways[i][0]);
+        xcount.push_back(ways[i].size());
+    }
+    xnodes.push_back(NULL);
+    xcount.push_back(0);
+
+    geometry_builder builder;
+    builder.set_thread_count(threads);
+    const double start = now();
+    geometry_builder::maybe_wkts_t wkts = builder.build_polygons(&xnodes[0], &xcount[0], false);
+    const double elapsed = now() - start;
+
+    fprintf(stderr, "%zu member ways, %zu polygons built in %.3fs\n", ways.size(), wkts->size(), elapsed);
+
+    // the outer polygon with its lakes as holes, plus each island
+    if (wkts->size() != size_t(islands + 1)) {
+        fprintf(stderr, "Expected %d polygons\n", islands + 1);
+        return EXIT_FAILURE;
+    }
+
+    return 0;
+}
@@ -7,6 +7,7 @@
 
 #include "osmtypes.hpp"
 #include "keyvals.hpp"
+#include "taglist.hpp"
 #include "tests/middle-tests.hpp"
 
 int test_node_set(middle_t *mid)
@@ -14,12 +15,12 @@ int test_node_set(middle_t *mid)
   osmid_t id = 1234;
   double lat = 12.3456789;
   double lon = 98.7654321;
-  struct keyval tags;
+  taglist tags;
   struct osmNode node;
   int status = 0;
 
   // set the node
-  status = mid->nodes_set(id, lat, lon, &tags);
+  status = mid->nodes_set(id, lat, lon, tags);
   if (status != 0) { std::cerr << "ERROR: Unable to set node.\n"; return 1; }
 
   // get it back
@@ -43,8 +44,6 @@ int test_node_set(middle_t *mid)
     dynamic_cast<slim_middle_t *>(mid)->nodes_delete(id);
   }
 
-  keyval::resetList(&tags);
-
   return 0;
 }
 
@@ -78,6 +77,7 @@ int test_way_set(middle_t *mid)
   osmid_t way_id = 1;
   double lat = 12.3456789;
   double lon = 98.7654321;
+  taglist way_tags;
   struct keyval tags[2]; /* <-- this is needed because the ways_get_list method calls
                           * keyval::initList() on the `count + 1`th tags element. */
   struct osmNode *node_ptr = NULL;
@@ -89,12 +89,12 @@ int test_way_set(middle_t *mid)
 
   // set the nodes
   for (int i = 0; i < nd_count; ++i) {
-    status = mid->nodes_set(nds[i], lat, lon, &tags[0]);
+    status = mid->nodes_set(nds[i], lat, lon, way_tags);
     if (status != 0) { std::cerr << "ERROR: Unable to set node " << nds[i] << ".\n"; return 1; }
   }
 
   // set the way
-  status = mid->ways_set(way_id, nds, nd_count, &tags[0]);
+  status = mid->ways_set(way_id, nds, nd_count, way_tags);
   if (status != 0) { std::cerr << "ERROR: Unable to set way.\n"; return 1; }
 
   // commit the setup data
@@ -344,6 +344,102 @@ void test_expire_merge_complete() {
   }
 }
 
+osmNode centroid_node(const xyz &tile) {
+  osmNode node;
+  tile.to_centroid(node.lon, node.lat);
+  return node;
+}
+
+// tests that a line only expires the tiles it passes through, or
+// passes close to.
+void test_expire_line() {
+  options_t opt;
+  opt.expire_tiles_zoom = 3;
+  opt.expire_tiles_zoom_min = 3;
+
+  // along a row, from the centre of one tile to another
+  {
+    expire_tiles et(&opt);
+    tile_output_set set;
+    osmNode nodes[] = { centroid_node(xyz(3, 1, 2)), centroid_node(xyz(3, 5, 2)) };
+    et.from_nodes_line(nodes, 2);
+    et.output_and_destroy(&set);
+
+    ASSERT_EQ(set.m_tiles.size(), 5);
+    std::set<xyz>::iterator itr = set.m_tiles.begin();
+    for (int x = 1; x <= 5; ++x) {
+      ASSERT_EQ(*itr, xyz(3, x, 2)); ++itr;
+    }
+  }
+
+  // diagonally through the corner shared by four tiles
+  {
+    expire_tiles et(&opt);
+    tile_output_set set;
+    osmNode nodes[] = { centroid_node(xyz(3, 3, 3)), centroid_node(xyz(3, 4, 4)) };
+    et.from_nodes_line(nodes, 2);
+    et.output_and_destroy(&set);
+
+    ASSERT_EQ(set.m_tiles.size(), 4);
+    std::set<xyz>::iterator itr = set.m_tiles.begin();
+    ASSERT_EQ(*itr, xyz(3, 3, 3)); ++itr;
+    ASSERT_EQ(*itr, xyz(3, 3, 4)); ++itr;
+    ASSERT_EQ(*itr, xyz(3, 4, 3)); ++itr;
+    ASSERT_EQ(*itr, xyz(3, 4, 4)); ++itr;
+  }
+
+  // across the date line, which only touches the tiles on either edge
+  {
+    expire_tiles et(&opt);
+    tile_output_set set;
+    osmNode nodes[] = { centroid_node(xyz(3, 7, 2)), centroid_node(xyz(3, 0, 2)) };
+    et.from_nodes_line(nodes, 2);
+    et.output_and_destroy(&set);
+
+    ASSERT_EQ(set.m_tiles.size(), 2);
+    std::set<xyz>::iterator itr = set.m_tiles.begin();
+    ASSERT_EQ(*itr, xyz(3, 0, 2)); ++itr;
+    ASSERT_EQ(*itr, xyz(3, 7, 2)); ++itr;
+  }
+}
+
+osmNode tile_node(int zoom, double x, double y) {
+  const double scale = EARTH_CIRCUMFERENCE / (1 << zoom);
+  osmNode node;
+  node.lon = (x - 0.5 * (1 << zoom)) * scale;
+  node.lat = (0.5 * (1 << zoom) - y) * scale;
+  return node;
+}
+
+// tests that a polygon expires the tiles it covers, rather than
+// all of the tiles in its bounding box.
+void test_expire_polygon() {
+  options_t opt;
+  opt.expire_tiles_zoom = 3;
+  opt.expire_tiles_zoom_min = 3;
+  opt.expire_tiles_max_bbox = EARTH_CIRCUMFERENCE;
+
+  expire_tiles et(&opt);
+  tile_output_set set;
+
+  // an L shape, covering two rows of four tiles and two rows of two
+  osmNode nodes[] = {
+    tile_node(3, 1.2, 1.2), tile_node(3, 4.8, 1.2), tile_node(3, 4.8, 2.8),
+    tile_node(3, 2.8, 2.8), tile_node(3, 2.8, 4.8), tile_node(3, 1.2, 4.8),
+    tile_node(3, 1.2, 1.2)
+  };
+  et.from_nodes_poly(nodes, 7, 1);
+  et.output_and_destroy(&set);
+
+  std::set<xyz> check_set;
+  for (int y = 1; y <= 4; ++y) {
+    for (int x = 1; x <= ((y <= 2) ? 4 : 2); ++x) {
+      check_set.insert(xyz(3, x, y));
+    }
+  }
+  assert_tilesets_equal(set.m_tiles, check_set);
+}
+
 } // anonymous namespace
 
 int main(int argc, char *argv[])
@@ -359,6 +455,8 @@ int main(int argc, char *argv[])
     RUN_TEST(test_expire_merge_same);
     RUN_TEST(test_expire_merge_overlap);
     RUN_TEST(test_expire_merge_complete);
+    RUN_TEST(test_expire_line);
+    RUN_TEST(test_expire_polygon);
 
     //passed
     return 0;
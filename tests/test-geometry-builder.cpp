@@ -0,0 +1,272 @@
+#include "geometry-builder.hpp"
+#include "wkb.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdexcept>
+#include <boost/format.hpp>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace {
+
+void run_test(const char* test_name, void (*testfunc)())
+{
+    try
+    {
+        fprintf(stderr, "%s\n", test_name);
+        testfunc();
+    }
+    catch(std::exception& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        fprintf(stderr, "FAIL\n");
+        exit(EXIT_FAILURE);
+    }
+    fprintf(stderr, "PASS\n");
+}
+#define RUN_TEST(x) run_test(#x, &(x))
+#define ASSERT_EQ(a, b) { if (!((a) == (b))) { throw std::runtime_error((boost::format("Expecting %1% == %2%, but %3% != %4%") % #a % #b % (a) % (b)).str()); } }
+
+// builds the node list from "lon lat, lon lat, ..."
+std::vector<osmNode> nodes(const char *coords) {
+    std::vector<osmNode> result;
+    osmNode node;
+    int used = 0;
+    while (sscanf(coords, " %lf %lf%n", &node.lon, &node.lat, &used) == 2) {
+        result.push_back(node);
+        coords += used;
+        if (*coords == ',')
+            ++coords;
+    }
+    return result;
+}
+
+std::string linestring(const char *coords) {
+    std::vector<osmNode> n = nodes(coords);
+    std::string hex;
+    wkb::write_linestring(hex, &n[0], n.size());
+    return hex;
+}
+
+std::string polygon(const char *coords) {
+    std::vector<osmNode> n = nodes(coords);
+    std::string hex;
+    wkb::write_polygon(hex, &n[0], n.size());
+    return hex;
+}
+
+geometry_builder::maybe_wkt_t simple(const char *coords, int polygon, int excludepoly = 0) {
+    geometry_builder builder;
+    builder.set_exclude_broken_polygon(excludepoly);
+    std::vector<osmNode> n = nodes(coords);
+    return builder.get_wkt_simple(n.empty() ? NULL : &n[0], n.size(), polygon);
+}
+
+geometry_builder::maybe_wkts_t split(const char *coords, int polygon, double split_at) {
+    geometry_builder builder;
+    std::vector<osmNode> n = nodes(coords);
+    return builder.get_wkt_split(n.empty() ? NULL : &n[0], n.size(), polygon, split_at);
+}
+
+void test_line() {
+    geometry_builder::maybe_wkt_t wkt = simple("0 0, 1 0, 1 1", 0);
+    ASSERT_EQ(bool(wkt), true);
+    ASSERT_EQ(wkt->geom, linestring("0 0, 1 0, 1 1"));
+    ASSERT_EQ(wkt->area, 0);
+}
+
+void test_line_repeated_nodes() {
+    geometry_builder::maybe_wkt_t wkt = simple("0 0, 0 0, 1 0, 1 0, 1 0, 1 1, 1 1", 0);
+    ASSERT_EQ(bool(wkt), true);
+    ASSERT_EQ(wkt->geom, linestring("0 0, 1 0, 1 1"));
+}
+
+// ways with fewer than two distinct nodes in a row aren't written at all
+void test_degenerate_line() {
+    ASSERT_EQ(bool(simple("0 0", 0)), false);
+    ASSERT_EQ(bool(simple("0 0, 0 0", 0)), false);
+    ASSERT_EQ(bool(simple("0 0, 0 0, 0 0, 0 0", 1)), false);
+
+    ASSERT_EQ(split("0 0, 0 0", 0, 100)->size(), 0);
+    ASSERT_EQ(split("0 0, 0 0, 0 0, 0 0", 1, 100)->size(), 0);
+}
+
+// a closed way which is only a ring because of a repeated node is a line
+void test_closed_degenerate_ring() {
+    geometry_builder::maybe_wkt_t wkt = simple("0 0, 1 1, 1 1, 0 0", 1);
+    ASSERT_EQ(bool(wkt), true);
+    ASSERT_EQ(wkt->geom, linestring("0 0, 1 1, 0 0"));
+    ASSERT_EQ(wkt->area, 0);
+
+    geometry_builder::maybe_wkts_t wkts = split("0 0, 1 1, 1 1, 0 0", 1, 100);
+    ASSERT_EQ(wkts->size(), 1);
+    ASSERT_EQ(wkts->at(0).geom, linestring("0 0, 1 1, 0 0"));
+}
+
+// the ring comes out clockwise from its lowest node, like GEOS normalize()
+void test_polygon() {
+    geometry_builder::maybe_wkt_t wkt = simple("1 1, 0 1, 0 0, 0 0, 1 0, 1 1", 1);
+    ASSERT_EQ(bool(wkt), true);
+    ASSERT_EQ(wkt->geom, polygon("0 0, 0 1, 1 1, 1 0, 0 0"));
+    ASSERT_EQ(wkt->area, 1);
+
+    geometry_builder::maybe_wkts_t wkts = split("1 1, 1 1, 0 1, 0 0, 1 0, 1 1", 1, 0.5);
+    ASSERT_EQ(wkts->size(), 1);
+    ASSERT_EQ(wkts->at(0).geom, polygon("0 0, 0 1, 1 1, 1 0, 0 0"));
+    ASSERT_EQ(wkts->at(0).area, 1);
+}
+
+// a closed way isn't an area unless it is asked to be
+void test_closed_line() {
+    geometry_builder::maybe_wkt_t wkt = simple("0 0, 1 0, 1 1, 0 0", 0);
+    ASSERT_EQ(bool(wkt), true);
+    ASSERT_EQ(wkt->geom, linestring("0 0, 1 0, 1 1, 0 0"));
+}
+
+// self-intersecting rings are left to GEOS, which repairs or drops them
+void test_self_intersecting_ring() {
+    const char *bowtie = "0 0, 2 2, 2 0, 0 2, 0 0";
+
+    ASSERT_EQ(bool(simple(bowtie, 1, 1)), false);
+
+    geometry_builder::maybe_wkt_t wkt = simple(bowtie, 1, 0);
+    ASSERT_EQ(bool(wkt), true);
+    ASSERT_EQ(wkb::is_polygon(wkt->geom), true);
+    ASSERT_EQ(wkt->area > 0, true);
+
+    // a ring going back over itself isn't simple either
+    ASSERT_EQ(bool(simple("0 0, 2 0, 1 0, 1 1, 0 0", 1, 1)), false);
+}
+
+void test_split_line() {
+    geometry_builder::maybe_wkts_t wkts = split("0 0, 0 0, 1 0, 2 0, 2 0", 0, 1.5);
+    ASSERT_EQ(wkts->size(), 2);
+    ASSERT_EQ(wkts->at(0).geom, linestring("0 0, 1 0, 1.5 0"));
+    ASSERT_EQ(wkts->at(1).geom, linestring("1.5 0, 2 0"));
+}
+
+// the areas of the polygons built from the ways, smallest first
+std::vector<double> polygon_areas(const char **ways, bool enable_multi) {
+    std::vector<std::vector<osmNode> > nodelists;
+    for (const char **way = ways; *way; ++way) {
+        nodelists.push_back(nodes(*way));
+    }
+
+    std::vector<const osmNode *> xnodes;
+    std::vector<int> xcount;
+    for (size_t i = 0; i < nodelists.size(); ++i) {
+        xnodes.push_back(&nodelists[i][0]);
+        xcount.push_back(nodelists[i].size());
+    }
+    xnodes.push_back(NULL);
+    xcount.push_back(0);
+
+    geometry_builder builder;
+    geometry_builder::maybe_wkts_t wkts = builder.build_polygons(&xnodes[0], &xcount[0], enable_multi, 1);
+
+    std::vector<double> areas;
+    for (geometry_builder::wkt_itr wkt = wkts->begin(); wkt != wkts->end(); ++wkt) {
+        ASSERT_EQ(wkb::is_polygon(wkt->geom), true);
+        areas.push_back(wkt->area);
+    }
+    std::sort(areas.begin(), areas.end());
+    return areas;
+}
+
+void test_ring_from_several_ways() {
+    const char *ways[] = {"0 0, 5 0, 10 0", "10 0, 10 10", "10 10, 0 10", "0 10, 0 5, 0 0", NULL};
+    std::vector<double> areas = polygon_areas(ways, false);
+    ASSERT_EQ(areas.size(), 1);
+    ASSERT_EQ(areas[0], 100);
+}
+
+// the ways of a ring can come in any order and direction
+void test_ring_from_reversed_ways() {
+    const char *ways[] = {"10 10, 10 0", "0 10, 10 10", "0 0, 5 0, 10 0", "0 0, 0 5, 0 10", NULL};
+    std::vector<double> areas = polygon_areas(ways, false);
+    ASSERT_EQ(areas.size(), 1);
+    ASSERT_EQ(areas[0], 100);
+}
+
+// a ring which doesn't close isn't a polygon
+void test_open_ring() {
+    const char *ways[] = {"0 0, 10 0", "10 0, 10 10", "10 10, 0 10", NULL};
+    ASSERT_EQ(polygon_areas(ways, false).size(), 0);
+}
+
+// an island in a lake is a polygon of its own, not a hole in the lake
+void test_island_in_hole() {
+    const char *ways[] = {"4 4, 6 4, 6 6, 4 6, 4 4",
+                          "0 0, 10 0, 10 10, 0 10, 0 0",
+                          "2 2, 8 2, 8 8, 2 8, 2 2", NULL};
+    std::vector<double> areas = polygon_areas(ways, false);
+    ASSERT_EQ(areas.size(), 2);
+    ASSERT_EQ(areas[0], 4);
+    ASSERT_EQ(areas[1], 64);
+
+    areas = polygon_areas(ways, true);
+    ASSERT_EQ(areas.size(), 1);
+    ASSERT_EQ(areas[0], 68);
+}
+
+// lakes next to each other are both holes, with islands in each
+void test_islands_in_several_holes() {
+    const char *ways[] = {"0 0, 20 0, 20 10, 0 10, 0 0",
+                          "1 1, 9 1, 9 9, 1 9, 1 1",
+                          "11 1, 19 1, 19 9, 11 9, 11 1",
+                          "4 4, 6 4, 6 6, 4 6, 4 4",
+                          "14 4, 16 4, 16 6, 14 6, 14 4", NULL};
+    std::vector<double> areas = polygon_areas(ways, false);
+    ASSERT_EQ(areas.size(), 3);
+    ASSERT_EQ(areas[0], 4);
+    ASSERT_EQ(areas[1], 4);
+    ASSERT_EQ(areas[2], 200 - 2 * 64);
+}
+
+// rings touching at a node are separate polygons
+void test_touching_rings() {
+    const char *ways[] = {"0 0, 1 0, 1 1, 0 1, 0 0", "1 1, 2 1, 2 2, 1 2, 1 1", NULL};
+    std::vector<double> areas = polygon_areas(ways, false);
+    ASSERT_EQ(areas.size(), 2);
+    ASSERT_EQ(areas[0], 1);
+    ASSERT_EQ(areas[1], 1);
+
+    areas = polygon_areas(ways, true);
+    ASSERT_EQ(areas.size(), 1);
+    ASSERT_EQ(areas[0], 2);
+}
+
+// a hole touching the outer ring at a node is still a hole
+void test_hole_touching_outer() {
+    const char *ways[] = {"0 0, 10 0, 10 10, 0 10, 0 5, 0 0", "0 5, 5 3, 5 7, 0 5", NULL};
+    std::vector<double> areas = polygon_areas(ways, false);
+    ASSERT_EQ(areas.size(), 1);
+    ASSERT_EQ(areas[0], 90);
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    //try each test if any fail we will exit
+    RUN_TEST(test_line);
+    RUN_TEST(test_line_repeated_nodes);
+    RUN_TEST(test_degenerate_line);
+    RUN_TEST(test_closed_degenerate_ring);
+    RUN_TEST(test_polygon);
+    RUN_TEST(test_closed_line);
+    RUN_TEST(test_self_intersecting_ring);
+    RUN_TEST(test_split_line);
+    RUN_TEST(test_ring_from_several_ways);
+    RUN_TEST(test_ring_from_reversed_ways);
+    RUN_TEST(test_open_ring);
+    RUN_TEST(test_island_in_hole);
+    RUN_TEST(test_islands_in_several_holes);
+    RUN_TEST(test_touching_rings);
+    RUN_TEST(test_hole_touching_outer);
+
+    //passed
+    return 0;
+}
@@ -0,0 +1,139 @@
+#include "id-tracker.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdexcept>
+#include <boost/format.hpp>
+#include <set>
+#include <vector>
+
+namespace {
+
+void run_test(const char* test_name, void (*testfunc)())
+{
+    try
+    {
+        fprintf(stderr, "%s\n", test_name);
+        testfunc();
+    }
+    catch(std::exception& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        fprintf(stderr, "FAIL\n");
+        exit(EXIT_FAILURE);
+    }
+    fprintf(stderr, "PASS\n");
+}
+#define RUN_TEST(x) run_test(#x, &(x))
+#define ASSERT_EQ(a, b) { if (!((a) == (b))) { throw std::runtime_error((boost::format("Expecting %1% == %2%, but %3% != %4%") % #a % #b % (a) % (b)).str()); } }
+
+// pop everything off the tracker, checking it comes out in order
+void assert_pops_equal(id_tracker &t, const std::set<osmid_t> &ids) {
+    ASSERT_EQ(t.size(), ids.size());
+    for (std::set<osmid_t>::const_iterator itr = ids.begin(); itr != ids.end(); ++itr) {
+        ASSERT_EQ(t.pop_mark(), *itr);
+    }
+    ASSERT_EQ(t.pop_mark(), id_tracker::max());
+    ASSERT_EQ(t.size(), 0);
+}
+
+void test_mark_pop() {
+    id_tracker t;
+    std::set<osmid_t> ids;
+
+    // sparse and dense blocks, negative ids and ids out of order
+    const osmid_t some[] = { 5, 1, 70000, -3, 65535, 65536, 1 };
+    for (size_t i = 0; i < sizeof(some) / sizeof(some[0]); ++i) {
+        t.mark(some[i]);
+        ids.insert(some[i]);
+    }
+    for (osmid_t id = 200000; id < 210000; ++id) {
+        t.mark(id);
+        ids.insert(id);
+    }
+
+    ASSERT_EQ(t.size(), ids.size());
+    for (std::set<osmid_t>::const_iterator itr = ids.begin(); itr != ids.end(); ++itr) {
+        ASSERT_EQ(t.is_marked(*itr), true);
+    }
+    ASSERT_EQ(t.is_marked(2), false);
+    ASSERT_EQ(t.is_marked(209999 + 1), false);
+    ASSERT_EQ(t.is_marked(-65539), false);
+
+    assert_pops_equal(t, ids);
+}
+
+void test_mark_after_pop() {
+    id_tracker t;
+    t.mark(10);
+    t.mark(20);
+    ASSERT_EQ(t.pop_mark(), 10);
+
+    // marking below what has been popped puts it back in front
+    t.mark(5);
+    t.mark(30);
+    ASSERT_EQ(t.size(), 3);
+    ASSERT_EQ(t.pop_mark(), 5);
+    ASSERT_EQ(t.pop_mark(), 20);
+    ASSERT_EQ(t.pop_mark(), 30);
+    ASSERT_EQ(t.pop_mark(), id_tracker::max());
+}
+
+void test_next_mark() {
+    id_tracker t;
+    std::set<osmid_t> ids;
+    for (int i = 0; i < 20000; ++i) {
+        osmid_t id = rand() % 1000000;
+        t.mark(id);
+        ids.insert(id);
+    }
+
+    std::vector<osmid_t> seen;
+    for (osmid_t id = t.next_mark(id_tracker::min()); id_tracker::is_valid(id); id = t.next_mark(id + 1)) {
+        seen.push_back(id);
+    }
+
+    // iterating doesn't remove anything
+    ASSERT_EQ(seen.size(), ids.size());
+    ASSERT_EQ(std::equal(seen.begin(), seen.end(), ids.begin()), true);
+    assert_pops_equal(t, ids);
+}
+
+void test_merge() {
+    id_tracker a, b;
+    std::set<osmid_t> ids;
+    for (int i = 0; i < 50000; ++i) {
+        osmid_t id = rand() % 300000;
+        if (i % 2) {
+            a.mark(id);
+        } else {
+            b.mark(id);
+        }
+        ids.insert(id);
+    }
+    const size_t b_size = b.size();
+
+    a.merge(b);
+    ASSERT_EQ(b.size(), b_size);
+    assert_pops_equal(a, ids);
+
+    b.clear();
+    ASSERT_EQ(b.size(), 0);
+    ASSERT_EQ(b.pop_mark(), id_tracker::max());
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    srand(0);
+
+    //try each test if any fail we will exit
+    RUN_TEST(test_mark_pop);
+    RUN_TEST(test_mark_after_pop);
+    RUN_TEST(test_next_mark);
+    RUN_TEST(test_merge);
+
+    //passed
+    return 0;
+}
@@ -15,7 +15,6 @@
 #include "middle-ram.hpp"
 #include "taginfo_impl.hpp"
 #include "parse.hpp"
-#include "text-tree.hpp"
 
 #include <libpq-fe.h>
 #include <sys/types.h>
@@ -65,6 +65,24 @@ void test_incompatible_args()
     parse_fail(len(a3), a3, "you can not specify both");
 }
 
+void test_prescan_relations()
+{
+    const char* a1[] = {"osm2pgsql", "--prescan-relations", "tests/liechtenstein-2013-08-03.osm.pbf"};
+    options_t options = options_t::parse(len(a1), const_cast<char **>(a1));
+    if (!options.prescan_relations)
+        throw std::logic_error("Expected the relation prescan to be enabled");
+
+    const char* a2[] = {"osm2pgsql", "--prescan-relations", "--append", "--slim", "tests/liechtenstein-2013-08-03.osm.pbf"};
+    options = options_t::parse(len(a2), const_cast<char **>(a2));
+    if (options.prescan_relations)
+        throw std::logic_error("Expected the relation prescan to be ignored in append mode");
+
+    const char* a3[] = {"osm2pgsql", "--prescan-relations", "-"};
+    options = options_t::parse(len(a3), const_cast<char **>(a3));
+    if (options.prescan_relations)
+        throw std::logic_error("Expected the relation prescan to be ignored when reading stdin");
+}
+
 void test_middles()
 {
     const char* a1[] = {"osm2pgsql", "--slim", "tests/liechtenstein-2013-08-03.osm.pbf"};
@@ -288,6 +306,7 @@ int main(int argc, char *argv[])
     //try each test if any fail we will exit
     run_test("test_insufficient_args", test_insufficient_args);
     run_test("test_incompatible_args", test_incompatible_args);
+    run_test("test_prescan_relations", test_prescan_relations);
     run_test("test_middles", test_middles);
     run_test("test_outputs", test_outputs);
     run_test("test_random_perms", test_random_perms);
@@ -0,0 +1,143 @@
+#include "pgsql-id-tracker.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <stdexcept>
+#include <boost/format.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <set>
+#include <string>
+
+#include "tests/common-pg.hpp"
+
+namespace {
+
+std::string conninfo;
+
+void run_test(const char* test_name, void (*testfunc)())
+{
+    try
+    {
+        fprintf(stderr, "%s\n", test_name);
+        testfunc();
+    }
+    catch(std::exception& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        fprintf(stderr, "FAIL\n");
+        exit(EXIT_FAILURE);
+    }
+    fprintf(stderr, "PASS\n");
+}
+#define RUN_TEST(x) run_test(#x, &(x))
+#define ASSERT_EQ(a, b) { if (!((a) == (b))) { throw std::runtime_error((boost::format("Expecting %1% == %2%, but %3% != %4%") % #a % #b % (a) % (b)).str()); } }
+
+// pop everything off the tracker, checking it comes out in order
+void assert_pops_equal(id_tracker &t, const std::set<osmid_t> &ids) {
+    ASSERT_EQ(t.size(), ids.size());
+    for (std::set<osmid_t>::const_iterator itr = ids.begin(); itr != ids.end(); ++itr) {
+        ASSERT_EQ(t.pop_mark(), *itr);
+    }
+    ASSERT_EQ(t.pop_mark(), id_tracker::max());
+    ASSERT_EQ(t.size(), 0);
+}
+
+// more marks than are buffered and popped in one go, with ids marked
+// again after they have been copied to the table
+void test_mark_pop() {
+    pgsql_id_tracker t(conninfo, "test", "mark_pop", true);
+    std::set<osmid_t> ids;
+    for (int i = 0; i < 100000; ++i) {
+        osmid_t id = rand() % 80000 - 1000;
+        t.mark(id);
+        ids.insert(id);
+    }
+
+    ASSERT_EQ(t.is_marked(*ids.begin()), true);
+    ASSERT_EQ(t.is_marked(*ids.rbegin()), true);
+    ASSERT_EQ(t.is_marked(80000), false);
+
+    assert_pops_equal(t, ids);
+}
+
+void test_mark_after_pop() {
+    pgsql_id_tracker t(conninfo, "test", "mark_after_pop", true);
+    t.mark(10);
+    t.mark(20);
+    ASSERT_EQ(t.pop_mark(), 10);
+
+    // marking below what has been popped puts it back in front, and
+    // marking one of the batch again doesn't pop it twice
+    t.mark(5);
+    t.mark(20);
+    t.mark(30);
+    ASSERT_EQ(t.size(), 3);
+    ASSERT_EQ(t.is_marked(5), true);
+    ASSERT_EQ(t.is_marked(10), false);
+    ASSERT_EQ(t.pop_mark(), 5);
+    ASSERT_EQ(t.pop_mark(), 20);
+    ASSERT_EQ(t.pop_mark(), 30);
+    ASSERT_EQ(t.pop_mark(), id_tracker::max());
+}
+
+int table_count(const char *name) {
+    pg::conn_ptr conn = pg::conn::connect(conninfo);
+    pg::result_ptr res = conn->exec(boost::format("SELECT count(*) FROM pg_tables WHERE tablename = '%1%'") % name);
+    return atoi(PQgetvalue(res->get(), 0, 0));
+}
+
+// marks are in the table once committed, and an owned table is dropped
+// when the tracker goes
+void test_commit() {
+    {
+        pgsql_id_tracker t(conninfo, "test", "commit", true);
+        t.mark(1);
+        t.mark(2);
+        t.commit();
+
+        pg::conn_ptr conn = pg::conn::connect(conninfo);
+        pg::result_ptr res = conn->exec("SELECT count(*) FROM test_commit");
+        ASSERT_EQ(atoi(PQgetvalue(res->get(), 0, 0)), 2);
+
+        ASSERT_EQ(t.pop_mark(), 1);
+        t.mark(3);
+    }
+    ASSERT_EQ(table_count("test_commit"), 0);
+}
+
+// a tracker can be used through the in-memory tracker's interface
+void test_as_id_tracker() {
+    boost::scoped_ptr<id_tracker> t(new pgsql_id_tracker(conninfo, "test", "base", true));
+    std::set<osmid_t> ids;
+    for (osmid_t id = 100; id > 0; id -= 3) {
+        t->mark(id);
+        ids.insert(id);
+    }
+    assert_pops_equal(*t, ids);
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    boost::scoped_ptr<pg::tempdb> db;
+
+    try {
+        db.reset(new pg::tempdb);
+    } catch (const std::exception &e) {
+        std::cerr << "Unable to setup database: " << e.what() << "\n";
+        return 77; // <-- code to skip this test.
+    }
+    conninfo = db->conninfo();
+    srand(0);
+
+    //try each test if any fail we will exit
+    RUN_TEST(test_mark_pop);
+    RUN_TEST(test_mark_after_pop);
+    RUN_TEST(test_commit);
+    RUN_TEST(test_as_id_tracker);
+
+    //passed
+    return 0;
+}
@@ -0,0 +1,140 @@
+#include "spatial-order.hpp"
+#include "reprojection.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdexcept>
+#include <boost/format.hpp>
+#include <vector>
+
+#define EARTH_CIRCUMFERENCE (40075016.68)
+
+namespace {
+
+void run_test(const char* test_name, void (*testfunc)())
+{
+    try
+    {
+        fprintf(stderr, "%s\n", test_name);
+        testfunc();
+    }
+    catch(std::exception& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        fprintf(stderr, "FAIL\n");
+        exit(EXIT_FAILURE);
+    }
+    fprintf(stderr, "PASS\n");
+}
+#define RUN_TEST(x) run_test(#x, &(x))
+#define ASSERT_EQ(a, b) { if (!((a) == (b))) { throw std::runtime_error((boost::format("Expecting %1% == %2%, but %3% != %4%") % #a % #b % (a) % (b)).str()); } }
+
+// the first 4^n keys fill the 2^n x 2^n block in the corner, each cell
+// exactly once, and consecutive keys are neighbouring cells
+void test_hilbert_locality() {
+    const uint32_t side = 64;
+    std::vector<int> cell(side * side, -1);
+
+    for (uint32_t x = 0; x < side; ++x) {
+        for (uint32_t y = 0; y < side; ++y) {
+            const uint32_t key = spatial_order::hilbert_key(x, y);
+            ASSERT_EQ(key < side * side, true);
+            ASSERT_EQ(cell[key], -1);
+            cell[key] = x * side + y;
+        }
+    }
+
+    for (uint32_t key = 1; key < side * side; ++key) {
+        const int dx = abs(cell[key] / int(side) - cell[key - 1] / int(side));
+        const int dy = abs(cell[key] % int(side) - cell[key - 1] % int(side));
+        ASSERT_EQ(dx + dy, 1);
+    }
+}
+
+void test_hilbert_range() {
+    const uint32_t last = (1 << 15) - 1;
+    ASSERT_EQ(spatial_order::hilbert_key(0, 0), 0);
+
+    // the curve ends in the other corner along the x axis
+    ASSERT_EQ(spatial_order::hilbert_key(last, 0), last * (last + 2));
+
+    ASSERT_EQ(spatial_order::hilbert_key(last, last) < (1u << 30), true);
+    ASSERT_EQ(spatial_order::hilbert_key(last, last) != spatial_order::unknown_key, true);
+}
+
+void test_location_key() {
+    reprojection proj(PROJ_SPHERE_MERC);
+    const double half = EARTH_CIRCUMFERENCE / 2;
+    const uint32_t last = (1 << 15) - 1;
+
+    // the north west corner is the first cell, the south east the last
+    ASSERT_EQ(spatial_order::location_key(&proj, -half + 1, half - 1), spatial_order::hilbert_key(0, 0));
+    ASSERT_EQ(spatial_order::location_key(&proj, half - 1, -half + 1), spatial_order::hilbert_key(last, last));
+
+    // anything outside the extent is clamped onto its edge
+    ASSERT_EQ(spatial_order::location_key(&proj, -2 * half, 2 * half), spatial_order::hilbert_key(0, 0));
+    ASSERT_EQ(spatial_order::location_key(&proj, 2 * half, -2 * half), spatial_order::hilbert_key(last, last));
+
+    // points within a cell get the same key
+    const double cell = EARTH_CIRCUMFERENCE / (1 << 15);
+    ASSERT_EQ(spatial_order::location_key(&proj, 0.2 * cell, 0.2 * cell),
+              spatial_order::location_key(&proj, 0.7 * cell, 0.7 * cell));
+}
+
+void test_unknown_key() {
+    spatial_order order;
+    ASSERT_EQ(order.get(1), spatial_order::unknown_key);
+
+    order.add(10, 5);
+    order.add(20, 6);
+    ASSERT_EQ(order.get(10), 5);
+    ASSERT_EQ(order.get(20), 6);
+    ASSERT_EQ(order.get(1), spatial_order::unknown_key);
+    ASSERT_EQ(order.get(15), spatial_order::unknown_key);
+    ASSERT_EQ(order.get(30), spatial_order::unknown_key);
+
+    order.clear();
+    ASSERT_EQ(order.size(), 0);
+    ASSERT_EQ(order.get(10), spatial_order::unknown_key);
+}
+
+void test_add_out_of_order() {
+    spatial_order order;
+    for (osmid_t id = 100; id > 0; --id) {
+        order.add(id, uint32_t(id * 2));
+    }
+    ASSERT_EQ(order.size(), 100);
+    for (osmid_t id = 1; id <= 100; ++id) {
+        ASSERT_EQ(order.get(id), uint32_t(id * 2));
+    }
+}
+
+// an id added again, as in diff processing, gets the last key
+void test_add_again() {
+    spatial_order order;
+    order.add(1, 10);
+    order.add(2, 20);
+    order.add(1, 11);
+    order.add(3, 30);
+    order.add(1, 12);
+    ASSERT_EQ(order.get(1), 12);
+    ASSERT_EQ(order.get(2), 20);
+    ASSERT_EQ(order.get(3), 30);
+    ASSERT_EQ(order.size(), 3);
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    //try each test if any fail we will exit
+    RUN_TEST(test_hilbert_locality);
+    RUN_TEST(test_hilbert_range);
+    RUN_TEST(test_location_key);
+    RUN_TEST(test_unknown_key);
+    RUN_TEST(test_add_out_of_order);
+    RUN_TEST(test_add_again);
+
+    //passed
+    return 0;
+}
@@ -0,0 +1,135 @@
+#include "string-interner.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace {
+
+void run_test(const char* test_name, void (*testfunc)())
+{
+    try
+    {
+        fprintf(stderr, "%s\n", test_name);
+        testfunc();
+    }
+    catch(std::exception& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        fprintf(stderr, "FAIL\n");
+        exit(EXIT_FAILURE);
+    }
+    fprintf(stderr, "PASS\n");
+}
+#define RUN_TEST(x) run_test(#x, &(x))
+#define ASSERT_EQ(a, b) { if (!((a) == (b))) { throw std::runtime_error((boost::format("Expecting %1% == %2%, but %3% != %4%") % #a % #b % (a) % (b)).str()); } }
+
+void test_intern() {
+    string_interner strings;
+    const string_interner::handle outer = strings.intern("outer");
+    const string_interner::handle inner = strings.intern("inner");
+
+    ASSERT_EQ(outer == inner, false);
+    ASSERT_EQ(strings.intern("outer"), outer);
+    ASSERT_EQ(strings.intern("outer:x", 5), outer);
+    ASSERT_EQ(std::string(strings.get(inner)), "inner");
+    ASSERT_EQ(strings.size(), size_t(2));
+
+    // the same text is always at the same place
+    ASSERT_EQ(strings.text("inner"), strings.get(inner));
+
+    // the empty string is a string like any other
+    const string_interner::handle empty = strings.intern("");
+    ASSERT_EQ(std::string(strings.get(empty)), "");
+    ASSERT_EQ(strings.size(), size_t(3));
+}
+
+void test_find() {
+    string_interner strings;
+    string_interner::handle h = 0;
+    ASSERT_EQ(strings.find("highway", 7, &h), false);
+
+    const string_interner::handle highway = strings.intern("highway");
+    ASSERT_EQ(strings.find("highway", 7, &h), true);
+    ASSERT_EQ(h, highway);
+    ASSERT_EQ(strings.find("highwa", 6, &h), false);
+    ASSERT_EQ(strings.size(), size_t(1));
+}
+
+// enough strings, and long enough ones, that the tables grow and the text
+// goes into many blocks
+void test_many() {
+    string_interner strings;
+    std::vector<string_interner::handle> handles;
+    std::vector<const char *> texts;
+    const std::string padding(1000, 'x');
+
+    for (int i = 0; i < 100000; ++i) {
+        std::string str = (boost::format("key%1%") % i).str();
+        if (i % 1000 == 0) {
+            str += padding;
+        }
+        handles.push_back(strings.intern(str.c_str()));
+        texts.push_back(strings.get(handles.back()));
+    }
+    ASSERT_EQ(strings.size(), size_t(100000));
+
+    for (int i = 0; i < 100000; ++i) {
+        std::string str = (boost::format("key%1%") % i).str();
+        if (i % 1000 == 0) {
+            str += padding;
+        }
+        ASSERT_EQ(strings.intern(str.c_str()), handles[i]);
+        // nothing moved while the others were added
+        ASSERT_EQ(strings.get(handles[i]), texts[i]);
+        ASSERT_EQ(std::string(texts[i]), str);
+    }
+}
+
+void intern_all(string_interner *strings, int offset, std::vector<string_interner::handle> *handles) {
+    for (int i = 0; i < 20000; ++i) {
+        const int n = (i + offset) % 20000;
+        (*handles)[n] = strings->intern((boost::format("role%1%") % n).str().c_str());
+    }
+}
+
+// threads adding the same strings in a different order get the same handles
+void test_threads() {
+    string_interner strings;
+    const int thread_count = 4;
+    std::vector<std::vector<string_interner::handle> > handles(thread_count, std::vector<string_interner::handle>(20000));
+
+    boost::thread_group threads;
+    for (int t = 0; t < thread_count; ++t) {
+        threads.create_thread(boost::bind(intern_all, &strings, t * 5000, &handles[t]));
+    }
+    threads.join_all();
+
+    ASSERT_EQ(strings.size(), size_t(20000));
+    for (int t = 1; t < thread_count; ++t) {
+        for (int i = 0; i < 20000; ++i) {
+            ASSERT_EQ(handles[t][i], handles[0][i]);
+        }
+    }
+    ASSERT_EQ(std::string(strings.get(handles[0][1234])), "role1234");
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    //try each test if any fail we will exit
+    RUN_TEST(test_intern);
+    RUN_TEST(test_find);
+    RUN_TEST(test_many);
+    RUN_TEST(test_threads);
+
+    //passed
+    return 0;
+}
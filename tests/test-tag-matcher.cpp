@@ -0,0 +1,102 @@
+#include "taginfo_impl.hpp"
+#include "wildcmp.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <boost/format.hpp>
+
+namespace {
+
+void run_test(const char* test_name, void (*testfunc)())
+{
+    try
+    {
+        fprintf(stderr, "%s\n", test_name);
+        testfunc();
+    }
+    catch(std::exception& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        fprintf(stderr, "FAIL\n");
+        exit(EXIT_FAILURE);
+    }
+    fprintf(stderr, "PASS\n");
+}
+#define RUN_TEST(x) run_test(#x, &(x))
+#define ASSERT_EQ(a, b) { if (!((a) == (b))) { throw std::runtime_error((boost::format("Expecting %1% == %2%, but %3% != %4%") % #a % #b % (a) % (b)).str()); } }
+
+const char *names[] = {
+    "note:*", "name", "source:*", "NAME", "highway", "*:source", "a?c",
+    "tiger:*", "tiger:county", "building", "it:fvg:*", "it:*", "ref", "*",
+    NULL
+};
+
+const char *keys[] = {
+    "name", "Name", "NAME", "note", "note:", "note:en", "NOTE:de", "source",
+    "source:name", "highway", "Highway", "abc", "aBc", "ac", "abbc",
+    "tiger:county", "tiger:cfcc", "it:fvg:ctrn", "it:fvg", "it:x", "ref",
+    "name:source", ":source", "", "x", "building:levels",
+    NULL
+};
+
+// the index of the first name matching key, the way the style was matched
+// before the matcher
+int first_match(const std::vector<std::string> &list, const char *key) {
+    for (size_t i = 0; i < list.size(); ++i) {
+        if (wildMatch(list[i].c_str(), key)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void test_same_as_wildmatch() {
+    // every prefix of the name list, so entries are shadowed in every way
+    for (int count = 0; names[count]; ++count) {
+        tag_matcher matcher;
+        std::vector<std::string> list;
+        for (int i = 0; i <= count; ++i) {
+            matcher.add(names[i]);
+            list.push_back(names[i]);
+        }
+
+        for (int k = 0; keys[k]; ++k) {
+            ASSERT_EQ(matcher.find(keys[k]), first_match(list, keys[k]));
+        }
+    }
+}
+
+void test_export_list() {
+    export_list exlist;
+    taginfo info;
+    info.name = "note:*";
+    info.flags = FLAG_DELETE;
+    exlist.add(OSMTYPE_NODE, info);
+    info.name = "amenity";
+    info.flags = FLAG_POLYGON;
+    exlist.add(OSMTYPE_NODE, info);
+
+    ASSERT_EQ(exlist.find(OSMTYPE_NODE, "note:en")->flags, FLAG_DELETE);
+    ASSERT_EQ(exlist.find(OSMTYPE_NODE, "amenity")->flags, FLAG_POLYGON);
+    ASSERT_EQ(exlist.find(OSMTYPE_NODE, "shop") == NULL, true);
+    ASSERT_EQ(exlist.find(OSMTYPE_WAY, "amenity") == NULL, true);
+
+    // copies have their own matcher
+    export_list copy(exlist);
+    ASSERT_EQ(copy.find(OSMTYPE_NODE, "amenity")->name, std::string("amenity"));
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    //try each test if any fail we will exit
+    RUN_TEST(test_same_as_wildmatch);
+    RUN_TEST(test_export_list);
+
+    //passed
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include "taglist.hpp"
+#include "keyvals.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdexcept>
+#include <string>
+#include <boost/format.hpp>
+
+namespace {
+
+void run_test(const char* test_name, void (*testfunc)())
+{
+    try
+    {
+        fprintf(stderr, "%s\n", test_name);
+        testfunc();
+    }
+    catch(std::exception& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        fprintf(stderr, "FAIL\n");
+        exit(EXIT_FAILURE);
+    }
+    fprintf(stderr, "PASS\n");
+}
+#define RUN_TEST(x) run_test(#x, &(x))
+#define ASSERT_EQ(a, b) { if (!((a) == (b))) { throw std::runtime_error((boost::format("Expecting %1% == %2%, but %3% != %4%") % #a % #b % (a) % (b)).str()); } }
+
+std::string str(const char *s) {
+    return s ? std::string(s) : std::string("(null)");
+}
+
+void test_add_get() {
+    taglist tags;
+    ASSERT_EQ(tags.empty(), true);
+
+    tags.add("highway", "primary");
+    tags.add("name", 4, "Main Streetxx", 11);
+    ASSERT_EQ(tags.size(), size_t(2));
+
+    ASSERT_EQ(str(tags.key(0)), "highway");
+    ASSERT_EQ(str(tags.value(0)), "primary");
+    ASSERT_EQ(str(tags.key(1)), "name");
+    ASSERT_EQ(str(tags.value(1)), "Main Street");
+
+    ASSERT_EQ(str(tags.get("name")), "Main Street");
+    ASSERT_EQ(str(tags.get(taglist::intern("highway"))), "primary");
+    ASSERT_EQ(str(tags.get("surface")), "(null)");
+}
+
+void test_intern() {
+    const taglist::key_id id = taglist::intern("building");
+    ASSERT_EQ(taglist::intern("building:levels", 8), id);
+    ASSERT_EQ(str(taglist::key_name(id)), "building");
+
+    taglist tags;
+    tags.add("building", "yes");
+    ASSERT_EQ(tags.id(0), id);
+    // the key text is shared between all lists
+    ASSERT_EQ(tags.key(0), taglist::key_name(id));
+}
+
+void test_clear() {
+    taglist tags;
+    tags.add("amenity", "pub");
+    tags.clear();
+    ASSERT_EQ(tags.size(), size_t(0));
+    ASSERT_EQ(str(tags.get("amenity")), "(null)");
+
+    tags.add("shop", "bakery");
+    ASSERT_EQ(tags.size(), size_t(1));
+    ASSERT_EQ(str(tags.get("shop")), "bakery");
+}
+
+void test_keyval() {
+    taglist tags;
+    tags.add("a", "1");
+    tags.add("b", "2");
+    tags.add("c", "3");
+
+    struct keyval list;
+    tags.to_keyval(&list);
+    ASSERT_EQ(keyval::countList(&list), 3u);
+    // last to first, the order the parsers used to give
+    ASSERT_EQ(str(keyval::firstItem(&list)->key), "c");
+    ASSERT_EQ(str(keyval::getItem(&list, "a")), "1");
+
+    taglist copy;
+    copy.from_keyval(&list);
+    ASSERT_EQ(copy.size(), size_t(3));
+    for (size_t i = 0; i < tags.size(); ++i) {
+        ASSERT_EQ(copy.id(i), tags.id(i));
+        ASSERT_EQ(str(copy.value(i)), str(tags.value(i)));
+    }
+
+    keyval::resetList(&list);
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    //try each test if any fail we will exit
+    RUN_TEST(test_add_get);
+    RUN_TEST(test_intern);
+    RUN_TEST(test_clear);
+    RUN_TEST(test_keyval);
+
+    //passed
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include "text-scan.hpp"
+#include "pgsql.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdexcept>
+#include <string>
+#include <boost/format.hpp>
+
+namespace {
+
+void run_test(const char* test_name, void (*testfunc)())
+{
+    try
+    {
+        fprintf(stderr, "%s\n", test_name);
+        testfunc();
+    }
+    catch(std::exception& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        fprintf(stderr, "FAIL\n");
+        exit(EXIT_FAILURE);
+    }
+    fprintf(stderr, "PASS\n");
+}
+#define RUN_TEST(x) run_test(#x, &(x))
+#define ASSERT_EQ(a, b) { if (!((a) == (b))) { throw std::runtime_error((boost::format("Expecting %1% == %2%, but %3% != %4%") % #a % #b % (a) % (b)).str()); } }
+
+// the same text escaped a char at a time
+std::string escape_slowly(const std::string &src) {
+    std::string dst;
+    for (size_t i = 0; i < src.size(); ++i) {
+        switch (src[i]) {
+            case '\\': dst.append("\\\\"); break;
+            case '\n': dst.append("\\\n"); break;
+            case '\r': dst.append("\\\r"); break;
+            case '\t': dst.append("\\\t"); break;
+            default:   dst.push_back(src[i]); break;
+        }
+    }
+    return dst;
+}
+
+// the special byte at every position of strings long enough to take a
+// few blocks of every size
+void test_plain_prefix() {
+    const char specials[] = "\\\"\t\n\r";
+    for (size_t len = 0; len < 100; ++len) {
+        std::string str(len, 'a');
+        ASSERT_EQ(text_scan::plain_prefix(str.c_str(), len), len);
+        for (size_t pos = 0; pos < len; ++pos) {
+            for (const char *special = specials; *special; ++special) {
+                str[pos] = *special;
+                ASSERT_EQ(text_scan::plain_prefix(str.c_str(), len), pos);
+                // other control chars and UTF-8 don't need escaping
+                str[pos] = (pos % 2) ? '\x01' : '\xc3';
+                ASSERT_EQ(text_scan::plain_prefix(str.c_str(), len), len);
+                str[pos] = 'a';
+            }
+        }
+    }
+}
+
+void test_ascii_prefix() {
+    for (size_t len = 0; len < 100; ++len) {
+        std::string str(len, '\t');
+        ASSERT_EQ(text_scan::ascii_prefix(str.c_str(), len), len);
+        for (size_t pos = 0; pos < len; ++pos) {
+            str[pos] = '\x80';
+            ASSERT_EQ(text_scan::ascii_prefix(str.c_str(), len), pos);
+            str[pos] = '\xff';
+            ASSERT_EQ(text_scan::ascii_prefix(str.c_str(), len), pos);
+            str[pos] = '\x7f';
+            ASSERT_EQ(text_scan::ascii_prefix(str.c_str(), len), len);
+            str[pos] = '\t';
+        }
+    }
+}
+
+void test_escape() {
+    const char *chars = "ab\\\"\t\n\r\xc3\xa4";
+    srand(42);
+    for (int i = 0; i < 10000; ++i) {
+        std::string src;
+        const int len = rand() % 80;
+        for (int c = 0; c < len; ++c) {
+            // mostly plain text, like real tag values
+            src.push_back(chars[(rand() % 8) ? rand() % 2 : rand() % 9]);
+        }
+
+        std::string dst("prefix");
+        escape(src.c_str(), dst);
+        ASSERT_EQ(dst, "prefix" + escape_slowly(src));
+
+        char out[256];
+        escape(out, sizeof(out), src.c_str());
+        ASSERT_EQ(std::string(out), escape_slowly(src));
+    }
+}
+
+void test_escape_truncated() {
+    char out[8];
+    escape(out, sizeof(out), "abcdefgh");
+    ASSERT_EQ(std::string(out), "abcde");
+
+    escape(out, sizeof(out), "abc\tdefgh");
+    ASSERT_EQ(std::string(out), "abc\\\t");
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    //try each test if any fail we will exit
+    RUN_TEST(test_plain_prefix);
+    RUN_TEST(test_ascii_prefix);
+    RUN_TEST(test_escape);
+    RUN_TEST(test_escape_truncated);
+
+    //passed
+    return 0;
+}
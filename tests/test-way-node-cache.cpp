@@ -0,0 +1,94 @@
+#include "way-node-cache.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdexcept>
+#include <boost/format.hpp>
+
+namespace {
+
+void run_test(const char* test_name, void (*testfunc)())
+{
+    try
+    {
+        fprintf(stderr, "%s\n", test_name);
+        testfunc();
+    }
+    catch(std::exception& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        fprintf(stderr, "FAIL\n");
+        exit(EXIT_FAILURE);
+    }
+    fprintf(stderr, "PASS\n");
+}
+#define RUN_TEST(x) run_test(#x, &(x))
+#define ASSERT_EQ(a, b) { if (!((a) == (b))) { throw std::runtime_error((boost::format("Expecting %1% == %2%, but %3% != %4%") % #a % #b % (a) % (b)).str()); } }
+
+// whether the way is cached, checking its nodes if it is
+bool cached(way_node_cache &cache, osmid_t id, int expected_count) {
+    int count = -1;
+    struct osmNode *nodes = cache.get(id, &count);
+    if (nodes == NULL) {
+        return false;
+    }
+    ASSERT_EQ(count, expected_count);
+    for (int i = 0; i < count; ++i) {
+        ASSERT_EQ(nodes[i].lon, double(id));
+        ASSERT_EQ(nodes[i].lat, double(i));
+    }
+    free(nodes);
+    return true;
+}
+
+void set_way(way_node_cache &cache, osmid_t id, int count) {
+    struct osmNode nodes[100];
+    for (int i = 0; i < count; ++i) {
+        nodes[i].lon = id;
+        nodes[i].lat = i;
+    }
+    cache.set(id, nodes, count);
+}
+
+void test_get_set() {
+    way_node_cache cache(1 << 20);
+    ASSERT_EQ(cached(cache, 1, 0), false);
+
+    set_way(cache, 1, 10);
+    set_way(cache, 2, 0);
+    ASSERT_EQ(cached(cache, 1, 10), true);
+    ASSERT_EQ(cached(cache, 2, 0), true);
+    ASSERT_EQ(cached(cache, 3, 0), false);
+
+    ASSERT_EQ(cache.hits(), 2);
+    ASSERT_EQ(cache.misses(), 2);
+}
+
+void test_least_recently_used_dropped() {
+    // room for a few ways of 100 nodes
+    way_node_cache cache(4 * 100 * sizeof(osmNode));
+
+    set_way(cache, 1, 100);
+    set_way(cache, 2, 100);
+    set_way(cache, 3, 100);
+    // using 1 makes 2 the least recently used
+    ASSERT_EQ(cached(cache, 1, 100), true);
+    set_way(cache, 4, 100);
+
+    ASSERT_EQ(cached(cache, 2, 100), false);
+    ASSERT_EQ(cached(cache, 1, 100), true);
+    ASSERT_EQ(cached(cache, 3, 100), true);
+    ASSERT_EQ(cached(cache, 4, 100), true);
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    //try each test if any fail we will exit
+    RUN_TEST(test_get_set);
+    RUN_TEST(test_least_recently_used_dropped);
+
+    //passed
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include "wkb.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdexcept>
+#include <string>
+#include <boost/format.hpp>
+
+namespace {
+
+void run_test(const char* test_name, void (*testfunc)())
+{
+    try
+    {
+        fprintf(stderr, "%s\n", test_name);
+        testfunc();
+    }
+    catch(std::exception& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        fprintf(stderr, "FAIL\n");
+        exit(EXIT_FAILURE);
+    }
+    fprintf(stderr, "PASS\n");
+}
+#define RUN_TEST(x) run_test(#x, &(x))
+#define ASSERT_EQ(a, b) { if (!((a) == (b))) { throw std::runtime_error((boost::format("Expecting %1% == %2%, but %3% != %4%") % #a % #b % (a) % (b)).str()); } }
+
+void test_point() {
+    std::string wkb;
+    wkb::write_point(wkb, 1.0, -2.0);
+    ASSERT_EQ(wkb, std::string("0101000000000000000000F03F00000000000000C0"));
+}
+
+void test_linestring() {
+    const osmNode nodes[] = { { 0.0, 1.0 }, { 2.0, 0.5 } };
+    std::string wkb;
+    wkb::write_linestring(wkb, nodes, 2);
+    ASSERT_EQ(wkb, std::string("010200000002000000"
+                               "0000000000000000000000000000F03F"
+                               "0000000000000040000000000000E03F"));
+}
+
+void test_is_polygon() {
+    const osmNode nodes[] = { { 0.0, 0.0 }, { 1.0, 0.0 }, { 1.0, 1.0 }, { 0.0, 0.0 } };
+    std::string poly, line, point;
+    wkb::write_polygon(poly, nodes, 4);
+    wkb::write_linestring(line, nodes, 4);
+    wkb::write_point(point, 0.0, 0.0);
+
+    ASSERT_EQ(wkb::is_polygon(poly), true);
+    ASSERT_EQ(wkb::is_polygon(line), false);
+    ASSERT_EQ(wkb::is_polygon(point), false);
+
+    // big endian and EWKB multipolygon with an SRID, as written by PostGIS
+    ASSERT_EQ(wkb::is_polygon("0000000006"), true);
+    ASSERT_EQ(wkb::is_polygon("0106000020E6100000"), true);
+    ASSERT_EQ(wkb::is_polygon("0000000002"), false);
+
+    // WKT or garbage is never a polygon
+    ASSERT_EQ(wkb::is_polygon("POLYGON((0 0,1 0,1 1,0 0))"), false);
+    ASSERT_EQ(wkb::is_polygon(""), false);
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    //try each test if any fail we will exit
+    RUN_TEST(test_point);
+    RUN_TEST(test_linestring);
+    RUN_TEST(test_is_polygon);
+
+    //passed
+    return 0;
+}
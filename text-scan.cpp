@@ -0,0 +1,149 @@
+/* Scanning text a block at a time, see text-scan.hpp */
+
+#include "text-scan.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define TEXT_SCAN_SSE2
+#endif
+
+// AVX2 is compiled in for its own functions only, and used if the CPU has it
+#if defined(TEXT_SCAN_SSE2) && (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#include <immintrin.h>
+#define TEXT_SCAN_AVX2
+#endif
+
+namespace {
+
+inline bool is_special(unsigned char c) {
+    return c == '\\' || c == '"' || c == '\t' || c == '\n' || c == '\r';
+}
+
+size_t plain_prefix_scalar(const char *str, size_t len) {
+    size_t i = 0;
+    while (i < len && !is_special(str[i]))
+        ++i;
+    return i;
+}
+
+size_t ascii_prefix_scalar(const char *str, size_t len) {
+    size_t i = 0;
+    while (i < len && !(str[i] & 0x80))
+        ++i;
+    return i;
+}
+
+#ifdef TEXT_SCAN_SSE2
+size_t plain_prefix_sse2(const char *str, size_t len) {
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(str + i));
+        const __m128i found = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, backslash), _mm_cmpeq_epi8(v, quote)),
+            _mm_or_si128(_mm_cmpeq_epi8(v, tab),
+                         _mm_or_si128(_mm_cmpeq_epi8(v, newline), _mm_cmpeq_epi8(v, cr))));
+        const int mask = _mm_movemask_epi8(found);
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return i + plain_prefix_scalar(str + i, len - i);
+}
+
+size_t ascii_prefix_sse2(const char *str, size_t len) {
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        const int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(str + i)));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return i + ascii_prefix_scalar(str + i, len - i);
+}
+#endif
+
+#ifdef TEXT_SCAN_AVX2
+__attribute__((target("avx2")))
+size_t plain_prefix_avx2(const char *str, size_t len) {
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
+
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)(str + i));
+        const __m256i found = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, backslash), _mm256_cmpeq_epi8(v, quote)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, tab),
+                            _mm256_or_si256(_mm256_cmpeq_epi8(v, newline), _mm256_cmpeq_epi8(v, cr))));
+        const unsigned int mask = _mm256_movemask_epi8(found);
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    // the rest is shorter than a block, which the SSE2 scan may still get
+    return i + plain_prefix_sse2(str + i, len - i);
+}
+
+__attribute__((target("avx2")))
+size_t ascii_prefix_avx2(const char *str, size_t len) {
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        const unsigned int mask = _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)(str + i)));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return i + ascii_prefix_sse2(str + i, len - i);
+}
+#endif
+
+typedef size_t (*scan_fn)(const char *, size_t);
+
+struct scans {
+    scan_fn plain_prefix;
+    scan_fn ascii_prefix;
+
+    scans() {
+#if defined(TEXT_SCAN_AVX2)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            plain_prefix = plain_prefix_avx2;
+            ascii_prefix = ascii_prefix_avx2;
+            return;
+        }
+#endif
+#if defined(TEXT_SCAN_SSE2)
+        plain_prefix = plain_prefix_sse2;
+        ascii_prefix = ascii_prefix_sse2;
+#else
+        plain_prefix = plain_prefix_scalar;
+        ascii_prefix = ascii_prefix_scalar;
+#endif
+    }
+};
+
+// picked on first use, which is thread safe as the result is always the same
+const scans &best_scans() {
+    static const scans s;
+    return s;
+}
+
+} // anonymous namespace
+
+namespace text_scan {
+
+size_t plain_prefix(const char *str, size_t len) {
+    return best_scans().plain_prefix(str, len);
+}
+
+size_t ascii_prefix(const char *str, size_t len) {
+    return best_scans().ascii_prefix(str, len);
+}
+
+}
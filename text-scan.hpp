@@ -0,0 +1,27 @@
+/* Scanning text for the bytes escaping or sanitising has to look at.
+ *
+ * Most tag values are plain ASCII that nothing has to be done to, so the
+ * escape functions find the next byte that needs work with these and copy
+ * everything before it in one go. The scans look at 16 (SSE2) or 32 (AVX2)
+ * bytes at a time where the CPU has them, which is checked at run time, and
+ * fall back to a byte at a time elsewhere.
+*/
+
+#ifndef TEXT_SCAN_H
+#define TEXT_SCAN_H
+
+#include <stddef.h>
+
+namespace text_scan {
+
+/* The length of the start of str, of at most len bytes, without any of
+ * the bytes the escape functions change: backslash, double quote, tab,
+ * newline and carriage return. */
+size_t plain_prefix(const char *str, size_t len);
+
+/* The length of the start of str, of at most len bytes, which is ASCII */
+size_t ascii_prefix(const char *str, size_t len);
+
+}
+
+#endif
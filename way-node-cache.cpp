@@ -0,0 +1,74 @@
+#include "way-node-cache.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+way_node_cache::way_node_cache(size_t max_bytes)
+    : max_bytes(max_bytes), used_bytes(0), hit_count(0), miss_count(0) {
+}
+
+way_node_cache::~way_node_cache() {
+}
+
+size_t way_node_cache::entry_bytes(size_t node_count) {
+    return sizeof(osmNode) * node_count + sizeof(map_t::value_type) + 4 * sizeof(void *);
+}
+
+struct osmNode *way_node_cache::get(osmid_t id, int *count) {
+    boost::mutex::scoped_lock lock(mutex);
+
+    map_t::iterator itr = ways.find(id);
+    if (itr == ways.end()) {
+        ++miss_count;
+        return NULL;
+    }
+    ++hit_count;
+
+    //move it to the front so it is dropped last
+    lru.splice(lru.begin(), lru, itr->second.lru);
+
+    const std::vector<osmNode> &nodes = itr->second.nodes;
+    struct osmNode *copy = (struct osmNode *)malloc(sizeof(struct osmNode) * (nodes.size() + 1));
+    if (!nodes.empty()) {
+        memcpy(copy, &nodes[0], sizeof(struct osmNode) * nodes.size());
+    }
+    *count = nodes.size();
+    return copy;
+}
+
+void way_node_cache::set(osmid_t id, const struct osmNode *nodes, int count) {
+    const size_t bytes = entry_bytes(count);
+    if (bytes > max_bytes) {
+        return;
+    }
+
+    boost::mutex::scoped_lock lock(mutex);
+
+    if (ways.find(id) != ways.end()) {
+        return;
+    }
+
+    //make space by dropping the least recently used ways
+    while (used_bytes + bytes > max_bytes && !lru.empty()) {
+        map_t::iterator itr = ways.find(lru.back());
+        used_bytes -= entry_bytes(itr->second.nodes.size());
+        ways.erase(itr);
+        lru.pop_back();
+    }
+
+    lru.push_front(id);
+    entry &e = ways[id];
+    e.nodes.assign(nodes, nodes + count);
+    e.lru = lru.begin();
+    used_bytes += bytes;
+}
+
+size_t way_node_cache::hits() const {
+    boost::mutex::scoped_lock lock(mutex);
+    return hit_count;
+}
+
+size_t way_node_cache::misses() const {
+    boost::mutex::scoped_lock lock(mutex);
+    return miss_count;
+}
@@ -0,0 +1,52 @@
+/* Bounded cache of the node locations of ways.
+ *
+ * Ways which are members of several relations, like coastlines and
+ * boundaries, have their nodes looked up again for every relation. This
+ * keeps the locations of recently used ways so that only the first lookup
+ * has to go through the node cache or the database. It is shared between
+ * the middle and its clones, so it may be used from several threads. When
+ * it is full, the least recently used ways are dropped.
+*/
+
+#ifndef WAY_NODE_CACHE_H
+#define WAY_NODE_CACHE_H
+
+#include "osmtypes.hpp"
+
+#include <list>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+class way_node_cache : public boost::noncopyable {
+public:
+    explicit way_node_cache(size_t max_bytes);
+    ~way_node_cache();
+
+    // a malloc'd copy of the nodes of the way, or NULL if it isn't cached
+    struct osmNode *get(osmid_t id, int *count);
+    void set(osmid_t id, const struct osmNode *nodes, int count);
+
+    size_t hits() const;
+    size_t misses() const;
+
+private:
+    struct entry {
+        std::vector<osmNode> nodes;
+        std::list<osmid_t>::iterator lru;
+    };
+    typedef boost::unordered_map<osmid_t, entry> map_t;
+
+    // rough size of a cached way, including the bookkeeping
+    static size_t entry_bytes(size_t node_count);
+
+    map_t ways;
+    // most recently used at the front
+    std::list<osmid_t> lru;
+    size_t max_bytes, used_bytes;
+    size_t hit_count, miss_count;
+    mutable boost::mutex mutex;
+};
+
+#endif
@@ -0,0 +1,103 @@
+#include "wkb.hpp"
+
+#include <string.h>
+#include <boost/cstdint.hpp>
+
+#define WKB_POINT (1)
+#define WKB_LINESTRING (2)
+#define WKB_POLYGON (3)
+#define WKB_MULTIPOLYGON (6)
+
+namespace {
+const char hex_digits[] = "0123456789ABCDEF";
+
+inline void write_byte(std::string &out, uint8_t byte) {
+    out.push_back(hex_digits[byte >> 4]);
+    out.push_back(hex_digits[byte & 0xf]);
+}
+
+inline void write_uint32(std::string &out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        write_byte(out, uint8_t(value >> (8 * i)));
+    }
+}
+
+inline void write_double(std::string &out, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    for (int i = 0; i < 8; ++i) {
+        write_byte(out, uint8_t(bits >> (8 * i)));
+    }
+}
+
+inline void write_header(std::string &out, uint32_t type) {
+    //little endian
+    write_byte(out, 1);
+    write_uint32(out, type);
+}
+
+inline void write_nodes(std::string &out, const osmNode *nodes, int count) {
+    write_uint32(out, count);
+    for (int i = 0; i < count; ++i) {
+        write_double(out, nodes[i].lon);
+        write_double(out, nodes[i].lat);
+    }
+}
+
+inline int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+} // anonymous namespace
+
+namespace wkb {
+
+void write_point(std::string &out, double x, double y) {
+    out.reserve(out.size() + 42);
+    write_header(out, WKB_POINT);
+    write_double(out, x);
+    write_double(out, y);
+}
+
+void write_linestring(std::string &out, const osmNode *nodes, int count) {
+    out.reserve(out.size() + 18 + 32 * count);
+    write_header(out, WKB_LINESTRING);
+    write_nodes(out, nodes, count);
+}
+
+void write_polygon(std::string &out, const osmNode *nodes, int count) {
+    out.reserve(out.size() + 26 + 32 * count);
+    write_header(out, WKB_POLYGON);
+    //one ring
+    write_uint32(out, 1);
+    write_nodes(out, nodes, count);
+}
+
+bool is_polygon(const std::string &hex) {
+    //byte order followed by a 4 byte type
+    if (hex.size() < 10) {
+        return false;
+    }
+
+    int digits[10];
+    for (int i = 0; i < 10; ++i) {
+        if ((digits[i] = hex_value(hex[i])) < 0) {
+            return false;
+        }
+    }
+
+    const bool little_endian = ((digits[0] << 4) | digits[1]) == 1;
+    uint32_t type = 0;
+    for (int i = 0; i < 4; ++i) {
+        const uint32_t byte = (digits[2 + 2 * i] << 4) | digits[3 + 2 * i];
+        type |= little_endian ? (byte << (8 * i)) : (byte << (8 * (3 - i)));
+    }
+
+    //ignore the EWKB flags for SRID, Z and M
+    type &= 0x0fffffff;
+    return (type == WKB_POLYGON) || (type == WKB_MULTIPOLYGON);
+}
+
+} // namespace wkb
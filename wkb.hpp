@@ -0,0 +1,24 @@
+#ifndef WKB_HPP
+#define WKB_HPP
+
+#include "osmtypes.hpp"
+
+#include <string>
+
+/* Helpers for hex encoded well known binary (WKB), which PostGIS accepts
+ * as geometry input (with an SRID=...; prefix) in the same places as WKT.
+ * Geometries are written little endian and without any GEOS objects, so
+ * that the simple cases don't need float formatting or parsing at all. */
+namespace wkb {
+    // append a point
+    void write_point(std::string &out, double x, double y);
+    // append a linestring through count nodes
+    void write_linestring(std::string &out, const osmNode *nodes, int count);
+    // append a polygon with a single outer ring, the nodes must be closed
+    void write_polygon(std::string &out, const osmNode *nodes, int count);
+
+    // whether hex WKB (in either byte order) is a polygon or multipolygon
+    bool is_polygon(const std::string &hex);
+}
+
+#endif